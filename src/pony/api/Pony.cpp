@@ -0,0 +1,308 @@
+//===- Pony.cpp - Embedding API for the Pony compiler ---------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements libpony, the embedding API of the Pony compiler.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Pony.h"
+#include "pony/Dialect.h"
+#include "pony/JITSession.h"
+#include "pony/MLIRGen.h"
+#include "pony/Parser.h"
+#include "pony/Trace.h"
+
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/ExecutionEngine/ExecutionEngine.h"
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
+#include "mlir/Target/LLVMIR/Export.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <cstdlib>
+
+using namespace pony;
+
+static llvm::Error makeError(const llvm::Twine &message) {
+  return llvm::createStringError(llvm::inconvertibleErrorCode(), message);
+}
+
+void pony::configureForTarget(llvm::Module &llvmModule,
+                              const llvm::TargetMachine &targetMachine) {
+  llvmModule.setDataLayout(targetMachine.createDataLayout());
+  llvmModule.setTargetTriple(targetMachine.getTargetTriple().str());
+  for (llvm::Function &function : llvmModule) {
+    if (function.isDeclaration())
+      continue;
+    function.addFnAttr("target-cpu", targetMachine.getTargetCPU());
+    function.addFnAttr("target-features",
+                       targetMachine.getTargetFeatureString());
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Tensor
+//===----------------------------------------------------------------------===//
+
+Tensor::Tensor(Tensor &&other)
+    : allocated(other.allocated), values(other.values),
+      dims(std::move(other.dims)) {
+  other.allocated = nullptr;
+  other.values = nullptr;
+}
+
+Tensor &Tensor::operator=(Tensor &&other) {
+  if (this != &other) {
+    free(allocated);
+    allocated = other.allocated;
+    values = other.values;
+    dims = std::move(other.dims);
+    other.allocated = nullptr;
+    other.values = nullptr;
+  }
+  return *this;
+}
+
+Tensor::~Tensor() { free(allocated); }
+
+void *Tensor::release() {
+  void *result = allocated;
+  allocated = nullptr;
+  values = nullptr;
+  return result;
+}
+
+//===----------------------------------------------------------------------===//
+// Function
+//===----------------------------------------------------------------------===//
+
+/// Return the number of 64-bit words of the descriptor of a memref of rank
+/// `rank`: {allocated, aligned, offset, sizes[rank], strides[rank]}.
+static size_t getDescriptorSize(size_t rank) { return 3 + 2 * rank; }
+
+llvm::Expected<Tensor> Function::invoke(llvm::ArrayRef<TensorRef> args) const {
+  if (args.size() != argShapes.size())
+    return makeError("expected " + llvm::Twine(argShapes.size()) +
+                     " arguments, got " + llvm::Twine(args.size()));
+
+  // Describe each argument the way the compiled code expects memrefs of its
+  // static, contiguous shape, pointing straight at the caller's buffer.
+  std::vector<llvm::SmallVector<int64_t, 8>> descriptors(args.size());
+  llvm::SmallVector<void *, 4> descriptorPointers;
+  for (auto it : llvm::enumerate(args)) {
+    const TensorRef &arg = it.value();
+    llvm::ArrayRef<int64_t> shape = argShapes[it.index()];
+    if (arg.shape != shape)
+      return makeError("argument " + llvm::Twine(it.index()) +
+                       " does not have the shape the function was compiled "
+                       "for");
+
+    auto &descriptor = descriptors[it.index()];
+    descriptor.resize(getDescriptorSize(shape.size()));
+    descriptor[0] = reinterpret_cast<intptr_t>(arg.data);
+    descriptor[1] = reinterpret_cast<intptr_t>(arg.data);
+    descriptor[2] = 0;
+    int64_t stride = 1;
+    for (size_t i = shape.size(); i-- > 0;) {
+      descriptor[3 + i] = shape[i];
+      descriptor[3 + shape.size() + i] = stride;
+      stride *= shape[i];
+    }
+    descriptorPointers.push_back(descriptor.data());
+  }
+
+  // The C interface of the function takes a pointer to each descriptor,
+  // preceded by a pointer to the descriptor of the result, if any. The packed
+  // form takes a pointer to each of these pointers.
+  llvm::SmallVector<int64_t, 8> result;
+  void *resultPointer = nullptr;
+  llvm::SmallVector<void *, 4> packedArgs;
+  if (resultShape) {
+    result.resize(getDescriptorSize(resultShape->size()));
+    resultPointer = result.data();
+    packedArgs.push_back(&resultPointer);
+  }
+  for (void *&pointer : descriptorPointers)
+    packedArgs.push_back(&pointer);
+  function(packedArgs.data());
+
+  if (!resultShape)
+    return Tensor();
+  return Tensor(reinterpret_cast<void *>(result[0]),
+                reinterpret_cast<double *>(result[1]) + result[2],
+                *resultShape);
+}
+
+//===----------------------------------------------------------------------===//
+// CompiledModule
+//===----------------------------------------------------------------------===//
+
+CompiledModule::~CompiledModule() = default;
+
+/// Return the shape of `type`, a ranked tensor.
+static std::vector<int64_t> getShape(mlir::Type type) {
+  auto shape = type.cast<mlir::RankedTensorType>().getShape();
+  return std::vector<int64_t>(shape.begin(), shape.end());
+}
+
+llvm::Error pony::declareEntryPoints(mlir::ModuleOp module,
+                                     llvm::ArrayRef<EntryPoint> entryPoints) {
+  // Entry points are public, with the argument shapes they are called with.
+  mlir::MLIRContext *context = module.getContext();
+  for (const EntryPoint &entryPoint : entryPoints) {
+    auto function = module.lookupSymbol<mlir::pony::FuncOp>(entryPoint.name);
+    if (!function)
+      return makeError("no function named '" + entryPoint.name + "'");
+    if (function.getNumArguments() != entryPoint.argShapes.size())
+      return makeError("function '" + entryPoint.name + "' takes " +
+                       llvm::Twine(function.getNumArguments()) +
+                       " arguments");
+
+    llvm::SmallVector<mlir::Type, 4> argTypes;
+    for (const auto &shape : entryPoint.argShapes)
+      argTypes.push_back(mlir::RankedTensorType::get(
+          shape, mlir::FloatType::getF64(context)));
+    function.setType(mlir::FunctionType::get(
+        context, argTypes, function.getFunctionType().getResults()));
+    for (auto it : llvm::zip(function.getArguments(), argTypes))
+      std::get<0>(it).setType(std::get<1>(it));
+    function.setPublic();
+  }
+  return llvm::Error::success();
+}
+
+llvm::Expected<std::unique_ptr<CompiledModule>>
+CompiledModule::compile(llvm::StringRef source,
+                        llvm::ArrayRef<EntryPoint> entryPoints,
+                        const CompileOptions &options) {
+  mlir::DialectRegistry registry;
+  registry.insert<mlir::pony::PonyDialect>();
+  mlir::registerLLVMDialectTranslation(registry);
+  auto context = std::make_unique<mlir::MLIRContext>(registry);
+  context->loadDialect<mlir::pony::PonyDialect>();
+
+  // Collect the diagnostics for the error.
+  std::string diagnostics;
+  llvm::raw_string_ostream os(diagnostics);
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBuffer(source, "<source>"), llvm::SMLoc());
+  mlir::SourceMgrDiagnosticHandler diagHandler(sourceMgr, context.get(), os);
+
+  // The lexer wants a nul terminated buffer.
+  std::string buffer = source.str();
+  LexerBuffer lexer(buffer.c_str(), buffer.c_str() + buffer.size(),
+                    "<source>");
+  lexer.setEchoTokens(false);
+  Parser parser(lexer);
+  std::unique_ptr<ModuleAST> moduleAST = parser.parseModule();
+  if (!moduleAST)
+    return makeError("failed to parse the Pony source");
+  mlir::OwningOpRef<mlir::ModuleOp> module = mlirGen(*context, *moduleAST);
+  if (!module)
+    return makeError(os.str());
+
+  if (llvm::Error err = declareEntryPoints(*module, entryPoints))
+    return std::move(err);
+
+  mlir::PassManager pm(context.get());
+  buildPipeline(pm, LoweringTarget::LLVM, options);
+  if (mlir::failed(pm.run(*module)))
+    return makeError(os.str());
+
+  auto compiled = load(*module, options);
+  if (compiled)
+    (*compiled)->context = std::move(context);
+  return compiled;
+}
+
+llvm::Expected<std::unique_ptr<CompiledModule>>
+CompiledModule::load(mlir::ModuleOp module, const CompileOptions &options,
+                     llvm::TargetMachine *targetMachine, Tracer *tracer) {
+  std::unique_ptr<CompiledModule> compiled(new CompiledModule());
+
+  // The lowering keeps the Pony signature of every public function.
+  for (auto function : module.getOps<mlir::LLVM::LLVMFuncOp>()) {
+    auto signature = function->getAttrOfType<mlir::TypeAttr>("pony.signature");
+    if (!signature)
+      continue;
+    auto type = signature.getValue().cast<mlir::FunctionType>();
+    Signature &entry = compiled->signatures[function.getName()];
+    for (mlir::Type input : type.getInputs())
+      entry.argShapes.push_back(getShape(input));
+    if (type.getNumResults())
+      entry.resultShape = getShape(type.getResult(0));
+  }
+
+  static bool initialized = [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    return true;
+  }();
+  (void)initialized;
+
+  // The engine only refers to the callbacks, which must outlive its creation.
+  auto buildLLVMModule = [targetMachine, tracer](
+                             mlir::ModuleOp module,
+                             llvm::LLVMContext &llvmContext) {
+    TraceScope scope(tracer, "TranslateToLLVMIR");
+    auto llvmModule = mlir::translateModuleToLLVMIR(module, llvmContext);
+    // Tag the LLVM IR with the target cpu and features, so that the JIT's
+    // code generator uses them too.
+    if (llvmModule && targetMachine)
+      configureForTarget(*llvmModule, *targetMachine);
+    return llvmModule;
+  };
+  auto optPipeline = mlir::makeOptimizingTransformer(
+      options.optLevel, options.sizeLevel, targetMachine);
+  auto optimize = [&optPipeline, tracer](llvm::Module *llvmModule) {
+    TraceScope scope(tracer, "OptimizeLLVMIR");
+    return optPipeline(llvmModule);
+  };
+
+  mlir::ExecutionEngineOptions engineOptions;
+  engineOptions.llvmModuleBuilder = buildLLVMModule;
+  engineOptions.transformer = optimize;
+  engineOptions.jitCodeGenOptLevel =
+      targetMachine ? targetMachine->getOptLevel()
+                    : static_cast<llvm::CodeGenOpt::Level>(options.optLevel);
+  auto engine = mlir::ExecutionEngine::create(module, engineOptions);
+  if (!engine)
+    return engine.takeError();
+  compiled->engine = std::move(*engine);
+
+  // Bind the runtime entry points the lowered code calls into to the copies
+  // linked into this library.
+  compiled->engine->registerSymbols(getRuntimeSymbols);
+  return std::move(compiled);
+}
+
+llvm::Expected<Function> CompiledModule::lookup(llvm::StringRef name) const {
+  auto signature = signatures.find(name);
+  if (signature == signatures.end())
+    return makeError("no public function named '" + name + "'");
+
+  // Call the wrapper taking memref descriptors by pointer.
+  auto function = engine->lookup(("_mlir_ciface_" + name).str());
+  if (!function)
+    return function.takeError();
+  return Function(*function, signature->second.argShapes,
+                  signature->second.resultShape);
+}
+
+llvm::Error CompiledModule::runMain() const {
+  auto signature = signatures.find("main");
+  if (signature != signatures.end() &&
+      (!signature->second.argShapes.empty() || signature->second.resultShape))
+    return makeError("'main' takes arguments or returns a value, call it "
+                     "through lookup instead");
+  return engine->invokePacked("main");
+}
@@ -0,0 +1,326 @@
+//===- CompilerWorker.cpp - Batch compilation and -serve ------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the runners compiling many programs in one process:
+// the batch compilation of several input files and the requests of -serve.
+// Each of their threads keeps a worker with its own context, pass pipelines
+// and target machine warm from one input to the next.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Driver.h"
+#include "pony/AST.h"
+#include "pony/Dialect.h"
+#include "pony/JITSession.h"
+#include "pony/MLIRGen.h"
+#include "pony/Runtime.h"
+#include "pony/Trace.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/Parser/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Support/FileUtilities.h"
+#include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+using namespace pony;
+
+namespace {
+/// The dialects every worker context starts out with.
+struct PonyDialectRegistry : public mlir::DialectRegistry {
+  PonyDialectRegistry() {
+    insert<mlir::pony::PonyDialect>();
+    mlir::registerLLVMDialectTranslation(*this);
+  }
+};
+
+/// Everything a worker thread of -serve or of a batch compilation keeps warm
+/// between inputs: a context with the dialects loaded, the pass pipeline with
+/// its frozen pattern sets, the target machine and, for -serve, the JIT.
+struct CompilerWorker {
+  CompilerWorker(const mlir::DialectRegistry &registry,
+                 const DriverOptions &options, Action action)
+      : context(registry), options(options), action(action) {
+    // There already is one input per thread.
+    context.disableMultithreading();
+    context.getOrLoadDialect<mlir::pony::PonyDialect>();
+  }
+
+  /// Return the pipeline lowering modules at stage `from`, built on first use.
+  mlir::PassManager &getPipeline(Stage from) {
+    auto &pm = pipelines[static_cast<unsigned>(from)];
+    if (!pm) {
+      pm = std::make_unique<mlir::PassManager>(&context);
+      buildDriverPipeline(*pm, getLoweringTarget(options, action, from),
+                          options, /*cache=*/nullptr, from);
+    }
+    return *pm;
+  }
+
+  mlir::MLIRContext context;
+  const DriverOptions &options;
+  Action action;
+  std::unique_ptr<mlir::PassManager> pipelines[4];
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+  std::unique_ptr<JITSession> session;
+  unsigned numInputs = 0;
+};
+} // namespace
+
+/// Attributes and types are never freed from a context, so start over with a
+/// fresh worker every so often to keep the memory of long runs bounded.
+static constexpr unsigned kWorkerInputLimit = 1000;
+
+/// Return the worker of the calling thread compiling for `action` with
+/// `options`, which must outlive it, or nullptr after setting `error`.
+static CompilerWorker *getThreadWorker(const DriverOptions &options,
+                                       Action action, std::string &error) {
+  static const PonyDialectRegistry registry;
+  thread_local std::unique_ptr<CompilerWorker> worker;
+  if (!worker || worker->numInputs == kWorkerInputLimit ||
+      &worker->options != &options || worker->action != action) {
+    worker.reset();
+    auto newWorker =
+        std::make_unique<CompilerWorker>(registry, options, action);
+    newWorker->targetMachine = createTargetMachine(options);
+    if (!newWorker->targetMachine) {
+      error = "Failed to create a target machine\n";
+      return nullptr;
+    }
+    worker = std::move(newWorker);
+  }
+  ++worker->numInputs;
+  return worker.get();
+}
+
+int pony::serveRequest(const DriverOptions &options, llvm::StringRef source,
+                       std::string &output) {
+  TraceScope scope(options.tracer, "ServeRequest");
+  CompilerWorker *worker = getThreadWorker(options, Action::RunJIT, output);
+  if (!worker)
+    return -1;
+  if (!worker->session) {
+    if (!isHostTriple(worker->targetMachine->getTargetTriple())) {
+      output = "Can't JIT code for a target other than the host\n";
+      return -1;
+    }
+    auto session = JITSession::create(*worker->targetMachine);
+    if (!session) {
+      output = "Failed to create the JIT: " +
+               llvm::toString(session.takeError()) + "\n";
+      return -1;
+    }
+    worker->session = std::move(*session);
+  }
+
+  // Report the diagnostics of this request back to the client.
+  llvm::raw_string_ostream diagnostics(output);
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBuffer(source, "<request>"), llvm::SMLoc());
+  mlir::SourceMgrDiagnosticHandler diagHandler(sourceMgr, &worker->context,
+                                               diagnostics);
+
+  auto moduleAST = parseSource(source, "<request>", /*echoTokens=*/false);
+  if (!moduleAST) {
+    diagnostics << "Failed to parse the program\n";
+    return 6;
+  }
+  mlir::OwningOpRef<mlir::ModuleOp> module =
+      mlirGen(worker->context, *moduleAST);
+  if (!module)
+    return 1;
+  LoweringTarget target = getLoweringTarget(options, Action::RunJIT);
+  if (mlir::failed(runPipeline(worker->getPipeline(Stage::Pony), target,
+                               options.compile, *module)))
+    return 4;
+
+  auto llvmContext = std::make_unique<llvm::LLVMContext>();
+  auto llvmModule =
+      translateAndOptimize(*module, *llvmContext, *worker->targetMachine,
+                           worker->options.compile, options.tracer);
+  if (!llvmModule) {
+    diagnostics << "Failed to emit LLVM IR\n";
+    return -1;
+  }
+  module = nullptr;
+
+  // Capture what the program prints on this thread.
+  std::string programOutput;
+  pony_set_output(
+      [](void *context, const char *data, size_t length) {
+        static_cast<std::string *>(context)->append(data, length);
+      },
+      &programOutput);
+  TraceScope runScope(options.tracer, "JITRun");
+  llvm::Error err = worker->session->run(llvm::orc::ThreadSafeModule(
+      std::move(llvmModule), std::move(llvmContext)));
+  runScope.end();
+  pony_set_output(nullptr, nullptr);
+  if (err) {
+    diagnostics << "JIT invocation failed: " << llvm::toString(std::move(err))
+                << "\n";
+    return -1;
+  }
+
+  diagnostics.flush();
+  output = std::move(programOutput);
+  return 0;
+}
+
+/// Compile `inputPath` as `options` say on the worker of the calling thread and
+/// write the result to `outputPath`. Diagnostics go to `diagnostics`.
+static bool compileBatchInput(const DriverOptions &options,
+                              llvm::StringRef inputPath,
+                              llvm::StringRef outputPath,
+                              std::string &diagnostics) {
+  TraceScope scope(options.tracer, "CompileInput", inputPath);
+  Action action = options.action;
+  CompilerWorker *worker = getThreadWorker(options, action, diagnostics);
+  if (!worker)
+    return false;
+
+  llvm::raw_string_ostream os(diagnostics);
+  auto fileOrErr = llvm::MemoryBuffer::getFile(inputPath);
+  if (std::error_code ec = fileOrErr.getError()) {
+    os << "Could not open input file " << inputPath << ": " << ec.message()
+       << "\n";
+    return false;
+  }
+  llvm::SourceMgr sourceMgr;
+  unsigned bufferId =
+      sourceMgr.AddNewSourceBuffer(std::move(*fileOrErr), llvm::SMLoc());
+  mlir::SourceMgrDiagnosticHandler diagHandler(sourceMgr, &worker->context,
+                                               os);
+
+  mlir::OwningOpRef<mlir::ModuleOp> module;
+  if (options.inputType == InputType::MLIR || inputPath.endswith(".mlir")) {
+    module = mlir::parseSourceFile<mlir::ModuleOp>(sourceMgr, &worker->context);
+  } else if (auto moduleAST =
+                 parseSource(sourceMgr.getMemoryBuffer(bufferId)->getBuffer(),
+                             inputPath, /*echoTokens=*/false)) {
+    module = mlirGen(worker->context, *moduleAST);
+  } else {
+    os << "Failed to parse " << inputPath << "\n";
+  }
+  if (!module)
+    return false;
+  Stage from = getStage(*module);
+  if (mlir::failed(runPipeline(worker->getPipeline(from),
+                               getLoweringTarget(options, action, from),
+                               worker->options.compile, *module)))
+    return false;
+
+  std::string errorMessage;
+  if (action <= Action::DumpMLIRLLVM) {
+    auto output = mlir::openOutputFile(outputPath, &errorMessage);
+    if (!output) {
+      os << errorMessage << "\n";
+      return false;
+    }
+    printModule(*module, output->os());
+    output->keep();
+    return true;
+  }
+
+  llvm::LLVMContext llvmContext;
+  auto llvmModule =
+      translateAndOptimize(*module, llvmContext, *worker->targetMachine,
+                           worker->options.compile, options.tracer);
+  if (!llvmModule)
+    return false;
+  if (action == Action::DumpLLVMIR) {
+    auto output = mlir::openOutputFile(outputPath, &errorMessage);
+    if (!output) {
+      os << errorMessage << "\n";
+      return false;
+    }
+    output->os() << *llvmModule;
+    output->keep();
+    return true;
+  }
+  return writeNativeCode(*llvmModule, *worker->targetMachine, options, action,
+                         outputPath);
+}
+
+int pony::compileBatch(const DriverOptions &options,
+                       llvm::ArrayRef<std::string> inputs) {
+  Action action = options.action;
+  if (action < Action::DumpMLIR || action >= Action::RunJIT) {
+    llvm::errs() << "Compiling several files requires -emit=mlir, "
+                    "mlir-affine, mlir-llvm, llvm, asm, obj or shared\n";
+    return -1;
+  }
+  if (!options.outputFilename.empty()) {
+    llvm::errs() << "-o can't be used with several input files, use "
+                    "-output-dir instead\n";
+    return -1;
+  }
+  if (action >= Action::DumpLLVMIR) {
+    // Report a bad target configuration once rather than for every file.
+    auto targetMachine = createTargetMachine(options);
+    if (!targetMachine || !checkTargetSupportsAction(*targetMachine, action))
+      return -1;
+  }
+  if (std::error_code ec =
+          llvm::sys::fs::create_directories(options.outputDirectory)) {
+    llvm::errs() << "Could not create the output directory "
+                 << options.outputDirectory << ": " << ec.message() << "\n";
+    return -1;
+  }
+
+  std::vector<std::string> outputs;
+  llvm::StringMap<llvm::StringRef> outputToInput;
+  for (const std::string &input : inputs) {
+    llvm::SmallString<128> path(options.outputDirectory);
+    llvm::sys::path::append(path, llvm::sys::path::filename(input));
+    llvm::sys::path::replace_extension(path, getOutputExtension(action));
+    auto inserted = outputToInput.try_emplace(path, input);
+    if (!inserted.second) {
+      llvm::errs() << "Inputs " << inserted.first->second << " and " << input
+                   << " would both be written to " << path << "\n";
+      return -1;
+    }
+    outputs.push_back(std::string(path));
+  }
+
+  std::vector<std::string> diagnostics(inputs.size());
+  std::vector<char> succeeded(inputs.size());
+  {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(options.numJobs));
+    for (size_t i = 0, e = inputs.size(); i != e; ++i)
+      pool.async([&, i] {
+        succeeded[i] =
+            compileBatchInput(options, inputs[i], outputs[i], diagnostics[i]);
+      });
+    pool.wait();
+  }
+
+  unsigned numFailed = 0;
+  for (size_t i = 0, e = inputs.size(); i != e; ++i) {
+    llvm::errs() << diagnostics[i];
+    if (!succeeded[i]) {
+      llvm::errs() << "Failed to compile " << inputs[i] << "\n";
+      ++numFailed;
+    }
+  }
+  if (numFailed) {
+    llvm::errs() << numFailed << " of " << inputs.size()
+                 << " files failed to compile\n";
+    return 1;
+  }
+  return 0;
+}
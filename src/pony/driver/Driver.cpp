@@ -0,0 +1,759 @@
+//===- Driver.cpp - The compiler driver behind ponyc ----------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the compilation of a single input by the driver, from
+// its source to the stage, the native code or the run its action asks for,
+// and the building blocks the other runners share.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Driver.h"
+#include "pony/AST.h"
+#include "pony/Dialect.h"
+#include "pony/FastCodegen.h"
+#include "pony/IRStats.h"
+#include "pony/Interpreter.h"
+#include "pony/MLIRGen.h"
+#include "pony/ParallelCodegen.h"
+#include "pony/Parser.h"
+#include "pony/Passes.h"
+#include "pony/Pony.h"
+#include "pony/Trace.h"
+
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/Parser/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Support/FileUtilities.h"
+#include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
+#include "mlir/Target/LLVMIR/Export.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include <limits>
+
+using namespace pony;
+
+//===----------------------------------------------------------------------===//
+// Parsing and the pass pipeline
+//===----------------------------------------------------------------------===//
+
+std::unique_ptr<ModuleAST> pony::parseSource(llvm::StringRef buffer,
+                                             llvm::StringRef filename,
+                                             bool echoTokens) {
+  LexerBuffer lexer(buffer.begin(), buffer.end(), std::string(filename));
+  lexer.setEchoTokens(echoTokens);
+  Parser parser(lexer);
+  return parser.parseModule();
+}
+
+std::unique_ptr<ModuleAST> pony::parseInputFile(llvm::StringRef filename) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
+      llvm::MemoryBuffer::getFileOrSTDIN(filename);
+  if (std::error_code ec = fileOrErr.getError()) {
+    llvm::errs() << "Could not open input file: " << ec.message() << "\n";
+    return nullptr;
+  }
+  return parseSource(fileOrErr.get()->getBuffer(), filename);
+}
+
+/// Load the input of `options` into `module`, parsing it as MLIR or as Pony
+/// source. Returns the exit code of the driver on failure, 0 otherwise.
+static int loadMLIR(const DriverOptions &options, mlir::MLIRContext &context,
+                    mlir::OwningOpRef<mlir::ModuleOp> &module) {
+  const std::string &inputFilename = options.inputFilename;
+
+  // Handle '.pony' input to the compiler.
+  if (options.inputType != InputType::MLIR &&
+      !llvm::StringRef(inputFilename).endswith(".mlir")) {
+    std::unique_ptr<ModuleAST> moduleAST;
+    {
+      TraceScope scope(options.tracer, "Parse", inputFilename);
+      moduleAST = parseInputFile(inputFilename);
+    }
+    if (!moduleAST) return 6;
+    TraceScope scope(options.tracer, "MLIRGen", inputFilename);
+    module = mlirGen(context, *moduleAST);
+    return !module ? 1 : 0;
+  }
+
+  // Otherwise, the input is '.mlir'.
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
+      llvm::MemoryBuffer::getFileOrSTDIN(inputFilename);
+  if (std::error_code ec = fileOrErr.getError()) {
+    llvm::errs() << "Could not open input file: " << ec.message() << "\n";
+    return -1;
+  }
+
+  // Parse the input mlir.
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(std::move(*fileOrErr), llvm::SMLoc());
+  {
+    TraceScope scope(options.tracer, "ParseMLIR", inputFilename);
+    module = mlir::parseSourceFile<mlir::ModuleOp>(sourceMgr, &context);
+  }
+  if (!module) {
+    llvm::errs() << "Error can't load file " << inputFilename << "\n";
+    return 3;
+  }
+  return 0;
+}
+
+LoweringTarget pony::getLoweringTarget(const DriverOptions &options,
+                                      Action action, Stage from) {
+  if (action == Action::DumpCost)
+    return LoweringTarget::Specialized;
+  if (action >= Action::DumpLLVMIR && options.fastCompile &&
+      from <= Stage::Specialized)
+    return LoweringTarget::Specialized;
+  if (action >= Action::DumpMLIRLLVM)
+    return LoweringTarget::LLVM;
+  if (action >= Action::DumpMLIRAffine)
+    return LoweringTarget::Affine;
+  return LoweringTarget::Pony;
+}
+
+void pony::buildDriverPipeline(mlir::PassManager &pm, LoweringTarget target,
+                               const DriverOptions &options,
+                               mlir::pony::SpecializationCache *cache,
+                               Stage from) {
+  // Apply any generic pass manager command line options.
+  applyPassManagerCLOptions(pm);
+  if (options.tracer)
+    pm.addInstrumentation(createTraceInstrumentation(*options.tracer));
+  if (options.irStatsRecorder)
+    pm.addInstrumentation(
+        createIRStatsInstrumentation(*options.irStatsRecorder));
+  pony::buildPipeline(pm, target, options.compile, cache, from);
+}
+
+mlir::LogicalResult pony::runPipeline(mlir::PassManager &pm,
+                                     LoweringTarget target,
+                                     const CompileOptions &options,
+                                     mlir::ModuleOp module) {
+  Stage from = getStage(module);
+  if (mlir::failed(pm.run(module)))
+    return mlir::failure();
+  setStage(module, getStageAfter(target, options, from));
+  return mlir::success();
+}
+
+void pony::printModule(mlir::ModuleOp module, llvm::raw_ostream &os) {
+  mlir::OpPrintingFlags flags;
+  flags.printLargeElementsAttrWithHex(/*largeElementLimit=*/16);
+  module.print(os, flags);
+}
+
+/// Lower `module` as far as the action of `options` needs it.
+static int processMLIR(const DriverOptions &options, mlir::MLIRContext &context,
+                       mlir::OwningOpRef<mlir::ModuleOp> &module) {
+  // A module saved at some stage resumes lowering from there.
+  Stage from = getStage(*module);
+  LoweringTarget target = getLoweringTarget(options, options.action, from);
+  mlir::PassManager pm(&context);
+  buildDriverPipeline(pm, target, options, /*cache=*/nullptr, from);
+  TraceScope scope(options.tracer, "Pipeline");
+  if (mlir::failed(runPipeline(pm, target, options.compile, *module)))
+    return 4;
+  return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// Dumps of a single input
+//===----------------------------------------------------------------------===//
+
+static int dumpToken(const DriverOptions &options) {
+  const std::string &inputFilename = options.inputFilename;
+  if (options.inputType == InputType::MLIR) {
+    llvm::errs() << "Can't dump Pony Tokens when the input is MLIR\n";
+    return 5;
+  }
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
+      llvm::MemoryBuffer::getFileOrSTDIN(inputFilename);
+  if (std::error_code ec = fileOrErr.getError()) {
+    llvm::errs() << "Could not open input file: " << ec.message() << "\n";
+    return 0;
+  }
+  auto buffer = fileOrErr.get()->getBuffer();
+  // 初始化lexer
+  LexerBuffer lexer(buffer.begin(), buffer.end(), std::string(inputFilename));
+
+  lexer.getNextToken();  // prime the lexer
+
+  // Consume and record all tokens until EOF
+  while (lexer.getCurToken() != pony::tok_eof) {
+    lexer.getNextToken();
+  }
+  // Include the EOF token
+  // lexer.getNextToken();
+
+  // If any lexical errors were detected, report and exit
+  if (lexer.hadLexError()) {
+    llvm::errs() << "\n Lexical analysis encountered errors.\n";
+    return 1;
+  }
+
+
+  // Otherwise, print all recorded tokens in order
+  // auto tokens = lexer.getRecordedTokens();
+  // for (auto tok : tokens) {
+  //   std::string name;
+  //   switch (tok) {
+  //   case pony::tok_eof:             name = "EOF"; break;
+  //   case pony::tok_return:          name = "return"; break;
+  //   case pony::tok_var:             name = "var"; break;
+  //   case pony::tok_def:             name = "def"; break;
+  //   case pony::tok_identifier:      name = "identifier"; break;
+  //   case pony::tok_number:          name = "number"; break;
+  //   case pony::tok_semicolon:       name = ";"; break;
+  //   case pony::tok_parenthese_open: name = "("; break;
+  //   case pony::tok_parenthese_close:name = ")"; break;
+  //   case pony::tok_bracket_open:    name = "{"; break;
+  //   case pony::tok_bracket_close:   name = "}"; break;
+  //   case pony::tok_sbracket_open:   name = "["; break;
+  //   case pony::tok_sbracket_close:  name = "]"; break;
+  //   case pony::tok_comma:          name = ","; break;
+  //   default:
+  //     // For other single-character tokens
+  //     name += char(tok); //output directly
+  //   }
+  //   llvm::outs() << name << ' ';
+  // }
+  return 0;
+}
+
+static int dumpAST(const DriverOptions &options) {
+  if (options.inputType == InputType::MLIR) {
+    llvm::errs() << "Can't dump a Pony AST when the input is MLIR\n";
+    return 5;
+  }
+
+  auto moduleAST = parseInputFile(options.inputFilename);
+  if (!moduleAST) return 1;
+
+  dump(*moduleAST);
+  return 0;
+}
+
+/// Interpret `module`, which must not be lowered past the Pony dialect, giving
+/// up before it does more than `workLimit` units of work. What the program
+/// prints is only written out once it finished, so a program given up on can
+/// still be run another way.
+static mlir::pony::InterpretResult interpret(mlir::ModuleOp module,
+                                             uint64_t workLimit) {
+  std::string output;
+  auto result = mlir::pony::interpretMain(module, output, workLimit);
+  if (result == mlir::pony::InterpretResult::Success)
+    llvm::outs() << output;
+  return result;
+}
+
+//===----------------------------------------------------------------------===//
+// Targets and LLVM IR
+//===----------------------------------------------------------------------===//
+
+bool pony::isHostTriple(const llvm::Triple &triple) {
+  llvm::Triple host(llvm::sys::getProcessTriple());
+  return triple.getArch() == host.getArch() && triple.getOS() == host.getOS();
+}
+
+std::unique_ptr<llvm::TargetMachine>
+pony::createTargetMachine(const DriverOptions &options) {
+  // Initialize every target, so that -mtriple can cross compile. This only
+  // needs to happen once, even when -serve workers get here concurrently.
+  static bool targetsInitialized = [] {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+    return true;
+  }();
+  (void)targetsInitialized;
+
+  llvm::Triple triple(options.targetTriple.empty()
+                          ? llvm::sys::getDefaultTargetTriple()
+                          : llvm::Triple::normalize(options.targetTriple));
+  std::string error;
+  const llvm::Target *target =
+      llvm::TargetRegistry::lookupTarget(triple.str(), error);
+  if (!target) {
+    llvm::errs() << "Failed to find target for '" << triple.str()
+                 << "': " << error << "\n";
+    return nullptr;
+  }
+
+  std::string cpu = options.targetCPU;
+  llvm::SubtargetFeatures features;
+  if (cpu.empty() || cpu == "native") {
+    cpu = "generic";
+    if (isHostTriple(triple)) {
+      cpu = llvm::sys::getHostCPUName().str();
+      llvm::StringMap<bool> hostFeatures;
+      if (llvm::sys::getHostCPUFeatures(hostFeatures))
+        for (auto &feature : hostFeatures)
+          features.AddFeature(feature.first(), feature.second);
+    }
+  }
+  for (const std::string &attr : options.targetAttrs)
+    features.AddFeature(attr);
+
+  // Generate position independent code so that the result can go into a
+  // shared library as well as an executable.
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple.str(), cpu, features.getString(), llvm::TargetOptions(),
+      llvm::Reloc::PIC_, llvm::None,
+      static_cast<llvm::CodeGenOpt::Level>(options.compile.optLevel)));
+}
+
+std::unique_ptr<llvm::TargetMachine>
+pony::createJITTargetMachine(const DriverOptions &options) {
+  auto targetMachine = createTargetMachine(options);
+  if (targetMachine && !isHostTriple(targetMachine->getTargetTriple())) {
+    llvm::errs() << "Can't JIT code for a target other than the host\n";
+    return nullptr;
+  }
+  return targetMachine;
+}
+
+bool pony::optimizeLLVMIR(llvm::Module &llvmModule,
+                          llvm::TargetMachine &targetMachine,
+                          const CompileOptions &options, Tracer *tracer) {
+  TraceScope scope(tracer, "OptimizeLLVMIR");
+  auto optPipeline = mlir::makeOptimizingTransformer(
+      options.optLevel, options.sizeLevel, &targetMachine);
+  if (auto err = optPipeline(&llvmModule)) {
+    llvm::errs() << "Failed to optimize LLVM IR " << err << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<llvm::Module>
+pony::translateToLLVMIR(mlir::ModuleOp module, llvm::LLVMContext &llvmContext,
+                        Tracer *tracer) {
+  TraceScope scope(tracer, "TranslateToLLVMIR");
+  std::unique_ptr<llvm::Module> llvmModule;
+  if (getStage(module) <= Stage::Specialized)
+    llvmModule = mlir::pony::translateToLLVMIRDirectly(module, llvmContext);
+  else
+    llvmModule = mlir::translateModuleToLLVMIR(module, llvmContext);
+  if (!llvmModule)
+    llvm::errs() << "Failed to emit LLVM IR\n";
+  return llvmModule;
+}
+
+std::unique_ptr<llvm::Module>
+pony::translateAndOptimize(mlir::ModuleOp module,
+                           llvm::LLVMContext &llvmContext,
+                           llvm::TargetMachine &targetMachine,
+                           const CompileOptions &options, Tracer *tracer) {
+  auto llvmModule = translateToLLVMIR(module, llvmContext, tracer);
+  if (!llvmModule)
+    return nullptr;
+  configureForTarget(*llvmModule, targetMachine);
+  if (!optimizeLLVMIR(*llvmModule, targetMachine, options, tracer))
+    return nullptr;
+  return llvmModule;
+}
+
+/// Print the LLVM IR of `module` to stderr.
+static int dumpLLVMIR(const DriverOptions &options, mlir::ModuleOp module) {
+  auto targetMachine = createTargetMachine(options);
+  if (!targetMachine)
+    return -1;
+
+  // Register the translation to LLVM IR with the MLIR context.
+  mlir::registerLLVMDialectTranslation(*module->getContext());
+  // Convert the module to LLVM IR in a new LLVM IR context.
+  llvm::LLVMContext llvmContext;
+  auto llvmModule = translateToLLVMIR(module, llvmContext, options.tracer);
+  if (!llvmModule)
+    return -1;
+  configureForTarget(*llvmModule, *targetMachine);
+
+  /// Optionally run an optimization pipeline over the llvm module.
+  if (!optimizeLLVMIR(*llvmModule, *targetMachine, options.compile,
+                      options.tracer))
+    return -1;
+  llvm::errs() << *llvmModule << "\n";
+  return 0;
+}
+
+/// Write the roofline report of `module`, specialized, to -o or stdout.
+static int dumpCost(const DriverOptions &options, mlir::ModuleOp module) {
+  std::string errorMessage;
+  auto output = mlir::openOutputFile(
+      options.outputFilename.empty() ? "-" : options.outputFilename,
+      &errorMessage);
+  if (!output) {
+    llvm::errs() << errorMessage << "\n";
+    return -1;
+  }
+  mlir::PassManager pm(module.getContext());
+  pm.addPass(mlir::pony::createCostReportPass(output->os(), options.roofline));
+  if (mlir::failed(pm.run(module)))
+    return 4;
+  output->keep();
+  return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// Native code
+//===----------------------------------------------------------------------===//
+
+/// Return the file the output of an ahead-of-time compilation goes to: `-o`
+/// if given, otherwise the input file name with `extension` instead of its
+/// own.
+static std::string getOutputFilename(const DriverOptions &options,
+                                     llvm::StringRef extension) {
+  if (!options.outputFilename.empty())
+    return options.outputFilename;
+  if (options.inputFilename == "-")
+    return ("a" + extension).str();
+  llvm::SmallString<128> path(
+      llvm::sys::path::filename(options.inputFilename));
+  llvm::sys::path::replace_extension(path, extension);
+  return std::string(path);
+}
+
+/// Run the code generator of `targetMachine` over `llvmModule`, writing an
+/// object or assembly file to `path`.
+static bool writeMachineCode(llvm::Module &llvmModule,
+                             llvm::TargetMachine &targetMachine,
+                             llvm::StringRef path,
+                             llvm::CodeGenFileType fileType) {
+  std::string errorMessage;
+  auto output = mlir::openOutputFile(path, &errorMessage);
+  if (!output) {
+    llvm::errs() << errorMessage << "\n";
+    return false;
+  }
+
+  llvm::legacy::PassManager codegenPasses;
+  if (targetMachine.addPassesToEmitFile(codegenPasses, output->os(), nullptr,
+                                        fileType)) {
+    llvm::errs() << "Target can't emit a file of this type\n";
+    return false;
+  }
+  codegenPasses.run(llvmModule);
+  output->keep();
+  return true;
+}
+
+/// Link `objectPaths` into `outputPath` with the system compiler driver: into
+/// a shared library together with the Pony runtime at `runtimeLibrary` if
+/// `shared`, otherwise into a single relocatable object.
+static bool linkObjects(llvm::ArrayRef<std::string> objectPaths,
+                        llvm::StringRef outputPath, bool shared,
+                        llvm::StringRef runtimeLibrary) {
+  auto linker = llvm::sys::findProgramByName("cc");
+  if (!linker) {
+    llvm::errs() << "Could not find 'cc' to link " << outputPath << ": "
+                 << linker.getError().message() << "\n";
+    return false;
+  }
+
+  llvm::SmallVector<llvm::StringRef, 8> args = {*linker};
+  if (shared)
+    args.append({"-shared"});
+  else
+    args.append({"-r", "-nostdlib"});
+  args.append({"-o", outputPath});
+  args.append(objectPaths.begin(), objectPaths.end());
+  if (shared)
+    args.push_back(runtimeLibrary);
+  std::string errorMessage;
+  if (llvm::sys::ExecuteAndWait(*linker, args, llvm::None, {}, 0, 0,
+                                &errorMessage)) {
+    llvm::errs() << "Failed to link " << outputPath << ": " << errorMessage
+                 << "\n";
+    return false;
+  }
+  return true;
+}
+
+llvm::StringRef pony::getOutputExtension(Action action) {
+  switch (action) {
+  case Action::DumpLLVMIR:
+    return ".ll";
+  case Action::EmitAssembly:
+    return ".s";
+  case Action::EmitObject:
+    return ".o";
+  case Action::EmitShared:
+    return ".so";
+  default:
+    return ".mlir";
+  }
+}
+
+/// Export the Pony `main` of `llvmModule` under a stable C entry point,
+/// `void pony_main()`, so it doesn't clash with the `main` of whatever links
+/// or dlopens it.
+static void exportMain(llvm::Module &llvmModule) {
+  if (llvm::Function *mainFunc = llvmModule.getFunction("main"))
+    mainFunc->setName("pony_main");
+}
+
+bool pony::writeNativeCode(llvm::Module &llvmModule,
+                           llvm::TargetMachine &targetMachine,
+                           const DriverOptions &options, Action action,
+                           llvm::StringRef outputPath) {
+  exportMain(llvmModule);
+
+  TraceScope scope(options.tracer, "Codegen");
+  if (action == Action::EmitAssembly)
+    return writeMachineCode(llvmModule, targetMachine, outputPath,
+                            llvm::CGFT_AssemblyFile);
+  if (action == Action::EmitObject)
+    return writeMachineCode(llvmModule, targetMachine, outputPath,
+                            llvm::CGFT_ObjectFile);
+
+  // For a shared library, go through a temporary object file.
+  llvm::SmallString<128> objectPath;
+  if (std::error_code ec =
+          llvm::sys::fs::createTemporaryFile("pony", "o", objectPath)) {
+    llvm::errs() << "Could not create a temporary object file: "
+                 << ec.message() << "\n";
+    return false;
+  }
+  llvm::FileRemover objectRemover(objectPath);
+  if (!writeMachineCode(llvmModule, targetMachine, objectPath,
+                        llvm::CGFT_ObjectFile))
+    return false;
+  TraceScope linkScope(options.tracer, "Link");
+  return linkObjects({std::string(objectPath)}, outputPath, /*shared=*/true,
+                     options.runtimeLibrary);
+}
+
+/// Generate the object file or shared library the action of `options` asks
+/// for from `llvmModule`, not optimized yet, in -codegen-threads partitions
+/// optimized and compiled in parallel, and link them into `outputPath`.
+static bool writeNativeCodeInParallel(llvm::Module &llvmModule,
+                                      llvm::TargetMachine &targetMachine,
+                                      const DriverOptions &options,
+                                      llvm::StringRef outputPath) {
+  exportMain(llvmModule);
+  llvm::Expected<std::vector<std::unique_ptr<llvm::MemoryBuffer>>> objects =
+      std::vector<std::unique_ptr<llvm::MemoryBuffer>>();
+  {
+    TraceScope scope(options.tracer, "ParallelCodegen");
+    objects = compileInParallel(llvmModule, targetMachine, options.compile,
+                                options.codegenThreads);
+  }
+  if (!objects) {
+    llvm::errs() << "Failed to generate code: "
+                 << llvm::toString(objects.takeError()) << "\n";
+    return false;
+  }
+
+  // The linker wants the objects as files.
+  std::vector<std::string> objectPaths;
+  std::vector<std::unique_ptr<llvm::FileRemover>> objectRemovers;
+  for (auto &object : *objects) {
+    int fd;
+    llvm::SmallString<128> objectPath;
+    if (std::error_code ec = llvm::sys::fs::createTemporaryFile(
+            "pony", "o", fd, objectPath)) {
+      llvm::errs() << "Could not create a temporary object file: "
+                   << ec.message() << "\n";
+      return false;
+    }
+    objectRemovers.push_back(std::make_unique<llvm::FileRemover>(objectPath));
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << object->getBuffer();
+    objectPaths.push_back(std::string(objectPath));
+  }
+  TraceScope scope(options.tracer, "Link");
+  return linkObjects(objectPaths, outputPath,
+                     /*shared=*/options.action == Action::EmitShared,
+                     options.runtimeLibrary);
+}
+
+bool pony::checkTargetSupportsAction(llvm::TargetMachine &targetMachine,
+                                     Action action) {
+  if (action == Action::EmitShared &&
+      !isHostTriple(targetMachine.getTargetTriple())) {
+    llvm::errs() << "Shared libraries can only be linked for the host\n";
+    return false;
+  }
+  return true;
+}
+
+/// Write the native code the action of `options` asks for from `module`.
+static int emitNativeCode(const DriverOptions &options, mlir::ModuleOp module) {
+  auto targetMachine = createTargetMachine(options);
+  if (!targetMachine ||
+      !checkTargetSupportsAction(*targetMachine, options.action))
+    return -1;
+
+  // Convert the module to LLVM IR in a new LLVM IR context.
+  mlir::registerLLVMDialectTranslation(*module->getContext());
+  llvm::LLVMContext llvmContext;
+
+  // Assembly files don't link, they always come out of a single partition.
+  std::string outputPath =
+      getOutputFilename(options, getOutputExtension(options.action));
+  if (options.codegenThreads > 1 && options.action != Action::EmitAssembly) {
+    auto llvmModule = translateToLLVMIR(module, llvmContext, options.tracer);
+    if (!llvmModule)
+      return -1;
+    configureForTarget(*llvmModule, *targetMachine);
+    return writeNativeCodeInParallel(*llvmModule, *targetMachine, options,
+                                     outputPath)
+               ? 0
+               : -1;
+  }
+
+  auto llvmModule = translateAndOptimize(module, llvmContext, *targetMachine,
+                                         options.compile, options.tracer);
+  if (!llvmModule)
+    return -1;
+
+  return writeNativeCode(*llvmModule, *targetMachine, options, options.action,
+                         outputPath)
+             ? 0
+             : -1;
+}
+
+//===----------------------------------------------------------------------===//
+// Single input
+//===----------------------------------------------------------------------===//
+
+int pony::compileInput(const DriverOptions &options) {
+  if (options.action == Action::DumpToken) return dumpToken(options);
+
+  if (options.action == Action::DumpAST) return dumpAST(options);
+
+  if (options.incremental)
+    return runIncrementalJit(options);
+
+  // If we aren't dumping the AST, then we are compiling with/to MLIR.
+
+  mlir::MLIRContext context;
+  // Load our Dialect in this MLIR Context.
+  context.getOrLoadDialect<mlir::pony::PonyDialect>();
+
+  mlir::OwningOpRef<mlir::ModuleOp> module;
+  if (int error = loadMLIR(options, context, module)) return error;
+
+  // Arguments of main make it an entry point, compiled for their shapes.
+  std::vector<MainArgument> mainArguments(options.mainArgs.size());
+  if (!options.mainArgs.empty()) {
+    EntryPoint entryPoint{"main", {}};
+    for (auto it : llvm::zip(options.mainArgs, mainArguments)) {
+      if (!readMainArgument(std::get<0>(it), std::get<1>(it)))
+        return -1;
+      entryPoint.argShapes.push_back(std::get<1>(it).shape);
+    }
+    if (llvm::Error err = declareEntryPoints(*module, entryPoint)) {
+      llvm::errs() << "Invalid -main-arg: " << llvm::toString(std::move(err))
+                   << "\n";
+      return -1;
+    }
+  }
+
+  llvm::Optional<mlir::pony::OpCost> mainCost;
+  if (options.perfCounters)
+    mainCost = estimateMainCost(options, *module);
+
+  bool isInterpretable = getStage(*module) <= Stage::Specialized;
+  if (options.action == Action::Interpret) {
+    if (!isInterpretable) {
+      llvm::errs() << "Only modules in the Pony dialect can be interpreted\n";
+      return -1;
+    }
+    TraceScope scope(options.tracer, "Interpret");
+    return interpret(*module, std::numeric_limits<uint64_t>::max()) ==
+                   mlir::pony::InterpretResult::Success
+               ? 0
+               : 4;
+  }
+
+  bool isInstrumented =
+      options.compile.profileOps || options.compile.trackAllocations;
+
+  // Programs doing less work than it takes to compile them finish sooner in
+  // the interpreter. It gives up on the others before they do more than
+  // -interp-threshold, or on anything it can't run, silently: the JIT takes
+  // over, and reports the errors if there are any.
+  if (options.action == Action::RunJIT && isInterpretable &&
+      options.interpThreshold && options.jitCacheDir.empty() &&
+      !options.jitLazy && !options.jitStartupTime &&
+      !isBenchmarking(options) && !isInstrumented) {
+    mlir::ScopedDiagnosticHandler ignoreDiagnostics(
+        &context, [](mlir::Diagnostic &) { return mlir::success(); });
+    TraceScope scope(options.tracer, "Interpret");
+    if (interpret(*module, options.interpThreshold) ==
+        mlir::pony::InterpretResult::Success)
+      return 0;
+  }
+
+  if (options.action == Action::DumpCost &&
+      getStage(*module) > Stage::Specialized) {
+    llvm::errs() << "Only modules in the Pony dialect have a static cost\n";
+    return -1;
+  }
+
+  if (int error = processMLIR(options, context, module)) return error;
+
+  if (options.action == Action::DumpCost)
+    return dumpCost(options, *module);
+
+  // If we aren't exporting to non-mlir, then we are done.
+  bool isOutputingMLIR = options.action <= Action::DumpMLIRLLVM;
+  if (isOutputingMLIR) {
+    if (options.outputFilename.empty()) {
+      module->dump();
+      return 0;
+    }
+    std::string errorMessage;
+    auto output = mlir::openOutputFile(options.outputFilename, &errorMessage);
+    if (!output) {
+      llvm::errs() << errorMessage << "\n";
+      return -1;
+    }
+    printModule(*module, output->os());
+    output->keep();
+    return 0;
+  }
+
+  // Check to see if we are compiling to LLVM IR.
+  if (options.action == Action::DumpLLVMIR)
+    return dumpLLVMIR(options, *module);
+
+  // Check to see if we are compiling ahead of time to native code.
+  if (options.action == Action::EmitAssembly ||
+      options.action == Action::EmitObject ||
+      options.action == Action::EmitShared)
+    return emitNativeCode(options, *module);
+
+  // Otherwise, we must be running the jit.
+  if (options.action == Action::RunJIT)
+    return runJit(options, *module, mainArguments, mainCost);
+
+  llvm::errs() << "No action specified (parsing only?), use -emit=<action>\n";
+  return -1;
+}
@@ -0,0 +1,608 @@
+//===- JITRunner.cpp - Running Pony programs with the JIT -----------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the ways the driver runs programs with the JIT: through
+// the on-disk object cache, function by function with -incremental, lazily,
+// from objects compiled in parallel, eagerly through the embedding API, as a
+// benchmark, and in the REPL.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Driver.h"
+#include "pony/AST.h"
+#include "pony/Dialect.h"
+#include "pony/FunctionCache.h"
+#include "pony/JITSession.h"
+#include "pony/ParallelCodegen.h"
+#include "pony/PerfCounters.h"
+#include "pony/PersistentObjectCache.h"
+#include "pony/Pony.h"
+#include "pony/Repl.h"
+#include "pony/Runtime.h"
+#include "pony/Trace.h"
+
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
+#include "mlir/Target/LLVMIR/Export.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+using namespace pony;
+
+/// Create a JITSession as JITSession::create does, or return nullptr after
+/// reporting why it couldn't be.
+static std::unique_ptr<JITSession>
+createSession(const llvm::TargetMachine &targetMachine,
+              llvm::ObjectCache *cache = nullptr, bool lazy = false,
+              JITSession::Optimizer optimize = nullptr) {
+  auto session =
+      JITSession::create(targetMachine, cache, lazy, std::move(optimize));
+  if (!session) {
+    llvm::errs() << "Failed to create the JIT: "
+                 << llvm::toString(session.takeError()) << "\n";
+    return nullptr;
+  }
+  return std::move(*session);
+}
+
+/// Load `module` into a JIT through the embedding API, which eagerly compiles
+/// it, or return nullptr after reporting why it couldn't be.
+static std::unique_ptr<CompiledModule>
+loadCompiledModule(const DriverOptions &options, mlir::ModuleOp module,
+                   llvm::TargetMachine &targetMachine) {
+  // Register the translation from MLIR to LLVM IR, which must happen before we
+  // can JIT-compile.
+  mlir::registerLLVMDialectTranslation(*module->getContext());
+  // Translating and optimizing record their own scopes, the rest is code
+  // generation.
+  TraceScope scope(options.tracer, "JITCompile");
+  auto compiled = CompiledModule::load(module, options.compile, &targetMachine,
+                                       options.tracer);
+  if (!compiled) {
+    llvm::errs() << "Failed to construct an execution engine: "
+                 << llvm::toString(compiled.takeError()) << "\n";
+    return nullptr;
+  }
+  return std::move(*compiled);
+}
+
+/// Run the compiled program with `run`, recorded as `phase` in the trace of
+/// `options`. Returns 0, or -1 after reporting the error `run` returned.
+static int runProgram(const DriverOptions &options, llvm::StringRef phase,
+                      llvm::function_ref<llvm::Error()> run) {
+  flushCompilerOutput();
+  TraceScope scope(options.tracer, phase);
+  if (llvm::Error err = run()) {
+    llvm::errs() << "JIT invocation failed: " << llvm::toString(std::move(err))
+                 << "\n";
+    return -1;
+  }
+  return 0;
+}
+
+/// Return a description of what, besides the program itself, changes the
+/// code generated for it: the target, the optimization level of `options`
+/// and the LLVM version.
+static std::string
+getCodegenConfiguration(llvm::TargetMachine &targetMachine,
+                        const CompileOptions &options) {
+  std::string content;
+  llvm::raw_string_ostream os(content);
+  os << LLVM_VERSION_STRING << '\n'
+     << targetMachine.getTargetTriple().str() << '\n'
+     << targetMachine.getTargetCPU() << '\n'
+     << targetMachine.getTargetFeatureString() << '\n'
+     << options.optLevel << ' ' << options.sizeLevel << '\n';
+  return os.str();
+}
+
+/// Return the key the object compiled from `module` is cached under.
+static std::string computeJitCacheKey(mlir::ModuleOp module,
+                                      llvm::TargetMachine &targetMachine,
+                                      const CompileOptions &options) {
+  std::string content = getCodegenConfiguration(targetMachine, options);
+  llvm::raw_string_ostream os(content);
+  module.print(os);
+  return PersistentObjectCache::computeKey(os.str());
+}
+
+/// JIT the module through an on-disk object cache. MLIR's ExecutionEngine has
+/// no way to plug in a custom llvm::ObjectCache, so this drives an ORC LLJIT
+/// through JITSession instead: on a hit the cached object is linked as is,
+/// skipping translation, optimization and code generation altogether.
+static int runCachedJit(const DriverOptions &options, mlir::ModuleOp module,
+                        std::unique_ptr<llvm::TargetMachine> targetMachine) {
+  mlir::registerLLVMDialectTranslation(*module->getContext());
+  PersistentObjectCache cache(options.jitCacheDir, options.jitCacheSize);
+  std::string key =
+      computeJitCacheKey(module, *targetMachine, options.compile);
+
+  auto session = createSession(*targetMachine, &cache);
+  if (!session)
+    return -1;
+
+  // On a miss, translate and optimize the module, and let the JIT store the
+  // object it compiles under the module identifier.
+  std::unique_ptr<llvm::MemoryBuffer> object = cache.lookup(key);
+  llvm::orc::ThreadSafeModule threadSafeModule;
+  if (!object) {
+    auto llvmContext = std::make_unique<llvm::LLVMContext>();
+    auto llvmModule =
+        translateAndOptimize(module, *llvmContext, *targetMachine,
+                             options.compile, options.tracer);
+    if (!llvmModule)
+      return -1;
+    llvmModule->setModuleIdentifier(key);
+    threadSafeModule = llvm::orc::ThreadSafeModule(std::move(llvmModule),
+                                                   std::move(llvmContext));
+  }
+
+  if (int error = runProgram(options, "JITRun", [&] {
+        return object ? session->run(std::move(object))
+                      : session->run(std::move(threadSafeModule));
+      }))
+    return error;
+
+  if (options.jitCacheStats)
+    cache.printStatistics(llvm::errs());
+  return 0;
+}
+
+int pony::runIncrementalJit(const DriverOptions &options) {
+  std::unique_ptr<ModuleAST> moduleAST;
+  {
+    TraceScope scope(options.tracer, "Parse", options.inputFilename);
+    moduleAST = parseInputFile(options.inputFilename);
+  }
+  if (!moduleAST)
+    return 6;
+  auto targetMachine = createJITTargetMachine(options);
+  if (!targetMachine)
+    return -1;
+
+  mlir::MLIRContext context;
+  context.getOrLoadDialect<mlir::pony::PonyDialect>();
+  mlir::registerLLVMDialectTranslation(context);
+
+  // The MLIR pipeline options change the generated code as well.
+  std::string configuration =
+      getCodegenConfiguration(*targetMachine, options.compile);
+  llvm::raw_string_ostream os(configuration);
+  os << options.compile.foldProgram << ' ' << options.compile.foldProgramLimit
+     << ' ' << options.compile.foldProgramWorkLimit << ' '
+     << options.compile.inlineThreshold << ' '
+     << options.compile.profileOps << ' '
+     << options.compile.trackAllocations << '\n';
+  PersistentObjectCache objects(options.jitCacheDir, options.jitCacheSize);
+  FunctionCache cache(context, *moduleAST, objects, os.str());
+
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> program;
+  if (!cache.getProgram(program)) {
+    // Start out from `main` alone, the specialization pass emits the other
+    // functions as it needs them, unless the cache has them already.
+    mlir::OwningOpRef<mlir::ModuleOp> module(
+        mlir::ModuleOp::create(mlir::UnknownLoc::get(&context)));
+    if (!cache.getFunction("main", *module)) {
+      llvm::errs() << "No 'main' function to run\n";
+      return 1;
+    }
+    mlir::PassManager pm(&context);
+    buildDriverPipeline(pm, LoweringTarget::LLVM, options, &cache);
+    {
+      TraceScope scope(options.tracer, "Pipeline");
+      if (mlir::failed(pm.run(*module)))
+        return 4;
+    }
+
+    llvm::LLVMContext llvmContext;
+    std::unique_ptr<llvm::Module> llvmModule;
+    {
+      TraceScope scope(options.tracer, "TranslateToLLVMIR");
+      llvmModule = mlir::translateModuleToLLVMIR(*module, llvmContext);
+    }
+    if (!llvmModule) {
+      llvm::errs() << "Failed to emit LLVM IR\n";
+      return -1;
+    }
+    configureForTarget(*llvmModule, *targetMachine);
+
+    // The functions compiled now and the cached ones call each other, so the
+    // optimizer must neither drop a function nor change its signature.
+    for (llvm::Function &function : *llvmModule)
+      if (!function.isDeclaration())
+        function.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    if (!optimizeLLVMIR(*llvmModule, *targetMachine, options.compile,
+                        options.tracer))
+      return -1;
+
+    if (auto err = cache.store(*llvmModule, *targetMachine)) {
+      llvm::errs() << "Failed to cache the compiled functions: "
+                   << llvm::toString(std::move(err)) << "\n";
+      return -1;
+    }
+    if (!cache.getProgram(program)) {
+      llvm::errs() << "Failed to collect the functions of the program\n";
+      return -1;
+    }
+  }
+
+  auto session = createSession(*targetMachine);
+  if (!session)
+    return -1;
+  if (int error = runProgram(options, "JITRun", [&] {
+        return session->run(std::move(program));
+      }))
+    return error;
+
+  if (options.jitCacheStats) {
+    objects.printStatistics(llvm::errs());
+    llvm::errs() << "Functions compiled: " << cache.getNumCompiled() << "\n";
+  }
+  return 0;
+}
+
+/// When the JIT-compiled `main` started, recorded by its first instruction with
+/// -jit-startup-time. `main` runs on the thread that compiled it.
+static thread_local std::chrono::steady_clock::time_point jitMainStart;
+static void recordJitMainStart() {
+  jitMainStart = std::chrono::steady_clock::now();
+}
+
+/// Make `main` of `llvmModule` call `pony_jit_main_started` first thing.
+static void instrumentMainStart(llvm::Module &llvmModule) {
+  llvm::Function *mainFunction = llvmModule.getFunction("main");
+  if (!mainFunction || mainFunction->isDeclaration())
+    return;
+  llvm::IRBuilder<> builder(&*mainFunction->getEntryBlock().begin());
+  builder.CreateCall(llvmModule.getOrInsertFunction(
+      "pony_jit_main_started", builder.getVoidTy()));
+}
+
+/// JIT the module through a JITSession, compiling and optimizing each function
+/// on its first call with -jit-lazy, or the whole module before main starts
+/// otherwise, and print how long it took main to start with -jit-startup-time.
+static int runSessionJit(const DriverOptions &options, mlir::ModuleOp module,
+                         std::unique_ptr<llvm::TargetMachine> targetMachine) {
+  auto start = std::chrono::steady_clock::now();
+
+  mlir::registerLLVMDialectTranslation(*module->getContext());
+  auto llvmContext = std::make_unique<llvm::LLVMContext>();
+  auto llvmModule = translateToLLVMIR(module, *llvmContext, options.tracer);
+  if (!llvmModule)
+    return -1;
+  configureForTarget(*llvmModule, *targetMachine);
+  if (options.jitStartupTime)
+    instrumentMainStart(*llvmModule);
+
+  auto session = createSession(
+      *targetMachine, /*cache=*/nullptr, options.jitLazy,
+      mlir::makeOptimizingTransformer(options.compile.optLevel,
+                                      options.compile.sizeLevel,
+                                      targetMachine.get()));
+  if (!session)
+    return -1;
+  if (llvm::Error err = session->define(
+          "pony_jit_main_started",
+          reinterpret_cast<void *>(&recordJitMainStart))) {
+    llvm::errs() << "Failed to create the JIT: "
+                 << llvm::toString(std::move(err)) << "\n";
+    return -1;
+  }
+  if (llvm::Error err = session->add(llvm::orc::ThreadSafeModule(
+          std::move(llvmModule), std::move(llvmContext)))) {
+    llvm::errs() << "Failed to add the module to the JIT: "
+                 << llvm::toString(std::move(err)) << "\n";
+    return -1;
+  }
+
+  // Looking `main` up compiles the whole module, unless the JIT is lazy: then
+  // it only returns a stub compiling `main` on the call.
+  llvm::Expected<void *> mainAddress = nullptr;
+  {
+    TraceScope scope(options.tracer, "JITCompile");
+    mainAddress = session->lookup("main");
+  }
+  if (!mainAddress) {
+    llvm::errs() << "JIT invocation failed: "
+                 << llvm::toString(mainAddress.takeError()) << "\n";
+    return -1;
+  }
+
+  if (int error = runProgram(options, "RunMain", [&]() -> llvm::Error {
+        reinterpret_cast<void (*)()>(*mainAddress)();
+        return llvm::Error::success();
+      }))
+    return error;
+
+  if (options.jitStartupTime) {
+    std::chrono::duration<double, std::milli> startupTime =
+        jitMainStart - start;
+    llvm::errs() << "Time to first instruction ("
+                 << (options.jitLazy ? "lazy" : "eager") << "): "
+                 << llvm::format("%.3f", startupTime.count()) << " ms\n";
+  }
+  return 0;
+}
+
+/// JIT the module from the objects of -codegen-threads partitions, optimized
+/// and compiled in parallel, linked together in a JITSession.
+static int runParallelJit(const DriverOptions &options, mlir::ModuleOp module,
+                          std::unique_ptr<llvm::TargetMachine> targetMachine) {
+  mlir::registerLLVMDialectTranslation(*module->getContext());
+  llvm::LLVMContext llvmContext;
+  auto llvmModule = translateToLLVMIR(module, llvmContext, options.tracer);
+  if (!llvmModule)
+    return -1;
+  configureForTarget(*llvmModule, *targetMachine);
+
+  llvm::Expected<std::vector<std::unique_ptr<llvm::MemoryBuffer>>> objects =
+      std::vector<std::unique_ptr<llvm::MemoryBuffer>>();
+  {
+    TraceScope scope(options.tracer, "ParallelCodegen");
+    objects = compileInParallel(*llvmModule, *targetMachine, options.compile,
+                                options.codegenThreads);
+  }
+  if (!objects) {
+    llvm::errs() << "Failed to generate code: "
+                 << llvm::toString(objects.takeError()) << "\n";
+    return -1;
+  }
+  auto session = createSession(*targetMachine);
+  if (!session)
+    return -1;
+  return runProgram(options, "JITRun",
+                    [&] { return session->run(std::move(*objects)); });
+}
+
+bool pony::isBenchmarking(const DriverOptions &options) {
+  return options.repeat > 1 || options.warmup || !options.mainArgs.empty() ||
+         options.perfCounters;
+}
+
+llvm::Optional<mlir::pony::OpCost>
+pony::estimateMainCost(const DriverOptions &options, mlir::ModuleOp module) {
+  Stage from = getStage(module);
+  if (from > Stage::Specialized)
+    return llvm::None;
+
+  // Specialize a copy, the module itself is lowered as the action says.
+  mlir::OwningOpRef<mlir::ModuleOp> copy = module.clone();
+  mlir::PassManager pm(module.getContext());
+  buildDriverPipeline(pm, LoweringTarget::Specialized, options,
+                      /*cache=*/nullptr, from);
+  if (mlir::failed(pm.run(*copy)))
+    return llvm::None;
+  return mlir::pony::CostAnalysis(*copy).getCallCost("main");
+}
+
+/// Report what `counters` counted over `numCalls` calls of main, which took
+/// `milliseconds` in all, and the rates `cost` of a call makes for.
+static void reportPerfCounters(const PerfCounters &counters,
+                               const llvm::Optional<mlir::pony::OpCost> &cost,
+                               size_t numCalls, double milliseconds) {
+  llvm::errs() << "Performance counters over " << numCalls << " call"
+               << (numCalls == 1 ? "" : "s") << " of main:\n";
+  if (!counters.getError().empty())
+    llvm::errs() << "  (unavailable counters: " << counters.getError()
+                 << ")\n";
+
+  llvm::Optional<uint64_t> counts[PerfCounters::kNumCounters];
+  for (unsigned i = 0; i != PerfCounters::kNumCounters; ++i) {
+    auto counter = static_cast<PerfCounters::Counter>(i);
+    counts[i] = counters.get(counter);
+    if (counts[i])
+      llvm::errs() << llvm::format("  %-16s %20llu\n",
+                                   PerfCounters::getName(counter),
+                                   (unsigned long long)*counts[i]);
+  }
+  auto &cycles = counts[PerfCounters::Cycles];
+  auto &instructions = counts[PerfCounters::Instructions];
+  if (cycles && *cycles && instructions)
+    llvm::errs() << llvm::format("  IPC %.2f\n",
+                                 double(*instructions) / *cycles);
+  if (instructions && *instructions) {
+    for (auto counter : {PerfCounters::L1DMisses, PerfCounters::LLCMisses,
+                         PerfCounters::BranchMisses})
+      if (counts[counter])
+        llvm::errs() << llvm::format(
+            "  %s per 1000 instructions: %.3f\n",
+            PerfCounters::getName(counter),
+            *counts[counter] * 1000.0 / *instructions);
+  }
+  if (cost && milliseconds > 0) {
+    double seconds = milliseconds / 1000;
+    llvm::errs() << llvm::format("  %.3f GFLOP/s, %.3f GB/s\n",
+                                 cost->flops * numCalls / seconds / 1e9,
+                                 cost->getBytes() * numCalls / seconds / 1e9);
+  }
+}
+
+bool pony::readMainArgument(llvm::StringRef spec, MainArgument &arg) {
+  llvm::StringRef path, shape;
+  std::tie(path, shape) = spec.rsplit(':');
+  if (path.empty() || shape.empty()) {
+    llvm::errs() << "-main-arg expects file:shape, as in a.bin:2x3, got '"
+                 << spec << "'\n";
+    return false;
+  }
+  llvm::SmallVector<llvm::StringRef, 4> dims;
+  shape.split(dims, 'x');
+  uint64_t numElements = 1;
+  for (llvm::StringRef dim : dims) {
+    int64_t size;
+    if (dim.getAsInteger(10, size) || size < 0) {
+      llvm::errs() << "Invalid shape '" << shape << "' in -main-arg\n";
+      return false;
+    }
+    arg.shape.push_back(size);
+    numElements *= size;
+  }
+
+  auto fileOrErr = llvm::MemoryBuffer::getFile(
+      path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+  if (std::error_code ec = fileOrErr.getError()) {
+    llvm::errs() << "Could not open " << path << ": " << ec.message() << "\n";
+    return false;
+  }
+  llvm::StringRef bytes = (*fileOrErr)->getBuffer();
+  if (bytes.size() != numElements * sizeof(double)) {
+    llvm::errs() << path << " holds " << bytes.size() << " bytes, a " << shape
+                 << " array of f64 takes " << numElements * sizeof(double)
+                 << "\n";
+    return false;
+  }
+  arg.data.resize(numElements);
+  std::memcpy(arg.data.data(), bytes.data(), bytes.size());
+  return true;
+}
+
+/// Call main `options.warmup` times, then `options.repeat` times timing every
+/// call, on `args`, and report the latency and throughput of the timed calls,
+/// and their hardware counters with the rates `cost` makes for if asked to.
+/// Only what the first call prints is printed.
+static int runBenchmark(const DriverOptions &options, mlir::ModuleOp module,
+                        llvm::TargetMachine &targetMachine,
+                        llvm::MutableArrayRef<MainArgument> args,
+                        const llvm::Optional<mlir::pony::OpCost> &cost) {
+  auto compiled = loadCompiledModule(options, module, targetMachine);
+  if (!compiled)
+    return -1;
+  auto mainFunction = compiled->lookup("main");
+  if (!mainFunction) {
+    llvm::errs() << "JIT invocation failed: "
+                 << llvm::toString(mainFunction.takeError()) << "\n";
+    return -1;
+  }
+  std::vector<TensorRef> tensorArgs;
+  for (MainArgument &arg : args)
+    tensorArgs.push_back({arg.data.data(), arg.shape});
+
+  flushCompilerOutput();
+
+  std::unique_ptr<PerfCounters> counters;
+  if (options.perfCounters)
+    counters = std::make_unique<PerfCounters>();
+  std::vector<double> latencies;
+  latencies.reserve(options.repeat);
+  TraceScope runScope(options.tracer, "RunMain");
+  for (unsigned i = 0, e = options.warmup + options.repeat; i != e; ++i) {
+    if (i == 1)
+      pony_set_output([](void *, const char *, size_t) {}, nullptr);
+    if (counters && i == options.warmup)
+      counters->start();
+    auto start = std::chrono::steady_clock::now();
+    auto result = mainFunction->invoke(tensorArgs);
+    std::chrono::duration<double, std::milli> latency =
+        std::chrono::steady_clock::now() - start;
+    if (!result) {
+      pony_set_output(nullptr, nullptr);
+      llvm::errs() << "JIT invocation failed: "
+                   << llvm::toString(result.takeError()) << "\n";
+      return -1;
+    }
+    if (i >= options.warmup)
+      latencies.push_back(latency.count());
+  }
+  if (counters)
+    counters->stop();
+  pony_set_output(nullptr, nullptr);
+  runScope.end();
+
+  double total = std::accumulate(latencies.begin(), latencies.end(), 0.0);
+  if (counters)
+    reportPerfCounters(*counters, cost, latencies.size(), total);
+  if (options.repeat == 1 && !options.warmup)
+    return 0;
+
+  // Nearest-rank percentiles of the sorted latencies.
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](unsigned p) {
+    size_t rank = (latencies.size() * p + 99) / 100;
+    return latencies[std::max<size_t>(rank, 1) - 1];
+  };
+  llvm::errs() << "main: " << options.repeat << " runs after "
+               << options.warmup << " warmup runs\n"
+               << llvm::format("  latency: min %.3f ms, median %.3f ms, "
+                               "p99 %.3f ms\n",
+                               latencies.front(), percentile(50),
+                               percentile(99))
+               << llvm::format("  throughput: %.1f runs/s\n",
+                               latencies.size() * 1000.0 / total);
+  return 0;
+}
+
+int pony::runJit(const DriverOptions &options, mlir::ModuleOp module,
+                 llvm::MutableArrayRef<MainArgument> mainArgs,
+                 const llvm::Optional<mlir::pony::OpCost> &mainCost) {
+  auto targetMachine = createJITTargetMachine(options);
+  if (!targetMachine)
+    return -1;
+  if (isBenchmarking(options))
+    return runBenchmark(options, module, *targetMachine, mainArgs, mainCost);
+  if (!options.jitCacheDir.empty())
+    return runCachedJit(options, module, std::move(targetMachine));
+  if (options.codegenThreads > 1)
+    return runParallelJit(options, module, std::move(targetMachine));
+  // The embedding API only loads modules lowered to the LLVM dialect.
+  if (options.jitLazy || options.jitStartupTime ||
+      getStage(module) <= Stage::Specialized)
+    return runSessionJit(options, module, std::move(targetMachine));
+
+  // Otherwise load the module through the embedding API, which eagerly
+  // compiles it, and invoke the JIT-compiled main.
+  auto compiled = loadCompiledModule(options, module, *targetMachine);
+  if (!compiled)
+    return -1;
+  return runProgram(options, "RunMain", [&] { return compiled->runMain(); });
+}
+
+int pony::runRepl(const DriverOptions &options) {
+  auto targetMachine = createJITTargetMachine(options);
+  if (!targetMachine)
+    return -1;
+  auto session = createSession(*targetMachine);
+  if (!session)
+    return -1;
+
+  mlir::MLIRContext context;
+  Repl repl(context, *session, options.compile,
+            [&](llvm::Module &llvmModule) {
+              configureForTarget(llvmModule, *targetMachine);
+              return optimizeLLVMIR(llvmModule, *targetMachine,
+                                    options.compile);
+            });
+
+  // Read lines until they make up a whole definition or statement.
+  std::string input;
+  std::string line;
+  while (true) {
+    llvm::outs() << (input.empty() ? "pony> " : "....> ");
+    llvm::outs().flush();
+    if (!std::getline(std::cin, line))
+      break;
+    input += line;
+    input += '\n';
+    if (!Repl::isComplete(input))
+      continue;
+    repl.evaluate(input);
+    input.clear();
+  }
+  llvm::outs() << "\n";
+  return 0;
+}
@@ -0,0 +1,45 @@
+//===- CompileServer.h - Long-lived compile-and-run server ----------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the transport of `ponyc -serve`: it reads compile-and-run
+// requests from stdin or from clients of a unix domain socket and hands them
+// to a pool of worker threads.
+//
+// Requests and responses are framed the same way on both transports:
+//
+//   request:  <id> <length>\n<length bytes of Pony source>
+//   response: <id> <status> <length>\n<length bytes of output>
+//
+// `id` is chosen by the client and echoed back, since requests are served
+// concurrently and responses may come back in any order. `status` is 0 when
+// the program ran, in which case the output is what it printed; otherwise the
+// output holds the diagnostics.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_COMPILESERVER_H
+#define PONY_COMPILESERVER_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <functional>
+#include <string>
+
+namespace pony {
+
+/// Compile and run `source`, appending its output to `output`, and return the
+/// status of the request. Called concurrently from the worker threads.
+using RequestHandler =
+    std::function<int(llvm::StringRef source, std::string &output)>;
+
+/// Serve requests with `handler` on `numWorkers` threads (0 meaning one per
+/// hardware thread). Requests are read from stdin until end of file, unless
+/// `socketPath` is given, in which case the server listens on a unix domain
+/// socket there and accepts any number of clients until it is killed.
+int runCompileServer(const RequestHandler &handler, llvm::StringRef socketPath,
+                     unsigned numWorkers);
+
+} // namespace pony
+
+#endif // PONY_COMPILESERVER_H
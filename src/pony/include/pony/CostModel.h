@@ -0,0 +1,110 @@
+//===- CostModel.h - Static cost of Pony programs --------------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the static cost model of the Pony compiler: the work of
+// every function of a specialized module, from the costs its operations
+// report through the cost model interface, and the roofline report of
+// -emit=cost. The heuristics of the compiler can query it as an analysis.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_COSTMODEL_H
+#define PONY_COSTMODEL_H
+
+#include "pony/Dialect.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/SymbolTable.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+
+#include <algorithm>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace mlir {
+namespace pony {
+
+/// The cost of the functions of a module whose shapes were specialized. As an
+/// MLIR analysis of the module, it is computed once and kept until a pass
+/// changes the module:
+///
+///   auto &costs = getAnalysis<CostAnalysis>();
+///   OpCost cost = costs.getCallCost(function);
+class CostAnalysis {
+public:
+  explicit CostAnalysis(Operation *module);
+
+  /// Return the cost of `op`, or None if it doesn't implement the cost model
+  /// interface or its shapes aren't static.
+  static Optional<OpCost> getOpCost(Operation *op);
+
+  /// Return the cost of the operations in the body of `function`, not counting
+  /// the functions it calls.
+  OpCost getLocalCost(FuncOp function) const;
+
+  /// Return the cost of a call of `function`: its operations and those of the
+  /// functions it calls, as many times as it calls them. Recursive calls and
+  /// operations of unknown cost count for nothing.
+  OpCost getCallCost(FuncOp function) const;
+
+  /// Return the cost of a call of the function named `name`, or None if the
+  /// module has no such function.
+  Optional<OpCost> getCallCost(StringRef name) const;
+
+  /// Return whether the cost of every operation of `function` is known.
+  bool isComplete(FuncOp function) const;
+
+private:
+  struct FunctionCost {
+    OpCost local;
+    OpCost call;
+    bool complete = true;
+  };
+
+  /// Compute the cost of `function` and of the functions it calls, unless
+  /// they are computed already or being computed, up the call stack.
+  void computeCost(FuncOp function, DenseSet<Operation *> &inProgress);
+
+  SymbolTable symbolTable;
+  DenseMap<Operation *, FunctionCost> functionCosts;
+};
+
+/// The machine the roofline model bounds the performance of a program by: it
+/// does at most `peakGflops` billion floating-point operations and moves at
+/// most `peakBandwidth` GB to or from memory per second.
+struct RooflineMachine {
+  double peakGflops = 32;
+  double peakBandwidth = 16;
+
+  /// The arithmetic intensity, in FLOPs per byte, above which the machine is
+  /// bound by its arithmetic rather than by its memory.
+  double getRidgePoint() const { return peakGflops / peakBandwidth; }
+
+  /// The GFLOP/s the machine attains at most on code of `cost`.
+  double getAttainableGflops(const OpCost &cost) const {
+    return std::min(peakGflops,
+                    cost.getArithmeticIntensity() * peakBandwidth);
+  }
+
+  /// The fewest seconds the machine takes to do the work of `cost`.
+  double getMinSeconds(const OpCost &cost) const {
+    return std::max(cost.flops / (peakGflops * 1e9),
+                    cost.getBytes() / (peakBandwidth * 1e9));
+  }
+};
+
+/// Write the roofline report of `module`, whose shapes must be specialized and
+/// whose functions cost `costs`, for `machine` to `os`: the cost of every
+/// operation of every function, the cost of a call of each function, and that
+/// of a call of `main`.
+void printCostReport(ModuleOp module, const CostAnalysis &costs,
+                     const RooflineMachine &machine, llvm::raw_ostream &os);
+
+} // namespace pony
+} // namespace mlir
+
+#endif // PONY_COSTMODEL_H
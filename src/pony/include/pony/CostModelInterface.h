@@ -0,0 +1,50 @@
+//===- CostModelInterface.h - Interface definitions for CostModel ----------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the declarations of the cost model interfaces defined in
+// CostModelInterface.td, and of the cost they return.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_COSTMODELINTERFACE_H
+#define PONY_COSTMODELINTERFACE_H
+
+#include "mlir/IR/OpDefinition.h"
+
+#include <cstdint>
+
+namespace mlir {
+namespace pony {
+
+/// The work done by an operation, or by a call of a function: what the loops
+/// of the affine lowering compute, with every operand read and every result
+/// written once.
+struct OpCost {
+  int64_t flops = 0;
+  int64_t bytesRead = 0;
+  int64_t bytesWritten = 0;
+
+  /// The bytes moved to or from memory.
+  int64_t getBytes() const { return bytesRead + bytesWritten; }
+
+  /// The floating-point operations per byte moved, or 0 if nothing is.
+  double getArithmeticIntensity() const {
+    return getBytes() ? double(flops) / getBytes() : 0.0;
+  }
+
+  OpCost &operator+=(const OpCost &other) {
+    flops += other.flops;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+    return *this;
+  }
+};
+
+/// Include the auto-generated declarations.
+#include "pony/CostModelOpInterfaces.h.inc"
+
+} // namespace pony
+} // namespace mlir
+
+#endif // PONY_COSTMODELINTERFACE_H
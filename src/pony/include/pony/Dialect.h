@@ -16,6 +16,7 @@
 #include "mlir/Interfaces/CallInterfaces.h"
 #include "mlir/Interfaces/CastInterfaces.h"
 #include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "pony/CostModelInterface.h"
 #include "pony/ShapeInferenceInterface.h"
 
 /// Include the auto-generated header file containing the declaration of the pony
@@ -27,4 +28,14 @@
 #define GET_OP_CLASSES
 #include "pony/Ops.h.inc"
 
+namespace mlir {
+namespace pony {
+
+/// The attribute marking the calls the inliner may inline, set and removed by
+/// the pass of createInlinerPass.
+constexpr llvm::StringLiteral kInlineAttrName = "pony.inline";
+
+} // namespace pony
+} // namespace mlir
+
 #endif // MLIR_TUTORIAL_PONY_DIALECT_H_
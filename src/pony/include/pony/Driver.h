@@ -0,0 +1,286 @@
+//===- Driver.h - The compiler driver behind ponyc -------------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares what ponyc does once it read its command line: compile a
+// single input and emit, interpret or JIT it, compile many inputs at once,
+// serve compile-and-run requests and run the REPL. The configuration of a run
+// is a DriverOptions, so the same runners work for any front end that fills
+// one in.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_DRIVER_H
+#define PONY_DRIVER_H
+
+#include "pony/CostModel.h"
+#include "pony/Pipeline.h"
+
+#include "mlir/Support/LogicalResult.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+class TargetMachine;
+class Triple;
+class raw_ostream;
+} // namespace llvm
+
+namespace mlir {
+class ModuleOp;
+class PassManager;
+} // namespace mlir
+
+namespace pony {
+
+class IRStats;
+class ModuleAST;
+class Tracer;
+
+/// The kind of input of the driver.
+enum class InputType { Pony, MLIR };
+
+/// What the driver does with its input, in the order of the stages it needs
+/// the input lowered to.
+enum class Action {
+  None,
+  DumpToken,
+  DumpAST,
+  DumpMLIR,
+  DumpMLIRAffine,
+  DumpMLIRLLVM,
+  DumpLLVMIR,
+  EmitAssembly,
+  EmitObject,
+  EmitShared,
+  RunJIT,
+  Interpret,
+  DumpCost
+};
+
+/// The configuration of a run of the driver. It is read from the command line
+/// once, and everything below takes it from here rather than from the options
+/// themselves, so that compilations with different settings can run side by
+/// side in one process.
+struct DriverOptions {
+  /// The input when compiling a single file, stdin by default.
+  std::string inputFilename = "-";
+  InputType inputType = InputType::Pony;
+  Action action = Action::None;
+
+  /// Where the outputs go: -o for a single input, -output-dir for several,
+  /// compiled on `numJobs` threads.
+  std::string outputFilename;
+  std::string outputDirectory = ".";
+  unsigned numJobs = 0;
+
+  /// The target, as given with -mtriple, -mcpu and -mattr.
+  std::string targetTriple;
+  std::string targetCPU;
+  std::vector<std::string> targetAttrs;
+
+  /// The runtime library that -emit=shared links into shared libraries.
+  std::string runtimeLibrary;
+
+  /// The options of the compiler itself.
+  CompileOptions compile;
+  unsigned codegenThreads = 1;
+  bool fastCompile = false;
+
+  /// The JIT and its on-disk cache.
+  std::string jitCacheDir;
+  uint64_t jitCacheSize = 0;
+  bool incremental = false;
+  bool jitCacheStats = false;
+  bool jitLazy = false;
+  bool jitStartupTime = false;
+
+  /// Call main `warmup` times, then `repeat` times timing each call, with the
+  /// arguments of `mainArgs`, each a "file:shape" pair, and count what the
+  /// timed calls do with the hardware counters if `perfCounters`.
+  unsigned repeat = 1;
+  unsigned warmup = 0;
+  std::vector<std::string> mainArgs;
+  bool perfCounters = false;
+
+  /// The most work a program run with the JIT may do to be interpreted
+  /// instead.
+  uint64_t interpThreshold = 0;
+
+  /// The machine -emit=cost bounds the performance of operations by.
+  mlir::pony::RooflineMachine roofline;
+
+  /// Where the timeline of -trace goes, and the tracer recording it while the
+  /// driver runs.
+  std::string traceFile;
+  Tracer *tracer = nullptr;
+
+  /// Whether to report the size of the IR after every pass, where its JSON
+  /// goes, and the statistics recording it while the driver runs.
+  bool irStats = false;
+  std::string irStatsJSONFile;
+  IRStats *irStatsRecorder = nullptr;
+};
+
+//===----------------------------------------------------------------------===//
+// Runners
+//===----------------------------------------------------------------------===//
+
+/// Compile the input file of `options` and do what its action says: dump a
+/// stage, write native code, interpret it or run it with the JIT. Returns the
+/// exit code of the driver.
+int compileInput(const DriverOptions &options);
+
+/// Compile every file of `inputs` on a thread pool, each thread with a context
+/// of its own. Every output is named after its input in -output-dir, and the
+/// diagnostics are reported in the order of the inputs, so the results don't
+/// depend on scheduling.
+int compileBatch(const DriverOptions &options,
+                 llvm::ArrayRef<std::string> inputs);
+
+/// Compile and run one -serve request on the warm state of the calling thread,
+/// setting `output` to what the program printed, or to the diagnostics if it
+/// didn't run. `options` must outlive the serving threads.
+int serveRequest(const DriverOptions &options, llvm::StringRef source,
+                 std::string &output);
+
+/// Run the REPL on stdin. Every input is compiled into a JIT kept for the
+/// whole session, so the code compiled for earlier inputs is reused as is.
+int runRepl(const DriverOptions &options);
+
+/// Return whether main is called with arguments, more than once or under the
+/// hardware counters.
+bool isBenchmarking(const DriverOptions &options);
+
+//===----------------------------------------------------------------------===//
+// Building blocks of the runners
+//===----------------------------------------------------------------------===//
+
+/// Returns a Pony AST resulting from parsing `buffer`, which must be nul
+/// terminated, or a nullptr on error.
+std::unique_ptr<ModuleAST> parseSource(llvm::StringRef buffer,
+                                       llvm::StringRef filename,
+                                       bool echoTokens = true);
+
+/// Returns a Pony AST resulting from parsing the file or a nullptr on error.
+std::unique_ptr<ModuleAST> parseInputFile(llvm::StringRef filename);
+
+/// Return the dialect `action` needs modules at stage `from` lowered to. With
+/// -fast-compile, LLVM IR is translated from the specialized Pony dialect,
+/// unless the module is already past it.
+LoweringTarget getLoweringTarget(const DriverOptions &options, Action action,
+                                 Stage from = Stage::Pony);
+
+/// Populate `pm` with the passes lowering a module at stage `from` to `target`
+/// with `options`, reusing the specializations `cache` has if given, and the
+/// instrumentations of -trace and -ir-stats.
+void buildDriverPipeline(mlir::PassManager &pm, LoweringTarget target,
+                         const DriverOptions &options,
+                         mlir::pony::SpecializationCache *cache = nullptr,
+                         Stage from = Stage::Pony);
+
+/// Run `pm`, built by buildDriverPipeline for `target`, `options` and the
+/// stage of `module`, over `module` and record the stage it gets it to.
+mlir::LogicalResult runPipeline(mlir::PassManager &pm, LoweringTarget target,
+                                const CompileOptions &options,
+                                mlir::ModuleOp module);
+
+/// Print `module` to `os`. Large constants are printed in hex, which is smaller
+/// and much faster to parse back than decimal literals, so that saved stages
+/// are cheap to resume from.
+void printModule(mlir::ModuleOp module, llvm::raw_ostream &os);
+
+/// Return true if code for `triple` can run on the machine we are running on.
+bool isHostTriple(const llvm::Triple &triple);
+
+/// Create a TargetMachine for the target of `options`. When compiling for the
+/// host without an explicit cpu, use the host cpu and every feature it
+/// reports, so the vectorizers can use the widest vector ISA available.
+std::unique_ptr<llvm::TargetMachine>
+createTargetMachine(const DriverOptions &options);
+
+/// Like createTargetMachine, for code the JIT runs: returns nullptr after
+/// reporting it if the target of `options` isn't the host.
+std::unique_ptr<llvm::TargetMachine>
+createJITTargetMachine(const DriverOptions &options);
+
+/// Run the LLVM optimization pipeline of `options` over `llvmModule`, timed by
+/// `tracer` if given. Returns false on failure.
+bool optimizeLLVMIR(llvm::Module &llvmModule,
+                    llvm::TargetMachine &targetMachine,
+                    const CompileOptions &options, Tracer *tracer = nullptr);
+
+/// Translate `module` to LLVM IR in `llvmContext`: straight from the Pony
+/// dialect with the fast back end if -fast-compile stopped it at the
+/// specialized stage, from the LLVM dialect otherwise. The LLVM dialect
+/// translation must have been registered with the context of `module`. Timed
+/// by `tracer` if given. Returns nullptr on failure.
+std::unique_ptr<llvm::Module> translateToLLVMIR(mlir::ModuleOp module,
+                                                llvm::LLVMContext &llvmContext,
+                                                Tracer *tracer = nullptr);
+
+/// Translate `module` to LLVM IR in `llvmContext`, configured for and
+/// optimized with `targetMachine` and `options`, timed by `tracer` if given.
+/// The LLVM dialect translation must have been registered with the context of
+/// `module`. Returns nullptr on failure.
+std::unique_ptr<llvm::Module>
+translateAndOptimize(mlir::ModuleOp module, llvm::LLVMContext &llvmContext,
+                     llvm::TargetMachine &targetMachine,
+                     const CompileOptions &options, Tracer *tracer = nullptr);
+
+/// Return the extension of the file `action` writes.
+llvm::StringRef getOutputExtension(Action action);
+
+/// Return false, after saying why, if `targetMachine` can't produce what
+/// `action` asks for.
+bool checkTargetSupportsAction(llvm::TargetMachine &targetMachine,
+                               Action action);
+
+/// Generate the native code `action` asks for from `llvmModule` and write it
+/// to `outputPath`, linking shared libraries against the runtime library of
+/// `options` and timed by its tracer.
+bool writeNativeCode(llvm::Module &llvmModule,
+                     llvm::TargetMachine &targetMachine,
+                     const DriverOptions &options, Action action,
+                     llvm::StringRef outputPath);
+
+/// An argument of main given with -main-arg.
+struct MainArgument {
+  std::vector<int64_t> shape;
+  std::vector<double> data;
+};
+
+/// Read the -main-arg `spec`, "file:shape" with the shape as in 2x3, into
+/// `arg`. Returns false after reporting an error.
+bool readMainArgument(llvm::StringRef spec, MainArgument &arg);
+
+/// Return the cost of a call of main from the shapes of `module` once
+/// specialized with `options`, or None if it is past the Pony dialect.
+llvm::Optional<mlir::pony::OpCost>
+estimateMainCost(const DriverOptions &options, mlir::ModuleOp module);
+
+/// Run `module` with the JIT the options ask for: through the on-disk cache,
+/// from objects compiled in parallel, lazily, or eagerly through the
+/// embedding API, or call main on `mainArgs` as a benchmark, reporting the
+/// rates `mainCost` makes for.
+int runJit(const DriverOptions &options, mlir::ModuleOp module,
+           llvm::MutableArrayRef<MainArgument> mainArgs = {},
+           const llvm::Optional<mlir::pony::OpCost> &mainCost = llvm::None);
+
+/// JIT the Pony input function by function through the on-disk cache: only
+/// the functions whose source, or the source of a function they call, changed
+/// since an earlier run go through MLIRGen, the pass pipeline and code
+/// generation. All the others are relinked from the cache.
+int runIncrementalJit(const DriverOptions &options);
+
+} // namespace pony
+
+#endif // PONY_DRIVER_H
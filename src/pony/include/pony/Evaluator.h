@@ -0,0 +1,54 @@
+//===- Evaluator.h - In-process evaluation of Pony operations --------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a small evaluator that computes the result of Pony
+// operations on concrete f64 tensors inside the compiler.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_EVALUATOR_H
+#define PONY_EVALUATOR_H
+
+#include "mlir/Support/LogicalResult.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mlir {
+class Operation;
+
+namespace pony {
+
+/// A dense, row-major tensor of f64 values.
+struct TensorValue {
+  llvm::SmallVector<int64_t, 4> shape;
+  std::vector<double> data;
+};
+
+/// Compute the result of `op` from the values of its operands. The shapes are
+/// taken from the operand values rather than from the IR types, so this works
+/// before shape inference as well. Returns failure if `op` is not a pure
+/// computation the evaluator knows, or if its operands have incompatible
+/// shapes; calls and prints are left to the caller.
+LogicalResult evaluateOp(Operation *op,
+                         llvm::ArrayRef<const TensorValue *> operands,
+                         TensorValue &result);
+
+/// Estimate the work of evaluating `op` on `operands`, in arithmetic operations
+/// and moves of tensor elements: the multiply-adds of a matrix product, one
+/// unit per element otherwise.
+uint64_t estimateWork(Operation *op,
+                      llvm::ArrayRef<const TensorValue *> operands);
+
+/// Append `value` to `out`, formatted byte for byte the way the
+/// `pony_print_memref` runtime function prints it.
+void renderTensor(const TensorValue &value, std::string &out);
+
+} // namespace pony
+} // namespace mlir
+
+#endif // PONY_EVALUATOR_H
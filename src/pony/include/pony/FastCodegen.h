@@ -0,0 +1,40 @@
+//===- FastCodegen.h - Direct translation of Pony to LLVM IR ---------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the fast back end of the compiler, selected with
+// -fast-compile: it translates specialized Pony modules straight to LLVM IR,
+// one simple loop nest or runtime call per operation, without going through
+// the affine, standard and LLVM dialects. The code is slower than what the
+// full pipeline generates, but takes a fraction of the time to produce, which
+// is what matters at -O0.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_FASTCODEGEN_H
+#define PONY_FASTCODEGEN_H
+
+#include <memory>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+} // namespace llvm
+
+namespace mlir {
+class ModuleOp;
+
+namespace pony {
+
+/// Translate `module`, in the Pony dialect with every function specialized for
+/// static shapes, to LLVM IR in `llvmContext`. Every tensor is a heap buffer
+/// of f64 in row-major order, passed and returned by pointer: the public
+/// functions other than `main` don't get the C interface of the full pipeline.
+/// Returns nullptr after emitting a diagnostic on failure.
+std::unique_ptr<llvm::Module>
+translateToLLVMIRDirectly(ModuleOp module, llvm::LLVMContext &llvmContext);
+
+} // namespace pony
+} // namespace mlir
+
+#endif // PONY_FASTCODEGEN_H
@@ -0,0 +1,109 @@
+//===- FunctionCache.h - On-disk cache of compiled Pony functions ---------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the cache behind incremental recompilation: every
+// function specialization is compiled to an object of its own, keyed by a
+// hash of the source of the generic function and of every function it
+// transitively calls, so that a rebuild only compiles the functions affected
+// by a change and relinks the others from the cache.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_FUNCTIONCACHE_H
+#define PONY_FUNCTIONCACHE_H
+
+#include "pony/PersistentObjectCache.h"
+#include "pony/SpecializationCache.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pony {
+class FunctionAST;
+class ModuleAST;
+
+class FunctionCache : public mlir::pony::SpecializationCache {
+public:
+  /// Cache the functions of `moduleAST` in `objects`. `configuration` covers
+  /// everything besides the source that changes the generated code.
+  FunctionCache(mlir::MLIRContext &context, ModuleAST &moduleAST,
+                PersistentObjectCache &objects, llvm::StringRef configuration);
+
+  /// SpecializationCache interface. Generic functions are emitted from the
+  /// AST on demand, and a specialization only counts as compiled if the
+  /// objects of all the functions it calls are cached as well.
+  mlir::pony::FuncOp getFunction(llvm::StringRef name,
+                                 mlir::ModuleOp module) override;
+  bool lookup(llvm::StringRef name, llvm::StringRef callee,
+              llvm::SmallVectorImpl<mlir::Type> &resultTypes) override;
+  void notifySpecialized(mlir::pony::FuncOp specialization,
+                         llvm::StringRef callee) override;
+
+  /// Split `llvmModule`, lowered from the specializations reported to
+  /// `notifySpecialized`, into a module per function, compile each of them
+  /// with `targetMachine` and store the objects.
+  llvm::Error store(llvm::Module &llvmModule,
+                    llvm::TargetMachine &targetMachine);
+
+  /// Append the objects of `main` and of every function it transitively calls
+  /// to `program`. Returns false if any of them is neither cached nor stored
+  /// by this run. The objects stay owned by the cache.
+  bool
+  getProgram(std::vector<std::unique_ptr<llvm::MemoryBuffer>> &program);
+
+  /// Number of functions compiled by `store`.
+  unsigned getNumCompiled() const { return numCompiled; }
+
+private:
+  /// A compiled function: its object, the keys of the functions it calls, and
+  /// the shapes of its results.
+  struct Entry {
+    std::unique_ptr<llvm::MemoryBuffer> object;
+    std::vector<std::string> callees;
+    std::vector<std::vector<int64_t>> resultShapes;
+  };
+
+  /// Return the key of the specialization `name` of the generic function
+  /// `callee`, or an empty string if there is no such function.
+  std::string getKey(llvm::StringRef name, llvm::StringRef callee) const;
+
+  std::string getEntryPath(llvm::StringRef key) const;
+
+  /// Load the entry `key` and, recursively, those of the functions it calls.
+  /// Returns false if any of them is missing.
+  bool load(llvm::StringRef key);
+
+  void collect(llvm::StringRef key, llvm::StringSet<> &visited,
+               std::vector<std::unique_ptr<llvm::MemoryBuffer>> &program);
+
+  mlir::MLIRContext &context;
+  PersistentObjectCache &objects;
+  std::string configuration;
+
+  /// The generic functions by name, and the hash of each of them covering the
+  /// functions it transitively calls.
+  llvm::StringMap<FunctionAST *> functions;
+  llvm::StringMap<std::string> hashes;
+
+  /// The key of every specialization of this run, by name, and the result
+  /// shapes of the ones compiled by this run.
+  llvm::StringMap<std::string> keys;
+  llvm::StringMap<std::vector<std::vector<int64_t>>> resultShapes;
+
+  /// The entries loaded or stored so far, by key.
+  llvm::StringMap<Entry> entries;
+  unsigned numCompiled = 0;
+};
+
+} // namespace pony
+
+#endif // PONY_FUNCTIONCACHE_H
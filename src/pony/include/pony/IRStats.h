@@ -0,0 +1,84 @@
+//===- IRStats.h - Size of the IR and memory of the compiler ---------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the statistics behind -ir-stats: after every pass, the
+// operations of the module by dialect and by name, the bytes its attributes
+// hold and the memory of the compiler, so that the pass blowing either up
+// stands out.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_IRSTATS_H
+#define PONY_IRSTATS_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace mlir {
+class Operation;
+class PassInstrumentation;
+} // namespace mlir
+
+namespace pony {
+
+/// The size of the modules of the pipelines of a run of the compiler after
+/// each of their passes. Safe to record into from any thread.
+class IRStats {
+public:
+  /// Return the number of a new pipeline to record the passes of, from 1.
+  unsigned beginPipeline();
+
+  /// Record the size of `module` after the pass `passName` of `pipeline`, and
+  /// the memory of the process now.
+  void record(unsigned pipeline, llvm::StringRef passName,
+              mlir::Operation *module);
+
+  /// Print a row per recorded pass, with the difference to the pass before,
+  /// followed by the operations of the module by dialect.
+  void print(llvm::raw_ostream &os) const;
+
+  /// Write every recorded pass, with its operations by dialect and by name, as
+  /// JSON.
+  void writeJSON(llvm::raw_ostream &os) const;
+
+private:
+  struct Snapshot {
+    unsigned pipeline;
+    std::string passName;
+    uint64_t numOperations = 0;
+    std::map<std::string, uint64_t> dialectCounts;
+    std::map<std::string, uint64_t> opCounts;
+    /// The bytes the distinct attributes of the module hold, of which
+    /// `denseBytes` in the elements of dense elements attributes.
+    uint64_t attributeBytes = 0;
+    uint64_t denseBytes = 0;
+    /// The resident memory of the process and its peak so far, 0 if unknown.
+    uint64_t residentBytes = 0;
+    uint64_t peakResidentBytes = 0;
+  };
+
+  mutable std::mutex mutex;
+  unsigned numPipelines = 0;
+  std::vector<Snapshot> snapshots;
+};
+
+/// Create an instrumentation recording the module into `stats` as a new
+/// pipeline, before its first pass and after every pass on it. The passes
+/// nested on functions are recorded together, once they ran on all of them.
+std::unique_ptr<mlir::PassInstrumentation>
+createIRStatsInstrumentation(IRStats &stats);
+
+} // namespace pony
+
+#endif // PONY_IRSTATS_H
@@ -0,0 +1,48 @@
+//===- Interpreter.h - Direct execution of Pony programs -------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares an interpreter running Pony programs straight from the
+// Pony dialect, generic or specialized, without lowering or compiling them.
+// Small programs finish in it long before the JIT would be ready to run them,
+// and since it computes with the kernels of the Evaluator its output is the
+// same as the compiled program's, byte for byte.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_INTERPRETER_H
+#define PONY_INTERPRETER_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace mlir {
+class ModuleOp;
+
+namespace pony {
+
+/// How an interpretation ended.
+enum class InterpretResult {
+  /// `main` returned.
+  Success,
+  /// The program can't be interpreted, the reason was reported as a
+  /// diagnostic.
+  Failure,
+  /// Going on would exceed the work limit.
+  WorkLimitExceeded,
+};
+
+/// Interpret the `main` function of `module`, a Pony dialect module that
+/// isn't lowered yet, appending what it prints to `output`. Stops before
+/// doing more than `workLimit` units of work, each an arithmetic operation or
+/// the move of a tensor element, estimated before every operation from the
+/// shapes of its operands.
+InterpretResult
+interpretMain(ModuleOp module, std::string &output,
+              uint64_t workLimit = std::numeric_limits<uint64_t>::max());
+
+} // namespace pony
+} // namespace mlir
+
+#endif // PONY_INTERPRETER_H
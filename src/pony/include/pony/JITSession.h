@@ -0,0 +1,96 @@
+//===- JITSession.h - Reusable JIT for running Pony programs ---------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a JIT that stays alive across programs: each program is
+// linked into a JITDylib of its own, which is dropped again once its `main`
+// returned, while the compiler, the target machine and the bindings to the
+// runtime and the C library are set up only once. Code that must outlive a
+// program, like what the REPL compiles, goes into the main JITDylib instead.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_JITSESSION_H
+#define PONY_JITSESSION_H
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace pony {
+
+/// Return the runtime entry points the lowered code calls into, bound to the
+/// copies linked into the compiler.
+llvm::orc::SymbolMap getRuntimeSymbols(llvm::orc::MangleAndInterner interner);
+
+/// Write out what the compiler buffered for stdout so far, which must come
+/// before what compiled code prints: the runtime writes straight to the file
+/// descriptor.
+void flushCompilerOutput();
+
+class JITSession {
+public:
+  /// Transforms the LLVM IR of the modules before they are compiled.
+  using Optimizer = std::function<llvm::Error(llvm::Module *)>;
+
+  /// Create a session generating code for the cpu, features and optimization
+  /// level of `targetMachine`, which must target the host. If `cache` is given,
+  /// every compiled module goes through it. If `lazy`, every function of a
+  /// module is split out and compiled on its first call, rather than along
+  /// with the whole module when a symbol of the module is first looked up.
+  /// `optimize`, if given, runs over what is compiled: whole modules, or the
+  /// functions one by one if `lazy`.
+  static llvm::Expected<std::unique_ptr<JITSession>>
+  create(const llvm::TargetMachine &targetMachine,
+         llvm::ObjectCache *cache = nullptr, bool lazy = false,
+         Optimizer optimize = nullptr);
+
+  /// Compile `module`, run its `main` function and release it again.
+  llvm::Error run(llvm::orc::ThreadSafeModule module);
+
+  /// Link the already compiled `object`, run its `main` function and release
+  /// it again.
+  llvm::Error run(std::unique_ptr<llvm::MemoryBuffer> object);
+
+  /// Link the already compiled `objects` together, run the `main` function
+  /// one of them defines and release them again.
+  llvm::Error run(std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects);
+
+  /// Add `module` to the main JITDylib, where it stays as long as the session
+  /// does. The code added later links against it.
+  llvm::Error add(llvm::orc::ThreadSafeModule module);
+
+  /// Define the symbol `name` of the main JITDylib at `address`, for the code
+  /// added later to call into the compiler.
+  llvm::Error define(llvm::StringRef name, void *address);
+
+  /// Return the address of the symbol `name` of the main JITDylib, compiling
+  /// the code defining it if needed.
+  llvm::Expected<void *> lookup(llvm::StringRef name);
+
+private:
+  JITSession(std::unique_ptr<llvm::orc::LLJIT> jit, bool lazy)
+      : jit(std::move(jit)), lazy(lazy) {}
+
+  /// Add `module` to `jd`, lazily if the session is.
+  llvm::Error addModule(llvm::orc::JITDylib &jd,
+                        llvm::orc::ThreadSafeModule module);
+
+  /// Create a JITDylib for one program, let `addProgram` populate it, then run
+  /// and remove it.
+  llvm::Error
+  runProgram(llvm::function_ref<llvm::Error(llvm::orc::JITDylib &)> addProgram);
+
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  bool lazy;
+  unsigned numPrograms = 0;
+};
+
+} // namespace pony
+
+#endif // PONY_JITSESSION_H
@@ -99,6 +99,9 @@ class Lexer {
   const std::vector<Token>& getRecordedTokens() const { return recordedTokens; }
   bool hadLexError() const { return lexHadError; }
 
+  /// Control whether tokens are echoed to stdout as they are lexed.
+  void setEchoTokens(bool echo) { echoTokens = echo; }
+
  private:
   /// Delegate to a derived class fetching the next line. Returns an empty
   /// string to signal end of file (EOF). Lines are expected to always finish
@@ -108,6 +111,7 @@ class Lexer {
   // Record all tokens seen and whether a lexical error occurred
   std::vector<Token> recordedTokens;
   bool lexHadError = false;
+  bool echoTokens = true;
 
   int getNextChar() {
     // If buffer is empty, read next line
@@ -162,7 +166,7 @@ class Lexer {
       }
       identifierStr = idStr;
 
-      llvm::outs() << "" << idStr << " ";
+      if (echoTokens) llvm::outs() << "" << idStr << " ";
       if (idStr == "return")   { recordedTokens.push_back(tok_return); return tok_return; }
       if (idStr == "var")      { recordedTokens.push_back(tok_var);    return tok_var; }
       if (idStr == "def")      { recordedTokens.push_back(tok_def);    return tok_def; }
@@ -199,7 +203,7 @@ class Lexer {
         return Token::error;
       }
       numVal = strtod(numStr.c_str(), nullptr);
-      llvm::outs() << "" << numStr << " ";
+      if (echoTokens) llvm::outs() << "" << numStr << " ";
       recordedTokens.push_back(tok_number);
       return tok_number;
     }
@@ -216,12 +220,12 @@ class Lexer {
     // Check for end of file.  Don't eat the EOF.
     if (lastChar == EOF) {
       recordedTokens.push_back(tok_eof);
-      llvm::outs() << "EOF\n";
+      if (echoTokens) llvm::outs() << "EOF\n";
       return tok_eof;
     }
 
     //check the semicolon and other single-character tokens
-    llvm::outs() << "" << (char)lastChar << " ";
+    if (echoTokens) llvm::outs() << "" << (char)lastChar << " ";
 
     switch (lastChar){
     case ';':
@@ -10,6 +10,8 @@
 #ifndef PONY_MLIRGEN_H
 #define PONY_MLIRGEN_H
 
+#include "mlir/Support/LogicalResult.h"
+
 #include <memory>
 
 namespace mlir {
@@ -20,12 +22,16 @@ class ModuleOp;
 } // namespace mlir
 
 namespace pony {
+class FunctionAST;
 class ModuleAST;
 
 /// Emit IR for the given Pony moduleAST, returns a newly created MLIR module
 /// or nullptr on failure.
 mlir::OwningOpRef<mlir::ModuleOp> mlirGen(mlir::MLIRContext &context,
                                           ModuleAST &moduleAST);
+
+/// Emit IR for the single function `functionAST` at the end of `module`.
+mlir::LogicalResult mlirGen(mlir::ModuleOp module, FunctionAST &functionAST);
 } // namespace pony
 
 #endif // PONY_MLIRGEN_H
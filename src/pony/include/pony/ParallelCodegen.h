@@ -0,0 +1,43 @@
+//===- ParallelCodegen.h - Parallel LLVM optimization and codegen ----------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the parallel back end of the compiler: an LLVM module is
+// split into partitions along the lines of llvm::SplitModule, every partition
+// is moved into an LLVMContext of its own, and the partitions are optimized
+// and compiled to objects concurrently. The objects link into the same
+// program the whole module would have compiled to.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_PARALLELCODEGEN_H
+#define PONY_PARALLELCODEGEN_H
+
+#include "pony/Pipeline.h"
+
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class Module;
+class TargetMachine;
+} // namespace llvm
+
+namespace pony {
+
+/// Split `llvmModule` into `numPartitions` partitions, optimize them as
+/// `options` say and compile them to objects for the target of
+/// `targetMachine`, on as many threads. The module must already be configured
+/// for the target, and its local symbols are externalized by the split.
+/// Functions are only inlined within their partition.
+llvm::Expected<std::vector<std::unique_ptr<llvm::MemoryBuffer>>>
+compileInParallel(llvm::Module &llvmModule,
+                  const llvm::TargetMachine &targetMachine,
+                  const CompileOptions &options, unsigned numPartitions);
+
+} // namespace pony
+
+#endif // PONY_PARALLELCODEGEN_H
@@ -9,21 +9,57 @@
 #ifndef PONY_PASSES_H
 #define PONY_PASSES_H
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
 namespace mlir {
 class Pass;
 
 namespace pony {
-std::unique_ptr<Pass> createShapeInferencePass();
+class SpecializationCache;
+struct RooflineMachine;
+
+/// Create a pass inlining the calls to functions of at most `threshold`
+/// operations. The larger functions are left to be specialized.
+std::unique_ptr<Pass> createInlinerPass(unsigned threshold);
+
+/// Create a pass specializing every function reachable from `main` and the
+/// other public functions for the shapes it is called with, inferring the
+/// shapes of all values on the way. With a `cache`, the generic functions are
+/// emitted on demand and the specializations compiled before are only
+/// declared.
+std::unique_ptr<Pass>
+createShapeSpecializationPass(SpecializationCache *cache = nullptr);
+
+/// Create a pass evaluating the constant computations of a shape-inferred
+/// function at compile time, and replacing prints of known values with
+/// pre-rendered strings of at most `maxOutputBytes` per function. It stops
+/// evaluating a function before doing more than `maxWork` units of work, as
+/// estimateWork counts them.
+std::unique_ptr<Pass> createFoldProgramPass(size_t maxOutputBytes,
+                                            uint64_t maxWork);
+
+/// Create a pass writing the roofline report of a shape-specialized module for
+/// `machine` to `os`, from the costs of the CostAnalysis of the module.
+std::unique_ptr<Pass> createCostReportPass(llvm::raw_ostream &os,
+                                           const RooflineMachine &machine);
 
 /// Create a pass for lowering to operations in the `Affine` and `Std` dialects,
-/// for a subset of the Pony IR (e.g. matmul).
-std::unique_ptr<mlir::Pass> createLowerToAffinePass();
+/// for a subset of the Pony IR (e.g. matmul). With `profileOps`, the loops of
+/// every operation are wrapped in `pony.profile_start` and `pony.profile_end`.
+std::unique_ptr<mlir::Pass> createLowerToAffinePass(bool profileOps = false);
 
 /// Create a pass for lowering operations the remaining `Pony` operations, as
-/// well as `Affine` and `Std`, to the LLVM dialect for codegen.
-std::unique_ptr<mlir::Pass> createLowerToLLVMPass();
+/// well as `Affine` and `Std`, to the LLVM dialect for codegen. With
+/// `trackAllocations`, buffers are allocated and freed through the runtime,
+/// which reports the memory the program used when it exits.
+std::unique_ptr<mlir::Pass>
+createLowerToLLVMPass(bool trackAllocations = false);
 
 } // namespace pony
 } // namespace mlir
@@ -0,0 +1,64 @@
+//===- PerfCounters.h - Hardware performance counters ----------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a set of hardware performance counters of the calling
+// thread, read through perf_event_open on Linux. They tell whether a program
+// is bound by its arithmetic, by the caches or by mispredicted branches.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_PERFCOUNTERS_H
+#define PONY_PERFCOUNTERS_H
+
+#include "llvm/ADT/Optional.h"
+
+#include <cstdint>
+#include <string>
+
+namespace pony {
+
+/// The counters of one thread, started and stopped around the code to measure.
+class PerfCounters {
+public:
+  enum Counter {
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+  };
+  static constexpr unsigned kNumCounters = BranchMisses + 1;
+
+  /// Open the counters of the calling thread, stopped. The counters the
+  /// kernel, the hardware or the permissions of the process don't provide are
+  /// unavailable, and all of them are on systems other than Linux.
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  /// Reset the counters and start counting.
+  void start();
+  /// Stop counting.
+  void stop();
+
+  /// Return the count of `counter` between start and stop, scaled up if the
+  /// kernel multiplexed it with others, or None if it is unavailable.
+  llvm::Optional<uint64_t> get(Counter counter) const;
+
+  /// Return the name `counter` is reported under.
+  static const char *getName(Counter counter);
+
+  /// Return why the first counter that couldn't be opened couldn't, or an
+  /// empty string if all of them could.
+  const std::string &getError() const { return error; }
+
+private:
+  int fds[kNumCounters];
+  std::string error;
+};
+
+} // namespace pony
+
+#endif // PONY_PERFCOUNTERS_H
@@ -0,0 +1,74 @@
+//===- PersistentObjectCache.h - On-disk cache of JIT compiled objects -----===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares an llvm::ObjectCache that keeps the objects produced by
+// the JIT in a directory, so that later runs of the same program can skip
+// LLVM code generation entirely.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_PERSISTENTOBJECTCACHE_H
+#define PONY_PERSISTENTOBJECTCACHE_H
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+namespace pony {
+
+/// An object cache keyed by the identifier of the module an object was
+/// compiled from; callers set the identifier to a hash of everything that
+/// influences code generation. Objects are stored as `<key>.o` in the cache
+/// directory, and the least recently used keys are evicted once the directory
+/// grows beyond `maxSizeBytes`, along with the other files clients named after
+/// them. Hit and miss counts are kept both for the
+/// current process and, cumulatively, in a `stats` file next to the objects.
+class PersistentObjectCache : public llvm::ObjectCache {
+public:
+  PersistentObjectCache(llvm::StringRef directory, uint64_t maxSizeBytes);
+  ~PersistentObjectCache() override;
+
+  /// Return a key for an object compiled from `content`.
+  static std::string computeKey(llvm::StringRef content);
+
+  /// Return the object cached under `key`, or nullptr.
+  std::unique_ptr<llvm::MemoryBuffer> lookup(llvm::StringRef key);
+
+  /// Store `object` under `key`, evicting old entries if needed.
+  void store(llvm::StringRef key, llvm::MemoryBufferRef object);
+
+  /// llvm::ObjectCache interface, forwarding to `store` and `lookup` with the
+  /// module identifier as the key.
+  void notifyObjectCompiled(const llvm::Module *module,
+                            llvm::MemoryBufferRef object) override;
+  std::unique_ptr<llvm::MemoryBuffer>
+  getObject(const llvm::Module *module) override;
+
+  llvm::StringRef getDirectory() const { return directory; }
+  unsigned getNumHits() const { return numHits; }
+  unsigned getNumMisses() const { return numMisses; }
+
+  /// Print the statistics of this process and the cumulative ones.
+  void printStatistics(llvm::raw_ostream &os);
+
+private:
+  std::string getObjectPath(llvm::StringRef key) const;
+  std::string getStatisticsPath() const;
+
+  /// Read the cumulative hit and miss counts of earlier processes.
+  void readStatistics(unsigned &hits, unsigned &misses) const;
+
+  /// Delete the files of the least recently used keys until the directory
+  /// fits in `maxSizeBytes`.
+  void evict();
+
+  std::string directory;
+  uint64_t maxSizeBytes;
+  unsigned numHits = 0, numMisses = 0;
+};
+
+} // namespace pony
+
+#endif // PONY_PERSISTENTOBJECTCACHE_H
@@ -0,0 +1,93 @@
+//===- Pipeline.h - The Pony compilation pipeline --------------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the options of the Pony compiler and the pass pipeline
+// lowering Pony modules, shared by the ponyc driver and the embedding API.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_PIPELINE_H
+#define PONY_PIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mlir {
+class ModuleOp;
+class PassManager;
+
+namespace pony {
+class SpecializationCache;
+} // namespace pony
+} // namespace mlir
+
+namespace pony {
+
+/// Options changing the code generated for a Pony module.
+struct CompileOptions {
+  /// The optimization level, from 0 to 3, and the size level: 0, or 1 to
+  /// optimize for size at level 2 (-Os).
+  unsigned optLevel = 1;
+  unsigned sizeLevel = 0;
+
+  /// Evaluate the computations on constants at compile time, pre-rendering at
+  /// most `foldProgramLimit` bytes of output and doing at most
+  /// `foldProgramWorkLimit` units of work per function.
+  bool foldProgram = false;
+  size_t foldProgramLimit = 1 << 20;
+  uint64_t foldProgramWorkLimit = 1 << 24;
+
+  /// Inline calls to functions of at most this many operations.
+  unsigned inlineThreshold = 32;
+
+  /// Time the loops of every operation with the cycle counter, and report
+  /// where the program spent its time when it exits.
+  bool profileOps = false;
+
+  /// Allocate every buffer through the runtime, and report the peak memory of
+  /// the program and what each source location allocated when it exits.
+  bool trackAllocations = false;
+};
+
+/// The dialects a Pony module can be lowered to. Specialized is the Pony
+/// dialect with every function specialized for the shapes it is called with,
+/// as the fast back end needs it.
+enum class LoweringTarget { Pony, Specialized, Affine, LLVM };
+
+/// How far a module has been lowered. Modules record the stage they are at,
+/// so that compiling a module saved at some stage resumes from there rather
+/// than running the passes it went through again.
+enum class Stage { Pony, Specialized, Affine, LLVM };
+
+/// Return the stage recorded in `module`, or Stage::Pony if there is none.
+Stage getStage(mlir::ModuleOp module);
+
+/// Record in `module` that it is at `stage`.
+void setStage(mlir::ModuleOp module, Stage stage);
+
+/// Return the stage a module at stage `from` is at after the pipeline lowering
+/// it to `target` with `options`.
+Stage getStageAfter(LoweringTarget target, const CompileOptions &options,
+                    Stage from);
+
+/// Populate `pm` with the passes lowering a Pony module at stage `from` to
+/// `target`, reusing the specializations `cache` has if given. Lowering to
+/// Pony only specializes and optimizes the module if `options` ask for it. The
+/// passes run at each level are:
+///
+///   -O0  Specialization and lowering only, to compile as fast as possible.
+///   -O1  Inlining, canonicalization and CSE of the Pony IR and of the loops,
+///        what the compiler always ran before it had levels. The default.
+///   -O2  -O1, plus loop fusion, loop-invariant code motion and memref
+///        dataflow optimization (store to load forwarding).
+///   -Os  -O2, optimizing the LLVM IR for size.
+///   -O3  -O2, plus loop tiling, unroll-and-jam and super-vectorization.
+void buildPipeline(mlir::PassManager &pm, LoweringTarget target,
+                   const CompileOptions &options,
+                   mlir::pony::SpecializationCache *cache = nullptr,
+                   Stage from = Stage::Pony);
+
+} // namespace pony
+
+#endif // PONY_PIPELINE_H
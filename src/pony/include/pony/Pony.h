@@ -0,0 +1,174 @@
+//===- Pony.h - Embedding API for the Pony compiler ------------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares libpony, the API for embedding the Pony compiler and JIT
+// into C++ applications: Pony source is compiled to a CompiledModule, whose
+// functions are looked up and called directly on buffers owned by the
+// caller. Buffers are handed to the compiled code as memref descriptors
+// pointing at the caller's memory, nothing is copied on the way in or out.
+//
+// Functions other than `main` are generic over the shapes of their arguments,
+// so the ones to call are declared as entry points along with the shapes to
+// compile them for:
+//
+//   auto module = pony::CompiledModule::compile(
+//       source, {{"multiply_transpose", {{2, 3}, {2, 3}}}});
+//   auto function = (*module)->lookup("multiply_transpose");
+//   double a[6] = {...}, b[6] = {...};
+//   auto result = function->invoke({{a, {2, 3}}, {b, {2, 3}}});
+//   // result->data() points at the 3x2 values, freed with the result.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_PONY_H
+#define PONY_PONY_H
+
+#include "pony/Pipeline.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+class TargetMachine;
+} // namespace llvm
+
+namespace mlir {
+class ExecutionEngine;
+class MLIRContext;
+class ModuleOp;
+} // namespace mlir
+
+namespace pony {
+class Tracer;
+
+/// A function to compile for external callers, and the shapes of the
+/// arguments to compile it for.
+struct EntryPoint {
+  std::string name;
+  std::vector<std::vector<int64_t>> argShapes;
+};
+
+/// Give the functions of `entryPoints` in `module`, a Pony module that isn't
+/// specialized yet, the argument shapes they are declared with, and make them
+/// public so that they are compiled for external callers.
+llvm::Error declareEntryPoints(mlir::ModuleOp module,
+                               llvm::ArrayRef<EntryPoint> entryPoints);
+
+/// Make `llvmModule` compile for `targetMachine`: set its data layout and
+/// triple, and attach the cpu and features to every function so that they
+/// also apply when the code generator isn't driven by `targetMachine` itself,
+/// as in the JIT.
+void configureForTarget(llvm::Module &llvmModule,
+                        const llvm::TargetMachine &targetMachine);
+
+/// A caller-owned, contiguous, row-major array of doubles.
+struct TensorRef {
+  double *data;
+  llvm::ArrayRef<int64_t> shape;
+};
+
+/// An array returned by a compiled function. The compiled code allocated it,
+/// the Tensor owns it from then on.
+class Tensor {
+public:
+  Tensor() = default;
+  Tensor(void *allocated, double *data, llvm::ArrayRef<int64_t> shape)
+      : allocated(allocated), values(data), dims(shape.begin(), shape.end()) {}
+  Tensor(Tensor &&other);
+  Tensor &operator=(Tensor &&other);
+  ~Tensor();
+
+  double *data() const { return values; }
+  llvm::ArrayRef<int64_t> shape() const { return dims; }
+
+  /// Give up the ownership of the array, returning the pointer to release it
+  /// with `free`.
+  void *release();
+
+private:
+  void *allocated = nullptr;
+  double *values = nullptr;
+  llvm::SmallVector<int64_t, 4> dims;
+};
+
+/// A function of a CompiledModule, valid as long as the module is.
+class Function {
+public:
+  using PackedFunction = void (*)(void **);
+
+  Function(PackedFunction function,
+           std::vector<std::vector<int64_t>> argShapes,
+           llvm::Optional<std::vector<int64_t>> resultShape)
+      : function(function), argShapes(std::move(argShapes)),
+        resultShape(std::move(resultShape)) {}
+
+  llvm::ArrayRef<std::vector<int64_t>> getArgumentShapes() const {
+    return argShapes;
+  }
+  bool hasResult() const { return resultShape.hasValue(); }
+
+  /// Call the function on `args`, which must have the shapes it was compiled
+  /// for. Returns its result, or an empty Tensor if it has none.
+  llvm::Expected<Tensor> invoke(llvm::ArrayRef<TensorRef> args) const;
+
+private:
+  PackedFunction function;
+  std::vector<std::vector<int64_t>> argShapes;
+  llvm::Optional<std::vector<int64_t>> resultShape;
+};
+
+/// A Pony module compiled and loaded into a JIT.
+class CompiledModule {
+public:
+  ~CompiledModule();
+
+  /// Compile the Pony `source` with `options`, along with `entryPoints`.
+  /// Errors carry the diagnostics of the compiler.
+  static llvm::Expected<std::unique_ptr<CompiledModule>>
+  compile(llvm::StringRef source, llvm::ArrayRef<EntryPoint> entryPoints = {},
+          const CompileOptions &options = {});
+
+  /// Load `module`, already lowered to the LLVM dialect, optimizing it as
+  /// `options` say and generating code for `targetMachine`, or for the host
+  /// if none is given. The translation to LLVM IR and its optimization are
+  /// recorded into `tracer`, if given. The LLVM dialect translation must have
+  /// been registered with the context of `module`.
+  static llvm::Expected<std::unique_ptr<CompiledModule>>
+  load(mlir::ModuleOp module, const CompileOptions &options = {},
+       llvm::TargetMachine *targetMachine = nullptr,
+       Tracer *tracer = nullptr);
+
+  /// Return the public function `name`: `main` or an entry point.
+  llvm::Expected<Function> lookup(llvm::StringRef name) const;
+
+  /// Run the `main` function, which must not take arguments.
+  llvm::Error runMain() const;
+
+private:
+  CompiledModule() = default;
+
+  /// The context the module was compiled in, if it is owned.
+  std::unique_ptr<mlir::MLIRContext> context;
+  std::unique_ptr<mlir::ExecutionEngine> engine;
+
+  /// The Pony signatures of the public functions, by name.
+  struct Signature {
+    std::vector<std::vector<int64_t>> argShapes;
+    llvm::Optional<std::vector<int64_t>> resultShape;
+  };
+  llvm::StringMap<Signature> signatures;
+};
+
+} // namespace pony
+
+#endif // PONY_PONY_H
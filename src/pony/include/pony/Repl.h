@@ -0,0 +1,93 @@
+//===- Repl.h - Interactive Pony sessions ----------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the engine of the Pony REPL. Function definitions and
+// statements are entered one at a time. A statement is compiled as a function
+// of its own, taking the live variables it reads as arguments, specialized
+// for their shapes and linked into a JIT that lives as long as the session,
+// then run right away. Variables keep their values between statements, and
+// every function specialization is compiled once, the later statements
+// calling the code compiled for the earlier ones.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_REPL_H
+#define PONY_REPL_H
+
+#include "pony/Pipeline.h"
+#include "pony/Pony.h"
+#include "pony/SpecializationCache.h"
+
+#include "mlir/Pass/PassManager.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Module.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace pony {
+class FunctionAST;
+class JITSession;
+class ModuleAST;
+
+class Repl : public mlir::pony::SpecializationCache {
+public:
+  /// Prepares the LLVM IR of every input for `session`: configures it for the
+  /// target and optimizes it. Returns false on failure.
+  using PrepareFunction = std::function<bool(llvm::Module &)>;
+
+  Repl(mlir::MLIRContext &context, JITSession &session,
+       const CompileOptions &options, PrepareFunction prepare);
+  ~Repl() override;
+
+  /// Return true if `input` holds complete definitions or a complete
+  /// statement, rather than the first lines of one.
+  static bool isComplete(llvm::StringRef input);
+
+  /// Evaluate `input`: record the functions it defines, or compile and run the
+  /// statement it holds. Errors are reported on stderr. Returns false on
+  /// failure.
+  bool evaluate(llvm::StringRef input);
+
+  /// SpecializationCache interface. Functions come from the definitions
+  /// entered so far, and the specializations compiled for earlier statements
+  /// are reused.
+  mlir::pony::FuncOp getFunction(llvm::StringRef name,
+                                 mlir::ModuleOp module) override;
+  bool lookup(llvm::StringRef name, llvm::StringRef callee,
+              llvm::SmallVectorImpl<mlir::Type> &resultTypes) override;
+  void notifySpecialized(mlir::pony::FuncOp specialization,
+                         llvm::StringRef callee) override;
+
+private:
+  /// Record the functions of `moduleAST`, which can't be defined already.
+  bool define(std::unique_ptr<ModuleAST> moduleAST);
+
+  /// Compile and run the single statement of the body of `wrapper`.
+  bool run(FunctionAST &wrapper);
+
+  mlir::MLIRContext &context;
+  JITSession &session;
+  PrepareFunction prepare;
+  mlir::PassManager pm;
+
+  /// The definitions entered so far, and their functions by name.
+  std::vector<std::unique_ptr<ModuleAST>> definitions;
+  llvm::StringMap<FunctionAST *> functions;
+
+  /// The result types of the specializations in the JIT, and of those of the
+  /// statement being compiled, by name.
+  llvm::StringMap<llvm::SmallVector<mlir::Type, 1>> compiled;
+  llvm::StringMap<llvm::SmallVector<mlir::Type, 1>> pending;
+
+  /// The values of the live variables.
+  llvm::StringMap<Tensor> variables;
+  unsigned numStatements = 0;
+};
+
+} // namespace pony
+
+#endif // PONY_REPL_H
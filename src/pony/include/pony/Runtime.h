@@ -0,0 +1,78 @@
+//===- Runtime.h - Runtime support library for Pony programs ---------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the C entry points of the Pony runtime. Generated code
+// calls into these functions, and the JIT binds them to the copies linked into
+// the compiler itself.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_RUNTIME_H
+#define PONY_RUNTIME_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pony {
+/// Upper bound on the number of characters `pony_format_f64` writes, large
+/// enough for `%f` of the biggest finite double.
+constexpr size_t kFormatF64MaxLength = 330;
+} // namespace pony
+
+extern "C" {
+
+/// Render `value` exactly as `printf("%f")` would into `out`, which must hold
+/// at least `kFormatF64MaxLength` characters. Returns the number of characters
+/// written; no terminating nul is appended.
+size_t pony_format_f64(double value, char *out);
+
+/// Print the strided f64 buffer described by `data`, `sizes` and `strides`
+/// (each of `rank` entries) in the layout `pony.print` has always produced:
+/// every element followed by a space, and a newline after each inner row.
+void pony_print_memref(double *data, int64_t rank, const int64_t *sizes,
+                       const int64_t *strides);
+
+/// Write `length` bytes of pre-rendered output starting at `data`.
+void pony_print_string(const char *data, int64_t length);
+
+/// Return the current value of the cycle counter, or of a nanosecond clock on
+/// targets without one, for `pony_profile_end`.
+int64_t pony_profile_start(void);
+
+/// Record in the profile of the program that the operation `op` at `file`,
+/// `line` and `col` (nul-terminated strings for the first two) ran from
+/// `start`, a value of `pony_profile_start`, until now, doing `flops`
+/// floating-point operations and moving `bytes` bytes. The first record
+/// arranges for `pony_profile_report` to run when the program exits.
+void pony_profile_end(int64_t start, const char *op, const char *file,
+                      int64_t line, int64_t col, int64_t flops, int64_t bytes);
+
+/// Write the operations recorded so far to stderr, one line per operation and
+/// source location, the ones the program spent the most time in first.
+void pony_profile_report(void);
+
+/// Allocate `size` bytes like `malloc`, recording the allocation under
+/// `file` (a nul-terminated string), `line` and `col`. The first allocation
+/// arranges for `pony_alloc_report` to run when the program exits.
+void *pony_alloc(int64_t size, const char *file, int64_t line, int64_t col);
+
+/// Free `ptr` like `free`, taking it off the live memory if `pony_alloc`
+/// allocated it.
+void pony_free(void *ptr);
+
+/// Write the peak memory of the program and what was allocated at every source
+/// location so far to stderr, the locations with the largest peak first.
+void pony_alloc_report(void);
+
+/// Receives the output of the runtime once redirected with `pony_set_output`.
+typedef void (*pony_output_fn)(void *context, const char *data, size_t length);
+
+/// Send the output of the runtime functions called on the current thread to
+/// `fn`, or back to stdout if `fn` is null. This lets a host running several
+/// programs at once tell their outputs apart.
+void pony_set_output(pony_output_fn fn, void *context);
+
+} // extern "C"
+
+#endif // PONY_RUNTIME_H
@@ -0,0 +1,45 @@
+//===- SpecializationCache.h - Reuse of earlier specializations -----------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the hooks through which the shape specialization pass
+// reuses the functions compiled by an earlier run of the compiler.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_SPECIALIZATIONCACHE_H
+#define PONY_SPECIALIZATIONCACHE_H
+
+#include "pony/Dialect.h"
+
+namespace mlir {
+namespace pony {
+
+/// Consulted by the shape specialization pass for every function it is about
+/// to specialize. A specialization that was compiled before is only declared,
+/// so that neither it nor the generic function it comes from goes through the
+/// rest of the pipeline again.
+class SpecializationCache {
+public:
+  virtual ~SpecializationCache() = default;
+
+  /// Return the generic function `name`, emitting it into `module` first if
+  /// it isn't there yet, or nullptr if there is no such function.
+  virtual FuncOp getFunction(StringRef name, ModuleOp module) = 0;
+
+  /// Return true if the specialization `name` of the generic function `callee`
+  /// was compiled before, setting `resultTypes` to its result types. The name
+  /// of a specialization spells out the shapes it is specialized for.
+  virtual bool lookup(StringRef name, StringRef callee,
+                      SmallVectorImpl<Type> &resultTypes) = 0;
+
+  /// Called once `specialization` of the generic function `callee` is fully
+  /// shaped and about to be compiled. Public functions are reported as
+  /// specializations of themselves.
+  virtual void notifySpecialized(FuncOp specialization, StringRef callee) = 0;
+};
+
+} // namespace pony
+} // namespace mlir
+
+#endif // PONY_SPECIALIZATIONCACHE_H
@@ -0,0 +1,101 @@
+//===- Trace.h - Timeline of the phases of the compiler --------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the tracer behind -trace: it records how long every
+// phase of the compiler takes, on every thread, down to each pass on each
+// function, and writes the timeline in the Chrome trace event format that
+// chrome://tracing and Perfetto open.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef PONY_TRACE_H
+#define PONY_TRACE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace mlir {
+class PassInstrumentation;
+} // namespace mlir
+
+namespace pony {
+
+/// The timed scopes of a run of the compiler. Safe to record into from any
+/// thread.
+class Tracer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Record that `name` ran from `start` to `end` on the calling thread, on
+  /// `detail` if it isn't empty, like the function a pass ran on.
+  void record(llvm::StringRef name, llvm::StringRef detail,
+              Clock::time_point start, Clock::time_point end);
+
+  /// Write the recorded scopes as Chrome trace events, with times relative to
+  /// the creation of the tracer.
+  void write(llvm::raw_ostream &os) const;
+
+private:
+  struct Event {
+    std::string name;
+    std::string detail;
+    uint64_t threadId;
+    Clock::time_point start;
+    Clock::time_point end;
+  };
+
+  Clock::time_point origin = Clock::now();
+  mutable std::mutex mutex;
+  std::vector<Event> events;
+};
+
+/// Records the time from its construction to its destruction into a tracer,
+/// or does nothing if the tracer is null.
+class TraceScope {
+public:
+  TraceScope(Tracer *tracer, llvm::StringRef name,
+             llvm::StringRef detail = "")
+      : tracer(tracer), name(tracer ? name : ""),
+        detail(tracer ? detail : "") {
+    if (tracer)
+      start = Tracer::Clock::now();
+  }
+  ~TraceScope() { end(); }
+
+  /// Record the scope now rather than on destruction.
+  void end() {
+    if (tracer)
+      tracer->record(name, detail, start, Tracer::Clock::now());
+    tracer = nullptr;
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  Tracer *tracer;
+  std::string name;
+  std::string detail;
+  Tracer::Clock::time_point start;
+};
+
+/// Create an instrumentation recording every pass into `tracer`, on the
+/// operation it runs on: the passes nested on functions are recorded once per
+/// function, on the thread that ran them.
+std::unique_ptr<mlir::PassInstrumentation>
+createTraceInstrumentation(Tracer &tracer);
+
+} // namespace pony
+
+#endif // PONY_TRACE_H
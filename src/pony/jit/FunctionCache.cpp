@@ -0,0 +1,345 @@
+//===- FunctionCache.cpp - On-disk cache of compiled Pony functions -------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the cache behind incremental recompilation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/FunctionCache.h"
+#include "pony/AST.h"
+#include "pony/MLIRGen.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/BuiltinTypes.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
+
+using namespace pony;
+
+/// Feed everything about `expr` that influences the generated code into
+/// `hash`, leaving out source locations, and collect the functions it calls
+/// into `callees`.
+static void hashExpr(ExprAST &expr, llvm::MD5 &hash,
+                     llvm::StringSet<> &callees) {
+  auto hashByte = [&](uint8_t byte) {
+    hash.update(llvm::makeArrayRef(byte));
+  };
+  auto hashString = [&](llvm::StringRef string) {
+    hash.update(string);
+    hash.update(llvm::StringRef("", 1));
+  };
+  auto hashInts = [&](llvm::ArrayRef<int64_t> values) {
+    hashString(std::to_string(values.size()));
+    for (int64_t value : values)
+      hashString(std::to_string(value));
+  };
+
+  hashByte(expr.getKind());
+  switch (expr.getKind()) {
+  case ExprAST::Expr_VarDecl: {
+    auto &varDecl = llvm::cast<VarDeclExprAST>(expr);
+    hashString(varDecl.getName());
+    hashInts(varDecl.getType().shape);
+    hashExpr(*varDecl.getInitVal(), hash, callees);
+    break;
+  }
+  case ExprAST::Expr_Return: {
+    auto value = llvm::cast<ReturnExprAST>(expr).getExpr();
+    hashByte(value.hasValue());
+    if (value)
+      hashExpr(**value, hash, callees);
+    break;
+  }
+  case ExprAST::Expr_Num: {
+    double value = llvm::cast<NumberExprAST>(expr).getValue();
+    hash.update(llvm::makeArrayRef(reinterpret_cast<uint8_t *>(&value),
+                                   sizeof(value)));
+    break;
+  }
+  case ExprAST::Expr_Literal: {
+    auto &literal = llvm::cast<LiteralExprAST>(expr);
+    hashInts(literal.getDims());
+    for (auto &value : literal.getValues())
+      hashExpr(*value, hash, callees);
+    break;
+  }
+  case ExprAST::Expr_Var:
+    hashString(llvm::cast<VariableExprAST>(expr).getName());
+    break;
+  case ExprAST::Expr_BinOp: {
+    auto &binOp = llvm::cast<BinaryExprAST>(expr);
+    hashByte(binOp.getOp());
+    hashExpr(*binOp.getLHS(), hash, callees);
+    hashExpr(*binOp.getRHS(), hash, callees);
+    break;
+  }
+  case ExprAST::Expr_Call: {
+    auto &call = llvm::cast<CallExprAST>(expr);
+    hashString(call.getCallee());
+    hashString(std::to_string(call.getArgs().size()));
+    for (auto &arg : call.getArgs())
+      hashExpr(*arg, hash, callees);
+    if (call.getCallee() != "transpose")
+      callees.insert(call.getCallee());
+    break;
+  }
+  case ExprAST::Expr_Print:
+    hashExpr(*llvm::cast<PrintExprAST>(expr).getArg(), hash, callees);
+    break;
+  }
+}
+
+FunctionCache::FunctionCache(mlir::MLIRContext &context, ModuleAST &moduleAST,
+                             PersistentObjectCache &objects,
+                             llvm::StringRef configuration)
+    : context(context), objects(objects),
+      configuration(configuration.str()) {
+  // Hash every function on its own first.
+  llvm::StringMap<std::string> localHashes;
+  llvm::StringMap<llvm::StringSet<>> directCallees;
+  for (FunctionAST &function : moduleAST) {
+    llvm::StringRef name = function.getProto()->getName();
+    functions[name] = &function;
+
+    llvm::MD5 hash;
+    hash.update(name);
+    for (auto &arg : function.getProto()->getArgs()) {
+      hash.update(llvm::StringRef("", 1));
+      hash.update(arg->getName());
+    }
+    for (auto &expr : *function.getBody())
+      hashExpr(*expr, hash, directCallees[name]);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    localHashes[name] = std::string(result.digest());
+  }
+
+  // Then combine the hash of each function with those of all the functions
+  // it transitively calls, in a deterministic order. Calls to functions that
+  // don't exist are covered by name, so defining them changes the hash.
+  for (auto &function : functions) {
+    llvm::StringSet<> reachable;
+    std::vector<llvm::StringRef> worklist = {function.getKey()};
+    while (!worklist.empty()) {
+      llvm::StringRef name = worklist.back();
+      worklist.pop_back();
+      if (!reachable.insert(name).second)
+        continue;
+      auto callees = directCallees.find(name);
+      if (callees == directCallees.end())
+        continue;
+      for (auto &callee : callees->second)
+        worklist.push_back(callee.getKey());
+    }
+
+    std::vector<llvm::StringRef> names;
+    for (auto &name : reachable)
+      names.push_back(name.getKey());
+    std::sort(names.begin(), names.end());
+    std::string content;
+    for (llvm::StringRef name : names)
+      content += name.str() + " " + localHashes.lookup(name) + "\n";
+    hashes[function.getKey()] = PersistentObjectCache::computeKey(content);
+  }
+}
+
+std::string FunctionCache::getKey(llvm::StringRef name,
+                                  llvm::StringRef callee) const {
+  auto hash = hashes.find(callee);
+  if (hash == hashes.end())
+    return "";
+  return PersistentObjectCache::computeKey(configuration + "\n" +
+                                           hash->second + "\n" + name.str());
+}
+
+std::string FunctionCache::getEntryPath(llvm::StringRef key) const {
+  llvm::SmallString<128> path(objects.getDirectory());
+  llvm::sys::path::append(path, key + ".fn");
+  return std::string(path);
+}
+
+mlir::pony::FuncOp FunctionCache::getFunction(llvm::StringRef name,
+                                              mlir::ModuleOp module) {
+  if (auto function = module.lookupSymbol<mlir::pony::FuncOp>(name))
+    return function;
+  FunctionAST *functionAST = functions.lookup(name);
+  if (!functionAST || mlir::failed(mlirGen(module, *functionAST)))
+    return nullptr;
+  return module.lookupSymbol<mlir::pony::FuncOp>(name);
+}
+
+bool FunctionCache::lookup(llvm::StringRef name, llvm::StringRef callee,
+                           llvm::SmallVectorImpl<mlir::Type> &resultTypes) {
+  std::string key = getKey(name, callee);
+  if (key.empty() || !load(key))
+    return false;
+  keys[name] = key;
+
+  auto elementType = mlir::FloatType::getF64(&context);
+  for (auto &shape : entries[key].resultShapes)
+    resultTypes.push_back(mlir::RankedTensorType::get(shape, elementType));
+  return true;
+}
+
+void FunctionCache::notifySpecialized(mlir::pony::FuncOp specialization,
+                                      llvm::StringRef callee) {
+  llvm::StringRef name = specialization.getName();
+  keys[name] = getKey(name, callee);
+  auto &shapes = resultShapes[name];
+  shapes.clear();
+  for (mlir::Type type : specialization.getFunctionType().getResults()) {
+    auto shape = type.cast<mlir::RankedTensorType>().getShape();
+    shapes.emplace_back(shape.begin(), shape.end());
+  }
+}
+
+bool FunctionCache::load(llvm::StringRef key) {
+  if (entries.count(key))
+    return true;
+
+  // The entry file lists the result shapes and the callees, one per line:
+  //   result <dim> <dim> ...
+  //   call <key>
+  auto entryFile = llvm::MemoryBuffer::getFile(getEntryPath(key));
+  if (!entryFile)
+    return false;
+  Entry entry;
+  llvm::SmallVector<llvm::StringRef, 8> lines;
+  (*entryFile)->getBuffer().split(lines, '\n', /*MaxSplit=*/-1,
+                                  /*KeepEmpty=*/false);
+  for (llvm::StringRef line : lines) {
+    llvm::StringRef kind, rest;
+    std::tie(kind, rest) = line.split(' ');
+    if (kind == "call") {
+      entry.callees.push_back(rest.str());
+      continue;
+    }
+    if (kind != "result")
+      return false;
+    llvm::SmallVector<llvm::StringRef, 4> dims;
+    rest.split(dims, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    std::vector<int64_t> shape;
+    for (llvm::StringRef dim : dims) {
+      int64_t size;
+      if (dim.getAsInteger(10, size))
+        return false;
+      shape.push_back(size);
+    }
+    entry.resultShapes.push_back(std::move(shape));
+  }
+
+  entry.object = objects.lookup(key);
+  if (!entry.object)
+    return false;
+  std::vector<std::string> callees = entry.callees;
+  entries[key] = std::move(entry);
+  for (const std::string &callee : callees) {
+    if (!load(callee)) {
+      entries.erase(key);
+      return false;
+    }
+  }
+  return true;
+}
+
+llvm::Error FunctionCache::store(llvm::Module &llvmModule,
+                                 llvm::TargetMachine &targetMachine) {
+  for (llvm::Function &function : llvmModule) {
+    if (function.isDeclaration())
+      continue;
+    // The C interface wrapper of `main` is for callers outside of Pony, the
+    // JIT calls `main` itself.
+    if (function.getName().startswith("_mlir_ciface_"))
+      continue;
+    auto key = keys.find(function.getName());
+    if (key == keys.end() || key->second.empty())
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "no cache key for function '%s'",
+                                     function.getName().str().c_str());
+
+    // Clone the function into a module of its own, along with the private
+    // globals, such as the strings it prints, that it may use.
+    llvm::ValueToValueMapTy valueMap;
+    std::unique_ptr<llvm::Module> part = llvm::CloneModule(
+        llvmModule, valueMap, [&](const llvm::GlobalValue *value) {
+          return value == &function ||
+                 (llvm::isa<llvm::GlobalVariable>(value) &&
+                  value->hasLocalLinkage());
+        });
+    for (llvm::GlobalVariable &global :
+         llvm::make_early_inc_range(part->globals())) {
+      global.removeDeadConstantUsers();
+      if (global.hasLocalLinkage() && global.use_empty())
+        global.eraseFromParent();
+    }
+
+    Entry entry;
+    for (llvm::Function &callee : *part) {
+      auto calleeKey = keys.find(callee.getName());
+      if (callee.isDeclaration() && calleeKey != keys.end())
+        entry.callees.push_back(calleeKey->second);
+    }
+    entry.resultShapes = resultShapes.lookup(function.getName());
+
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream os(buffer);
+    llvm::legacy::PassManager pm;
+    if (targetMachine.addPassesToEmitFile(pm, os, nullptr,
+                                          llvm::CGFT_ObjectFile))
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "target can't emit an object file");
+    pm.run(*part);
+    entry.object = llvm::MemoryBuffer::getMemBufferCopy(
+        llvm::StringRef(buffer.data(), buffer.size()), key->second);
+    ++numCompiled;
+
+    // Store the object before the entry file, an entry without its object is
+    // just a miss.
+    std::string content;
+    for (auto &shape : entry.resultShapes) {
+      content += "result";
+      for (int64_t dim : shape)
+        content += " " + std::to_string(dim);
+      content += "\n";
+    }
+    for (const std::string &callee : entry.callees)
+      content += "call " + callee + "\n";
+    objects.store(key->second, entry.object->getMemBufferRef());
+    llvm::SmallString<128> tempModel(objects.getDirectory());
+    llvm::sys::path::append(tempModel, "fn-%%%%%%.tmp");
+    if (auto err = llvm::writeFileAtomically(
+            tempModel, getEntryPath(key->second), content))
+      return err;
+    entries[key->second] = std::move(entry);
+  }
+  return llvm::Error::success();
+}
+
+void FunctionCache::collect(
+    llvm::StringRef key, llvm::StringSet<> &visited,
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> &program) {
+  if (!visited.insert(key).second)
+    return;
+  Entry &entry = entries[key];
+  program.push_back(llvm::MemoryBuffer::getMemBuffer(
+      entry.object->getMemBufferRef(), /*RequiresNullTerminator=*/false));
+  for (const std::string &callee : entry.callees)
+    collect(callee, visited, program);
+}
+
+bool FunctionCache::getProgram(
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> &program) {
+  std::string key = getKey("main", "main");
+  if (key.empty() || !load(key))
+    return false;
+  llvm::StringSet<> visited;
+  collect(key, visited, program);
+  return true;
+}
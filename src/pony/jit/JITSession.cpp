@@ -0,0 +1,187 @@
+//===- JITSession.cpp - Reusable JIT for running Pony programs ------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the JIT used to run Pony programs.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/JITSession.h"
+#include "pony/Runtime.h"
+
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace pony;
+
+void pony::flushCompilerOutput() { llvm::outs().flush(); }
+
+llvm::orc::SymbolMap
+pony::getRuntimeSymbols(llvm::orc::MangleAndInterner interner) {
+  llvm::orc::SymbolMap symbolMap;
+  symbolMap[interner("pony_print_memref")] =
+      llvm::JITEvaluatedSymbol::fromPointer(pony_print_memref);
+  symbolMap[interner("pony_print_string")] =
+      llvm::JITEvaluatedSymbol::fromPointer(pony_print_string);
+  symbolMap[interner("pony_profile_start")] =
+      llvm::JITEvaluatedSymbol::fromPointer(pony_profile_start);
+  symbolMap[interner("pony_profile_end")] =
+      llvm::JITEvaluatedSymbol::fromPointer(pony_profile_end);
+  symbolMap[interner("pony_alloc")] =
+      llvm::JITEvaluatedSymbol::fromPointer(pony_alloc);
+  symbolMap[interner("pony_free")] =
+      llvm::JITEvaluatedSymbol::fromPointer(pony_free);
+  return symbolMap;
+}
+
+/// Set up `builder` to generate code for `jtmb`, through `cache` if given.
+template <typename BuilderT>
+static BuilderT &configureBuilder(BuilderT &builder,
+                                  llvm::orc::JITTargetMachineBuilder jtmb,
+                                  llvm::ObjectCache *cache) {
+  return builder.setJITTargetMachineBuilder(std::move(jtmb))
+      .setCompileFunctionCreator(
+          [cache](llvm::orc::JITTargetMachineBuilder jtmb)
+              -> llvm::Expected<
+                  std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+            auto tm = jtmb.createTargetMachine();
+            if (!tm)
+              return tm.takeError();
+            return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(
+                std::move(*tm), cache);
+          });
+}
+
+llvm::Expected<std::unique_ptr<JITSession>>
+JITSession::create(const llvm::TargetMachine &targetMachine,
+                   llvm::ObjectCache *cache, bool lazy, Optimizer optimize) {
+  llvm::orc::JITTargetMachineBuilder jtmb(targetMachine.getTargetTriple());
+  jtmb.setCPU(targetMachine.getTargetCPU().str());
+  jtmb.getFeatures() =
+      llvm::SubtargetFeatures(targetMachine.getTargetFeatureString());
+  jtmb.setCodeGenOptLevel(targetMachine.getOptLevel());
+
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  if (lazy) {
+    // Compile each function on its own, as it is first called.
+    llvm::orc::LLLazyJITBuilder builder;
+    auto lazyJIT =
+        configureBuilder(builder, std::move(jtmb), cache).create();
+    if (!lazyJIT)
+      return lazyJIT.takeError();
+    (*lazyJIT)->setPartitionFunction(
+        llvm::orc::CompileOnDemandLayer::compileRequested);
+    jit = std::move(*lazyJIT);
+  } else {
+    llvm::orc::LLJITBuilder builder;
+    auto eagerJIT = configureBuilder(builder, std::move(jtmb), cache).create();
+    if (!eagerJIT)
+      return eagerJIT.takeError();
+    jit = std::move(*eagerJIT);
+  }
+
+  if (optimize) {
+    jit->getIRTransformLayer().setTransform(
+        [optimize](llvm::orc::ThreadSafeModule module,
+                   const llvm::orc::MaterializationResponsibility &)
+            -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+          if (auto err = module.withModuleDo([&](llvm::Module &llvmModule) {
+                return optimize(&llvmModule);
+              }))
+            return std::move(err);
+          return std::move(module);
+        });
+  }
+
+  // Resolve the C library from the process and the runtime from the copies
+  // linked into the compiler. Programs link against the main JITDylib.
+  llvm::orc::JITDylib &mainJD = jit->getMainJITDylib();
+  auto processSymbols =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          jit->getDataLayout().getGlobalPrefix());
+  if (!processSymbols)
+    return processSymbols.takeError();
+  mainJD.addGenerator(std::move(*processSymbols));
+  if (auto err = mainJD.define(llvm::orc::absoluteSymbols(
+          getRuntimeSymbols(llvm::orc::MangleAndInterner(
+              jit->getExecutionSession(), jit->getDataLayout())))))
+    return std::move(err);
+
+  return std::unique_ptr<JITSession>(new JITSession(std::move(jit), lazy));
+}
+
+llvm::Error JITSession::addModule(llvm::orc::JITDylib &jd,
+                                  llvm::orc::ThreadSafeModule module) {
+  if (lazy)
+    return static_cast<llvm::orc::LLLazyJIT &>(*jit).addLazyIRModule(
+        jd, std::move(module));
+  return jit->addIRModule(jd, std::move(module));
+}
+
+llvm::Error JITSession::run(llvm::orc::ThreadSafeModule module) {
+  return runProgram([&](llvm::orc::JITDylib &jd) {
+    return addModule(jd, std::move(module));
+  });
+}
+
+llvm::Error JITSession::run(std::unique_ptr<llvm::MemoryBuffer> object) {
+  return runProgram([&](llvm::orc::JITDylib &jd) {
+    return jit->addObjectFile(jd, std::move(object));
+  });
+}
+
+llvm::Error
+JITSession::run(std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects) {
+  return runProgram([&](llvm::orc::JITDylib &jd) -> llvm::Error {
+    for (auto &object : objects)
+      if (auto err = jit->addObjectFile(jd, std::move(object)))
+        return err;
+    return llvm::Error::success();
+  });
+}
+
+llvm::Error JITSession::add(llvm::orc::ThreadSafeModule module) {
+  return addModule(jit->getMainJITDylib(), std::move(module));
+}
+
+llvm::Error JITSession::define(llvm::StringRef name, void *address) {
+  llvm::orc::SymbolMap symbols;
+  symbols[jit->mangleAndIntern(name)] =
+      llvm::JITEvaluatedSymbol::fromPointer(address);
+  return jit->getMainJITDylib().define(
+      llvm::orc::absoluteSymbols(std::move(symbols)));
+}
+
+llvm::Expected<void *> JITSession::lookup(llvm::StringRef name) {
+  auto symbol = jit->getExecutionSession().lookup(
+      {&jit->getMainJITDylib()}, jit->mangleAndIntern(name));
+  if (!symbol)
+    return symbol.takeError();
+  return reinterpret_cast<void *>(symbol->getAddress());
+}
+
+llvm::Error JITSession::runProgram(
+    llvm::function_ref<llvm::Error(llvm::orc::JITDylib &)> addProgram) {
+  llvm::orc::ExecutionSession &session = jit->getExecutionSession();
+  auto jd = session.createJITDylib("program" + std::to_string(numPrograms++));
+  if (!jd)
+    return jd.takeError();
+  jd->addToLinkOrder(jit->getMainJITDylib());
+
+  llvm::Error err = addProgram(*jd);
+  if (!err) {
+    // Looking `main` up compiles the program.
+    auto mainSymbol = session.lookup({&*jd}, jit->mangleAndIntern("main"));
+    if (mainSymbol) {
+      auto *mainFunc = reinterpret_cast<void (*)()>(mainSymbol->getAddress());
+      mainFunc();
+    } else {
+      err = mainSymbol.takeError();
+    }
+  }
+
+  // Release the code and data of the program.
+  return llvm::joinErrors(std::move(err), session.removeJITDylib(*jd));
+}
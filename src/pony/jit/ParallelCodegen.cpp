@@ -0,0 +1,103 @@
+//===- ParallelCodegen.cpp - Parallel LLVM optimization and codegen -------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the parallel back end of the compiler.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/ParallelCodegen.h"
+
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/SmallVectorMemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+using namespace pony;
+
+/// Optimize the partition serialized in `bitcode` and compile it to an object
+/// with a copy of `targetMachine`. Runs on a worker thread, so everything it
+/// touches is its own.
+static llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+compilePartition(llvm::StringRef bitcode,
+                 const llvm::TargetMachine &targetMachine,
+                 const CompileOptions &options) {
+  llvm::LLVMContext llvmContext;
+  auto partition = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(bitcode, "<partition>"), llvmContext);
+  if (!partition)
+    return partition.takeError();
+
+  // A TargetMachine isn't safe to generate code with from several threads.
+  std::unique_ptr<llvm::TargetMachine> partitionTarget(
+      targetMachine.getTarget().createTargetMachine(
+          targetMachine.getTargetTriple().str(), targetMachine.getTargetCPU(),
+          targetMachine.getTargetFeatureString(), targetMachine.Options,
+          targetMachine.getRelocationModel(), targetMachine.getCodeModel(),
+          targetMachine.getOptLevel()));
+  if (!partitionTarget)
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "could not create a target machine");
+
+  auto optimize = mlir::makeOptimizingTransformer(
+      options.optLevel, options.sizeLevel, partitionTarget.get());
+  if (llvm::Error err = optimize(partition->get()))
+    return std::move(err);
+
+  llvm::SmallVector<char, 0> buffer;
+  llvm::raw_svector_ostream os(buffer);
+  llvm::legacy::PassManager pm;
+  if (partitionTarget->addPassesToEmitFile(pm, os, nullptr,
+                                           llvm::CGFT_ObjectFile))
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "target can't emit an object file");
+  pm.run(**partition);
+  return std::make_unique<llvm::SmallVectorMemoryBuffer>(std::move(buffer));
+}
+
+llvm::Expected<std::vector<std::unique_ptr<llvm::MemoryBuffer>>>
+pony::compileInParallel(llvm::Module &llvmModule,
+                        const llvm::TargetMachine &targetMachine,
+                        const CompileOptions &options,
+                        unsigned numPartitions) {
+  // The partitions share the context of the module, which only one thread may
+  // use at a time: serialize them here and read each one back into a context
+  // of its own on the thread compiling it, as llvm::splitCodeGen does.
+  std::vector<llvm::SmallString<0>> partitions;
+  llvm::SplitModule(
+      llvmModule, numPartitions,
+      [&](std::unique_ptr<llvm::Module> partition) {
+        partitions.emplace_back();
+        llvm::raw_svector_ostream os(partitions.back());
+        llvm::WriteBitcodeToFile(*partition, os);
+      },
+      /*PreserveLocals=*/false);
+
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects(partitions.size());
+  std::vector<std::string> errors(partitions.size());
+  {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(numPartitions));
+    for (size_t i = 0; i < partitions.size(); ++i)
+      pool.async([&, i] {
+        auto object = compilePartition(partitions[i], targetMachine, options);
+        if (object)
+          objects[i] = std::move(*object);
+        else
+          errors[i] = llvm::toString(object.takeError());
+      });
+    pool.wait();
+  }
+
+  for (const std::string &error : errors)
+    if (!error.empty())
+      return llvm::createStringError(llvm::inconvertibleErrorCode(), error);
+  return std::move(objects);
+}
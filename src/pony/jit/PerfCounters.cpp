@@ -0,0 +1,129 @@
+//===- PerfCounters.cpp - Hardware performance counters -------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the hardware performance counters on top of
+// perf_event_open. Every counter is opened on its own rather than as a group,
+// so that the ones the hardware lacks don't take the others down with them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/PerfCounters.h"
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <tuple>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace pony;
+
+#ifdef __linux__
+/// Return the perf event type and config measuring `counter`.
+static std::pair<uint32_t, uint64_t> getEvent(PerfCounters::Counter counter) {
+  switch (counter) {
+  case PerfCounters::Cycles:
+    return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+  case PerfCounters::Instructions:
+    return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS};
+  case PerfCounters::L1DMisses:
+    return {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+  case PerfCounters::LLCMisses:
+    return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+  case PerfCounters::BranchMisses:
+    return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+  }
+  llvm_unreachable("unknown counter");
+}
+
+PerfCounters::PerfCounters() {
+  for (unsigned i = 0; i != kNumCounters; ++i) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    std::tie(attr.type, attr.config) = getEvent(static_cast<Counter>(i));
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds[i] = syscall(SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1,
+                     /*group_fd=*/-1, /*flags=*/0);
+    if (fds[i] < 0 && error.empty())
+      error = std::string("perf_event_open: ") + std::strerror(errno);
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds)
+    if (fd >= 0)
+      close(fd);
+}
+
+void PerfCounters::start() {
+  for (int fd : fds) {
+    if (fd < 0)
+      continue;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void PerfCounters::stop() {
+  for (int fd : fds)
+    if (fd >= 0)
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+}
+
+llvm::Optional<uint64_t> PerfCounters::get(Counter counter) const {
+  int fd = fds[counter];
+  // The value, then the times the counter was enabled and running.
+  uint64_t values[3];
+  if (fd < 0 || read(fd, values, sizeof(values)) != sizeof(values) ||
+      values[2] == 0)
+    return llvm::None;
+  if (values[2] == values[1])
+    return values[0];
+  return uint64_t(double(values[0]) * values[1] / values[2]);
+}
+#else
+PerfCounters::PerfCounters() : error("not supported on this system") {
+  for (int &fd : fds)
+    fd = -1;
+}
+
+PerfCounters::~PerfCounters() = default;
+
+void PerfCounters::start() {}
+
+void PerfCounters::stop() {}
+
+llvm::Optional<uint64_t> PerfCounters::get(Counter) const {
+  return llvm::None;
+}
+#endif
+
+const char *PerfCounters::getName(Counter counter) {
+  switch (counter) {
+  case Cycles:
+    return "cycles";
+  case Instructions:
+    return "instructions";
+  case L1DMisses:
+    return "L1D load misses";
+  case LLCMisses:
+    return "LLC misses";
+  case BranchMisses:
+    return "branch misses";
+  }
+  llvm_unreachable("unknown counter");
+}
@@ -0,0 +1,188 @@
+//===- PersistentObjectCache.cpp - On-disk cache of JIT compiled objects --===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the on-disk object cache used by the JIT.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/PersistentObjectCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace pony;
+namespace fs = llvm::sys::fs;
+
+PersistentObjectCache::PersistentObjectCache(llvm::StringRef directory,
+                                             uint64_t maxSizeBytes)
+    : directory(directory.str()), maxSizeBytes(maxSizeBytes) {
+  if (std::error_code ec = fs::create_directories(directory))
+    llvm::errs() << "Could not create the JIT cache directory " << directory
+                 << ": " << ec.message() << "\n";
+}
+
+PersistentObjectCache::~PersistentObjectCache() {
+  if (!numHits && !numMisses)
+    return;
+
+  // Fold this process' counts into the cumulative statistics. Concurrent
+  // processes may race here; losing a few counts is fine, corrupting the file
+  // is not, hence the atomic write.
+  unsigned hits, misses;
+  readStatistics(hits, misses);
+  std::string content = std::to_string(hits + numHits) + " " +
+                        std::to_string(misses + numMisses) + "\n";
+  llvm::SmallString<128> tempModel(directory);
+  llvm::sys::path::append(tempModel, "stats-%%%%%%.tmp");
+  llvm::consumeError(
+      llvm::writeFileAtomically(tempModel, getStatisticsPath(), content));
+}
+
+std::string PersistentObjectCache::computeKey(llvm::StringRef content) {
+  llvm::MD5 hash;
+  hash.update(content);
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  return std::string(result.digest());
+}
+
+std::string PersistentObjectCache::getObjectPath(llvm::StringRef key) const {
+  llvm::SmallString<128> path(directory);
+  llvm::sys::path::append(path, key + ".o");
+  return std::string(path);
+}
+
+std::string PersistentObjectCache::getStatisticsPath() const {
+  llvm::SmallString<128> path(directory);
+  llvm::sys::path::append(path, "stats");
+  return std::string(path);
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+PersistentObjectCache::lookup(llvm::StringRef key) {
+  std::string path = getObjectPath(key);
+  auto bufferOrErr = llvm::MemoryBuffer::getFile(path);
+  if (!bufferOrErr) {
+    ++numMisses;
+    return nullptr;
+  }
+  ++numHits;
+
+  // Refresh the modification time, which eviction treats as the last use.
+  int fd;
+  if (!fs::openFileForReadWrite(path, fd, fs::CD_OpenExisting, fs::OF_None)) {
+    fs::setLastAccessAndModificationTime(
+        fd, std::chrono::time_point_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now()));
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  }
+  return std::move(*bufferOrErr);
+}
+
+void PersistentObjectCache::store(llvm::StringRef key,
+                                  llvm::MemoryBufferRef object) {
+  // Write through a temporary file so that concurrent readers never see a
+  // partially written object.
+  llvm::SmallString<128> tempModel(directory);
+  llvm::sys::path::append(tempModel, key + "-%%%%%%.tmp");
+  if (llvm::Error err = llvm::writeFileAtomically(
+          tempModel, getObjectPath(key), object.getBuffer())) {
+    llvm::errs() << "Could not store object in the JIT cache: "
+                 << llvm::toString(std::move(err)) << "\n";
+    return;
+  }
+  evict();
+}
+
+void PersistentObjectCache::notifyObjectCompiled(const llvm::Module *module,
+                                                 llvm::MemoryBufferRef object) {
+  store(module->getModuleIdentifier(), object);
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+PersistentObjectCache::getObject(const llvm::Module *module) {
+  // This is asked for by the compiler right before it generates code, after
+  // the caller already went through `lookup`, so it doesn't count towards the
+  // statistics.
+  auto bufferOrErr =
+      llvm::MemoryBuffer::getFile(getObjectPath(module->getModuleIdentifier()));
+  if (!bufferOrErr)
+    return nullptr;
+  return std::move(*bufferOrErr);
+}
+
+void PersistentObjectCache::evict() {
+  // The files named after a key, its object and what clients such as
+  // FunctionCache store along with it, make up one entry.
+  struct Entry {
+    std::vector<std::pair<std::string, uint64_t>> files;
+    llvm::sys::TimePoint<> lastUse;
+  };
+  llvm::StringMap<Entry> entries;
+  uint64_t totalSize = 0;
+
+  std::error_code ec;
+  for (fs::directory_iterator it(directory, ec), end; it != end && !ec;
+       it.increment(ec)) {
+    // Skip the statistics and the files still being written.
+    llvm::StringRef path = it->path();
+    llvm::StringRef extension = llvm::sys::path::extension(path);
+    if (extension.empty() || extension == ".tmp")
+      continue;
+    fs::file_status status;
+    if (fs::status(path, status))
+      continue;
+    Entry &entry = entries[llvm::sys::path::stem(path)];
+    entry.files.emplace_back(path.str(), status.getSize());
+    entry.lastUse = std::max(entry.lastUse, status.getLastModificationTime());
+    totalSize += status.getSize();
+  }
+  if (totalSize <= maxSizeBytes)
+    return;
+
+  // Drop the least recently used entries first, all of their files at once.
+  std::vector<const Entry *> byLastUse;
+  for (const auto &entry : entries)
+    byLastUse.push_back(&entry.getValue());
+  llvm::sort(byLastUse, [](const Entry *lhs, const Entry *rhs) {
+    return lhs->lastUse < rhs->lastUse;
+  });
+  for (const Entry *entry : byLastUse) {
+    if (totalSize <= maxSizeBytes)
+      break;
+    for (const auto &file : entry->files)
+      if (!fs::remove(file.first))
+        totalSize -= file.second;
+  }
+}
+
+void PersistentObjectCache::readStatistics(unsigned &hits,
+                                           unsigned &misses) const {
+  hits = misses = 0;
+  auto bufferOrErr = llvm::MemoryBuffer::getFile(getStatisticsPath());
+  if (!bufferOrErr)
+    return;
+  llvm::StringRef hitsStr, missesStr;
+  std::tie(hitsStr, missesStr) = (*bufferOrErr)->getBuffer().trim().split(' ');
+  if (hitsStr.getAsInteger(10, hits) || missesStr.getAsInteger(10, misses))
+    hits = misses = 0;
+}
+
+void PersistentObjectCache::printStatistics(llvm::raw_ostream &os) {
+  unsigned hits, misses;
+  readStatistics(hits, misses);
+  os << "JIT cache: " << numHits << " hits, " << numMisses
+     << " misses in this run; " << hits + numHits << " hits, "
+     << misses + numMisses << " misses overall (" << directory << ")\n";
+}
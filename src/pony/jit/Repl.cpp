@@ -0,0 +1,314 @@
+//===- Repl.cpp - Interactive Pony sessions -------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the engine of the Pony REPL.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Repl.h"
+#include "pony/AST.h"
+#include "pony/JITSession.h"
+#include "pony/MLIRGen.h"
+#include "pony/Parser.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
+#include "mlir/Target/LLVMIR/Export.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace pony;
+
+/// Collect the names of the variables `expr` reads into `names`.
+static void collectVariables(ExprAST &expr,
+                             llvm::SetVector<llvm::StringRef> &names) {
+  switch (expr.getKind()) {
+  case ExprAST::Expr_VarDecl:
+    collectVariables(*llvm::cast<VarDeclExprAST>(expr).getInitVal(), names);
+    break;
+  case ExprAST::Expr_Return:
+    if (auto value = llvm::cast<ReturnExprAST>(expr).getExpr())
+      collectVariables(**value, names);
+    break;
+  case ExprAST::Expr_Num:
+    break;
+  case ExprAST::Expr_Literal:
+    for (auto &value : llvm::cast<LiteralExprAST>(expr).getValues())
+      collectVariables(*value, names);
+    break;
+  case ExprAST::Expr_Var:
+    names.insert(llvm::cast<VariableExprAST>(expr).getName());
+    break;
+  case ExprAST::Expr_BinOp: {
+    auto &binOp = llvm::cast<BinaryExprAST>(expr);
+    collectVariables(*binOp.getLHS(), names);
+    collectVariables(*binOp.getRHS(), names);
+    break;
+  }
+  case ExprAST::Expr_Call:
+    for (auto &arg : llvm::cast<CallExprAST>(expr).getArgs())
+      collectVariables(*arg, names);
+    break;
+  case ExprAST::Expr_Print:
+    collectVariables(*llvm::cast<PrintExprAST>(expr).getArg(), names);
+    break;
+  }
+}
+
+/// Add to `llvmModule` a function `packedName` calling the C interface of its
+/// function `name` with the arguments packed into an array of pointers, the
+/// calling convention of pony::Function.
+static void addPackedWrapper(llvm::Module &llvmModule, llvm::StringRef name,
+                             llvm::StringRef packedName) {
+  llvm::Function *function =
+      llvmModule.getFunction(("_mlir_ciface_" + name).str());
+  llvm::LLVMContext &llvmContext = llvmModule.getContext();
+  llvm::IRBuilder<> builder(llvmContext);
+  llvm::Type *pointerType = builder.getInt8PtrTy();
+  auto *packedType = llvm::FunctionType::get(
+      builder.getVoidTy(), pointerType->getPointerTo(), /*isVarArg=*/false);
+  auto *packed = llvm::Function::Create(
+      packedType, llvm::GlobalValue::ExternalLinkage, packedName, llvmModule);
+
+  // Each element of the array points at the value of an argument.
+  builder.SetInsertPoint(
+      llvm::BasicBlock::Create(llvmContext, "entry", packed));
+  llvm::Value *packedArgs = packed->arg_begin();
+  llvm::SmallVector<llvm::Value *, 4> args;
+  for (llvm::Argument &arg : function->args()) {
+    llvm::Value *argPointer = builder.CreateLoad(
+        pointerType,
+        builder.CreateGEP(pointerType, packedArgs,
+                          builder.getInt64(arg.getArgNo())));
+    argPointer =
+        builder.CreateBitCast(argPointer, arg.getType()->getPointerTo());
+    args.push_back(builder.CreateLoad(arg.getType(), argPointer));
+  }
+  builder.CreateCall(function, args);
+  builder.CreateRetVoid();
+}
+
+Repl::Repl(mlir::MLIRContext &context, JITSession &session,
+           const CompileOptions &options, PrepareFunction prepare)
+    : context(context), session(session), prepare(std::move(prepare)),
+      pm(&context) {
+  context.getOrLoadDialect<mlir::pony::PonyDialect>();
+  mlir::registerLLVMDialectTranslation(context);
+  buildPipeline(pm, LoweringTarget::LLVM, options, this);
+}
+
+Repl::~Repl() = default;
+
+bool Repl::isComplete(llvm::StringRef input) {
+  int depth = 0;
+  llvm::StringRef last;
+  llvm::SmallVector<llvm::StringRef, 8> lines;
+  input.split(lines, '\n');
+  for (llvm::StringRef line : lines) {
+    line = line.take_until([](char c) { return c == '#'; }).trim();
+    depth += line.count('{') - line.count('}');
+    if (!line.empty())
+      last = line;
+  }
+  return last.empty() ||
+         (depth <= 0 && (last.endswith(";") || last.endswith("}")));
+}
+
+bool Repl::evaluate(llvm::StringRef input) {
+  if (input.trim().empty())
+    return true;
+
+  // Statements are parsed as the body of a function. The lexer expects the
+  // buffer to be nul terminated.
+  bool isDefinition = input.ltrim().startswith("def");
+  std::string source =
+      isDefinition ? input.str() : "def statement() { " + input.str() + "\n}";
+  LexerBuffer lexer(source.c_str(), source.c_str() + source.size(), "<repl>");
+  lexer.setEchoTokens(false);
+  Parser parser(lexer);
+  std::unique_ptr<ModuleAST> moduleAST = parser.parseModule();
+  if (!moduleAST)
+    return false;
+  if (isDefinition)
+    return define(std::move(moduleAST));
+  return run(*moduleAST->begin());
+}
+
+bool Repl::define(std::unique_ptr<ModuleAST> moduleAST) {
+  // Code compiled for the current definition of a function is linked into the
+  // session for good, it can't be replaced.
+  llvm::StringSet<> names;
+  for (FunctionAST &function : *moduleAST) {
+    llvm::StringRef name = function.getProto()->getName();
+    if (name == "main" || functions.count(name) ||
+        !names.insert(name).second) {
+      llvm::errs() << "Function '" << name << "' is already defined\n";
+      return false;
+    }
+  }
+
+  // Report the errors in the definitions now rather than when they are used.
+  mlir::OwningOpRef<mlir::ModuleOp> module(
+      mlir::ModuleOp::create(mlir::UnknownLoc::get(&context)));
+  for (FunctionAST &function : *moduleAST)
+    if (mlir::failed(mlirGen(*module, function)))
+      return false;
+
+  for (FunctionAST &function : *moduleAST)
+    functions[function.getProto()->getName()] = &function;
+  definitions.push_back(std::move(moduleAST));
+  return true;
+}
+
+bool Repl::run(FunctionAST &wrapper) {
+  ExprASTList &body = *wrapper.getBody();
+  if (body.size() != 1) {
+    llvm::errs() << "Enter one statement at a time\n";
+    return false;
+  }
+  std::unique_ptr<ExprAST> statement = std::move(body.front());
+  Location location = statement->loc();
+  if (llvm::isa<ReturnExprAST>(*statement)) {
+    llvm::errs() << "'return' is only allowed within functions\n";
+    return false;
+  }
+
+  // The live variables the statement reads are the arguments of its function.
+  llvm::SetVector<llvm::StringRef> names;
+  collectVariables(*statement, names);
+  std::vector<std::unique_ptr<VariableExprAST>> args;
+  std::vector<std::vector<int64_t>> argShapes;
+  llvm::SmallVector<TensorRef, 4> argValues;
+  for (llvm::StringRef name : names) {
+    auto variable = variables.find(name);
+    if (variable == variables.end())
+      continue;
+    Tensor &value = variable->second;
+    args.push_back(std::make_unique<VariableExprAST>(location, name));
+    argShapes.emplace_back(value.shape().begin(), value.shape().end());
+    argValues.push_back({value.data(), value.shape()});
+  }
+
+  // A declaration returns the value of its variable, a bare expression
+  // prints its value.
+  std::string result;
+  auto statementBody = std::make_unique<ExprASTList>();
+  if (auto *varDecl = llvm::dyn_cast<VarDeclExprAST>(statement.get())) {
+    result = varDecl->getName().str();
+    statementBody->push_back(std::move(statement));
+    std::unique_ptr<ExprAST> value =
+        std::make_unique<VariableExprAST>(location, result);
+    statementBody->push_back(
+        std::make_unique<ReturnExprAST>(location, std::move(value)));
+  } else if (llvm::isa<PrintExprAST>(*statement)) {
+    statementBody->push_back(std::move(statement));
+  } else {
+    statementBody->push_back(
+        std::make_unique<PrintExprAST>(location, std::move(statement)));
+  }
+  std::string name = "__repl_" + std::to_string(numStatements++);
+  FunctionAST function(
+      std::make_unique<PrototypeAST>(location, name, std::move(args)),
+      std::move(statementBody));
+
+  // Specialize the statement for the shapes of the live variables.
+  mlir::OwningOpRef<mlir::ModuleOp> module(
+      mlir::ModuleOp::create(mlir::UnknownLoc::get(&context)));
+  if (mlir::failed(mlirGen(*module, function)))
+    return false;
+  auto entry = module->lookupSymbol<mlir::pony::FuncOp>(name);
+  llvm::SmallVector<mlir::Type, 4> argTypes;
+  for (const auto &shape : argShapes)
+    argTypes.push_back(mlir::RankedTensorType::get(
+        shape, mlir::FloatType::getF64(&context)));
+  entry.setType(mlir::FunctionType::get(
+      &context, argTypes, entry.getFunctionType().getResults()));
+  for (auto it : llvm::zip(entry.getArguments(), argTypes))
+    std::get<0>(it).setType(std::get<1>(it));
+  entry.setPublic();
+
+  pending.clear();
+  if (mlir::failed(pm.run(*module)))
+    return false;
+  llvm::Optional<std::vector<int64_t>> resultShape;
+  if (!result.empty()) {
+    auto type = pending[name].front().cast<mlir::RankedTensorType>();
+    resultShape.emplace(type.getShape().begin(), type.getShape().end());
+  }
+
+  auto llvmContext = std::make_unique<llvm::LLVMContext>();
+  auto llvmModule = mlir::translateModuleToLLVMIR(*module, *llvmContext);
+  if (!llvmModule) {
+    llvm::errs() << "Failed to emit LLVM IR\n";
+    return false;
+  }
+  // The statements that follow call the specializations compiled here.
+  for (llvm::Function &llvmFunction : *llvmModule)
+    if (!llvmFunction.isDeclaration())
+      llvmFunction.setLinkage(llvm::GlobalValue::ExternalLinkage);
+  if (!prepare(*llvmModule))
+    return false;
+  std::string packedName = name + "_packed";
+  addPackedWrapper(*llvmModule, name, packedName);
+
+  if (llvm::Error err = session.add(llvm::orc::ThreadSafeModule(
+          std::move(llvmModule), std::move(llvmContext)))) {
+    llvm::errs() << "Failed to add the statement to the JIT: "
+                 << llvm::toString(std::move(err)) << "\n";
+    return false;
+  }
+  for (auto &specialization : pending)
+    compiled[specialization.getKey()] = specialization.getValue();
+  pending.clear();
+
+  auto packed = session.lookup(packedName);
+  if (!packed) {
+    llvm::errs() << "JIT invocation failed: "
+                 << llvm::toString(packed.takeError()) << "\n";
+    return false;
+  }
+  Function statementFunction(
+      reinterpret_cast<Function::PackedFunction>(*packed), std::move(argShapes),
+      std::move(resultShape));
+
+  flushCompilerOutput();
+  auto value = statementFunction.invoke(argValues);
+  if (!value) {
+    llvm::errs() << "JIT invocation failed: "
+                 << llvm::toString(value.takeError()) << "\n";
+    return false;
+  }
+  if (!result.empty())
+    variables[result] = std::move(*value);
+  return true;
+}
+
+mlir::pony::FuncOp Repl::getFunction(llvm::StringRef name,
+                                     mlir::ModuleOp module) {
+  if (auto function = module.lookupSymbol<mlir::pony::FuncOp>(name))
+    return function;
+  FunctionAST *functionAST = functions.lookup(name);
+  if (!functionAST || mlir::failed(mlirGen(module, *functionAST)))
+    return nullptr;
+  return module.lookupSymbol<mlir::pony::FuncOp>(name);
+}
+
+bool Repl::lookup(llvm::StringRef name, llvm::StringRef callee,
+                  llvm::SmallVectorImpl<mlir::Type> &resultTypes) {
+  auto specialization = compiled.find(name);
+  if (specialization == compiled.end())
+    return false;
+  resultTypes.append(specialization->second.begin(),
+                     specialization->second.end());
+  return true;
+}
+
+void Repl::notifySpecialized(mlir::pony::FuncOp specialization,
+                             llvm::StringRef callee) {
+  auto resultTypes = specialization.getFunctionType().getResults();
+  pending[specialization.getName()].assign(resultTypes.begin(),
+                                           resultTypes.end());
+}
@@ -0,0 +1,215 @@
+//===- CostModel.cpp - Static cost of Pony programs -----------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the cost analysis of specialized Pony modules, and the
+// pass writing their roofline report for -emit=cost.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/CostModel.h"
+#include "pony/Passes.h"
+
+#include "mlir/Pass/Pass.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace mlir;
+using namespace mlir::pony;
+
+/// Include the auto-generated definitions for the cost model interfaces.
+#include "pony/CostModelOpInterfaces.cpp.inc"
+
+//===----------------------------------------------------------------------===//
+// CostAnalysis
+//===----------------------------------------------------------------------===//
+
+CostAnalysis::CostAnalysis(Operation *module) : symbolTable(module) {
+  DenseSet<Operation *> inProgress;
+  for (pony::FuncOp function : cast<ModuleOp>(module).getOps<pony::FuncOp>())
+    computeCost(function, inProgress);
+}
+
+Optional<OpCost> CostAnalysis::getOpCost(Operation *op) {
+  if (auto model = dyn_cast<CostModel>(op))
+    return model.getCost();
+  return llvm::None;
+}
+
+void CostAnalysis::computeCost(pony::FuncOp function,
+                               DenseSet<Operation *> &inProgress) {
+  if (functionCosts.count(function) || !inProgress.insert(function).second)
+    return;
+
+  // Functions only declared, like the specializations another module of an
+  // incremental compilation has, have no body to tell their cost.
+  FunctionCost cost;
+  cost.complete = !function.isExternal();
+  function.walk([&](Operation *op) {
+    if (auto call = dyn_cast<GenericCallOp>(op)) {
+      auto callee = symbolTable.lookup<pony::FuncOp>(call.getCallee());
+      if (callee)
+        computeCost(callee, inProgress);
+      auto it = callee ? functionCosts.find(callee) : functionCosts.end();
+      if (it == functionCosts.end()) {
+        cost.complete = false;
+        return;
+      }
+      cost.call += it->second.call;
+      cost.complete &= it->second.complete;
+      return;
+    }
+    if (!isa<CostModel>(op))
+      return;
+    if (Optional<OpCost> opCost = getOpCost(op))
+      cost.local += *opCost;
+    else
+      cost.complete = false;
+  });
+  cost.call += cost.local;
+
+  inProgress.erase(function);
+  functionCosts[function] = cost;
+}
+
+OpCost CostAnalysis::getLocalCost(pony::FuncOp function) const {
+  auto it = functionCosts.find(function);
+  return it == functionCosts.end() ? OpCost() : it->second.local;
+}
+
+OpCost CostAnalysis::getCallCost(pony::FuncOp function) const {
+  auto it = functionCosts.find(function);
+  return it == functionCosts.end() ? OpCost() : it->second.call;
+}
+
+Optional<OpCost> CostAnalysis::getCallCost(StringRef name) const {
+  auto function = symbolTable.lookup<pony::FuncOp>(name);
+  if (!function)
+    return llvm::None;
+  return getCallCost(function);
+}
+
+bool CostAnalysis::isComplete(pony::FuncOp function) const {
+  auto it = functionCosts.find(function);
+  return it != functionCosts.end() && it->second.complete;
+}
+
+//===----------------------------------------------------------------------===//
+// Roofline report
+//===----------------------------------------------------------------------===//
+
+/// Return `loc` as `file:line:col`, looking through the call sites of inlined
+/// operations and the names of values, or "<unknown>".
+static std::string formatLocation(Location loc) {
+  std::string result = "<unknown>";
+  loc->walk([&](Location nested) {
+    auto fileLoc = nested.dyn_cast<FileLineColLoc>();
+    if (!fileLoc)
+      return WalkResult::advance();
+    result = (fileLoc.getFilename().getValue() + ":" +
+              Twine(fileLoc.getLine()) + ":" + Twine(fileLoc.getColumn()))
+                 .str();
+    return WalkResult::interrupt();
+  });
+  return result;
+}
+
+/// Write a row of the report for `cost`, labeled `location` and `name`.
+static void printCostRow(StringRef location, StringRef name,
+                         const OpCost &cost, const RooflineMachine &machine,
+                         raw_ostream &os) {
+  StringRef bound = "-";
+  if (cost.flops || cost.getBytes())
+    bound = cost.getArithmeticIntensity() >= machine.getRidgePoint()
+                ? "compute"
+                : "memory";
+  os << llvm::format("  %-24s %-18s %12lld %12lld %12lld %8.3f %-8s %9.2f "
+                     "%12.3f\n",
+                     location.str().c_str(), name.str().c_str(),
+                     (long long)cost.flops, (long long)cost.bytesRead,
+                     (long long)cost.bytesWritten,
+                     cost.getArithmeticIntensity(), bound.str().c_str(),
+                     machine.getAttainableGflops(cost),
+                     machine.getMinSeconds(cost) * 1e6);
+}
+
+/// Write the header of the rows of the report.
+static void printCostHeader(raw_ostream &os) {
+  os << llvm::format("  %-24s %-18s %12s %12s %12s %8s %-8s %9s %12s\n",
+                     "Location", "Operation", "FLOPs", "Read (B)",
+                     "Written (B)", "FLOP/B", "Bound", "GFLOP/s",
+                     "Time (us)");
+}
+
+void mlir::pony::printCostReport(ModuleOp module, const CostAnalysis &costs,
+                                 const RooflineMachine &machine,
+                                 raw_ostream &os) {
+  os << llvm::format("Roofline of a machine doing %.1f GFLOP/s and %.1f "
+                     "GB/s, ridge point at %.3f FLOP/B\n",
+                     machine.peakGflops, machine.peakBandwidth,
+                     machine.getRidgePoint());
+
+  for (pony::FuncOp function : module.getOps<pony::FuncOp>()) {
+    if (function.isExternal())
+      continue;
+    os << "\nFunction '" << function.getName() << "'"
+       << (costs.isComplete(function) ? "" : " (some shapes unknown)")
+       << ":\n";
+    printCostHeader(os);
+    function.walk([&](Operation *op) {
+      std::string location = formatLocation(op->getLoc());
+      if (auto call = dyn_cast<GenericCallOp>(op)) {
+        Optional<OpCost> cost = costs.getCallCost(call.getCallee());
+        printCostRow(location, ("call @" + call.getCallee()).str(),
+                     cost ? *cost : OpCost(), machine, os);
+        return;
+      }
+      if (!isa<CostModel>(op))
+        return;
+      if (Optional<OpCost> cost = CostAnalysis::getOpCost(op))
+        printCostRow(location, op->getName().getStringRef(), *cost, machine,
+                     os);
+      else
+        os << llvm::format("  %-24s %-18s %12s\n", location.c_str(),
+                           op->getName().getStringRef().str().c_str(),
+                           "(unknown shapes)");
+    });
+    printCostRow("", "body", costs.getLocalCost(function), machine, os);
+    printCostRow("", "call, with callees", costs.getCallCost(function),
+                 machine, os);
+  }
+
+  // The module does what a call of main does.
+  if (Optional<OpCost> cost = costs.getCallCost("main")) {
+    os << "\nModule, per call of 'main':\n";
+    printCostHeader(os);
+    printCostRow("", "total", *cost, machine, os);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// CostReportPass
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct CostReportPass
+    : public PassWrapper<CostReportPass, OperationPass<ModuleOp>> {
+  CostReportPass(raw_ostream &os, const RooflineMachine &machine)
+      : os(os), machine(machine) {}
+
+  void runOnOperation() final {
+    printCostReport(getOperation(), getAnalysis<CostAnalysis>(), machine, os);
+    markAllAnalysesPreserved();
+  }
+
+private:
+  raw_ostream &os;
+  RooflineMachine machine;
+};
+} // namespace
+
+std::unique_ptr<Pass>
+mlir::pony::createCostReportPass(raw_ostream &os,
+                                 const RooflineMachine &machine) {
+  return std::make_unique<CostReportPass>(os, machine);
+}
@@ -33,10 +33,13 @@ struct PonyInlinerInterface : public DialectInlinerInterface {
   // Analysis Hooks
   //===--------------------------------------------------------------------===//
 
-  /// All call operations within pony can be inlined.
+  /// Calls are inlined when the inliner pass marked them, their callee being
+  /// small enough for the copy to pay off. Larger callees are kept, and get
+  /// specialized for the shapes they are called with instead, which lets the
+  /// pass manager process them in parallel.
   bool isLegalToInline(Operation *call, Operation *callable,
                        bool wouldBeCloned) const final {
-    return true;
+    return call->hasAttr(kInlineAttrName);
   }
 
   /// All operations within pony can be inlined.
@@ -146,6 +149,29 @@ static void printBinaryOp(mlir::OpAsmPrinter &printer, mlir::Operation *op) {
   printer.printFunctionalType(op->getOperandTypes(), op->getResultTypes());
 }
 
+/// Return the size of the f64 elements of `type`, or None unless it is a
+/// statically shaped tensor or memref.
+static llvm::Optional<int64_t> getStaticBytes(Type type) {
+  auto shapedType = type.dyn_cast<ShapedType>();
+  if (!shapedType || !shapedType.hasStaticShape())
+    return llvm::None;
+  return shapedType.getNumElements() * (int64_t)sizeof(double);
+}
+
+/// Return the cost of the element-wise operation `op`, doing one
+/// floating-point operation per element of its result, or None unless its
+/// shapes are static.
+static llvm::Optional<OpCost> getElementwiseCost(mlir::Operation *op) {
+  auto bytes = getStaticBytes(op->getResult(0).getType());
+  if (!bytes)
+    return llvm::None;
+  OpCost cost;
+  cost.flops = *bytes / (int64_t)sizeof(double);
+  cost.bytesRead = op->getNumOperands() * *bytes;
+  cost.bytesWritten = *bytes;
+  return cost;
+}
+
 //===----------------------------------------------------------------------===//
 // ConstantOp
 //===----------------------------------------------------------------------===//
@@ -216,6 +242,17 @@ mlir::LogicalResult ConstantOp::verify() {
   return mlir::success();
 }
 
+/// Return the cost of the ConstantOp, which writes every element of the
+/// constant into its buffer. This is required by the cost model interface.
+llvm::Optional<OpCost> ConstantOp::getCost() {
+  auto bytes = getStaticBytes(getType());
+  if (!bytes)
+    return llvm::None;
+  OpCost cost;
+  cost.bytesWritten = *bytes;
+  return cost;
+}
+
 //===----------------------------------------------------------------------===//
 // AddOp
 //===----------------------------------------------------------------------===//
@@ -237,6 +274,9 @@ void AddOp::print(mlir::OpAsmPrinter &p) { printBinaryOp(p, *this); }
 /// interface.
 void AddOp::inferShapes() { getResult().setType(getOperand(0).getType()); }
 
+/// Return the cost of the AddOp, this is required by the cost model interface.
+llvm::Optional<OpCost> AddOp::getCost() { return getElementwiseCost(*this); }
+
 //===----------------------------------------------------------------------===//
 // CastOp
 //===----------------------------------------------------------------------===//
@@ -245,6 +285,10 @@ void AddOp::inferShapes() { getResult().setType(getOperand(0).getType()); }
 /// inference interface.
 void CastOp::inferShapes() { getResult().setType(getOperand().getType()); }
 
+/// Return the cost of the CastOp, this is required by the cost model interface.
+/// The result is the operand itself, the cast costs nothing.
+llvm::Optional<OpCost> CastOp::getCost() { return OpCost(); }
+
 /// Returns true if the given set of input and result types are compatible with
 /// this cast operation. This is required by the `CastOpInterface` to verify
 /// this operation and provide other additional utilities.
@@ -294,7 +338,9 @@ void FuncOp::print(mlir::OpAsmPrinter &p) {
 }
 
 /// Returns the region on the function operation that is callable.
-mlir::Region *FuncOp::getCallableRegion() { return &getBody(); }
+mlir::Region *FuncOp::getCallableRegion() {
+  return isExternal() ? nullptr : &getBody();
+}
 
 /// Returns the results types that the callable region produces when
 /// executed.
@@ -346,6 +392,9 @@ void MulOp::print(mlir::OpAsmPrinter &p) { printBinaryOp(p, *this); }
 /// interface.
 void MulOp::inferShapes() { getResult().setType(getOperand(0).getType()); }
 
+/// Return the cost of the MulOp, this is required by the cost model interface.
+llvm::Optional<OpCost> MulOp::getCost() { return getElementwiseCost(*this); }
+
 //===----------------------------------------------------------------------===//
 // GemmOp
 //===----------------------------------------------------------------------===//
@@ -377,6 +426,47 @@ void GemmOp::inferShapes() {
 
 }
 
+/// Return the cost of the GemmOp, a multiply and an add for each of the M x N
+/// x K steps of its loop nest, reading both operands and writing the result
+/// once each. This is required by the cost model interface.
+llvm::Optional<OpCost> GemmOp::getCost() {
+  auto lhsType = getLhs().getType().dyn_cast<ShapedType>();
+  auto lhsBytes = getStaticBytes(getLhs().getType());
+  auto rhsBytes = getStaticBytes(getRhs().getType());
+  auto resultBytes = getStaticBytes(getType());
+  if (!lhsBytes || !rhsBytes || !resultBytes || lhsType.getRank() != 2)
+    return llvm::None;
+  OpCost cost;
+  cost.flops = 2 * (*resultBytes / (int64_t)sizeof(double)) *
+               lhsType.getDimSize(1);
+  cost.bytesRead = *lhsBytes + *rhsBytes;
+  cost.bytesWritten = *resultBytes;
+  return cost;
+}
+
+//===----------------------------------------------------------------------===//
+// PrintOp
+//===----------------------------------------------------------------------===//
+
+/// Return the cost of the PrintOp, which reads every element of its input.
+/// This is required by the cost model interface.
+llvm::Optional<OpCost> PrintOp::getCost() {
+  auto bytes = getStaticBytes(getInput().getType());
+  if (!bytes)
+    return llvm::None;
+  OpCost cost;
+  cost.bytesRead = *bytes;
+  return cost;
+}
+
+//===----------------------------------------------------------------------===//
+// ReshapeOp
+//===----------------------------------------------------------------------===//
+
+/// Return the cost of the ReshapeOp, this is required by the cost model
+/// interface. Buffers are contiguous, the result is a view of the operand.
+llvm::Optional<OpCost> ReshapeOp::getCost() { return OpCost(); }
+
 //===----------------------------------------------------------------------===//
 // ReturnOp
 //===----------------------------------------------------------------------===//
@@ -430,6 +520,18 @@ void TransposeOp::inferShapes() {
   getResult().setType(RankedTensorType::get(dims, arrayTy.getElementType()));
 }
 
+/// Return the cost of the TransposeOp, which reads and writes every element
+/// once. This is required by the cost model interface.
+llvm::Optional<OpCost> TransposeOp::getCost() {
+  auto bytes = getStaticBytes(getType());
+  if (!bytes)
+    return llvm::None;
+  OpCost cost;
+  cost.bytesRead = *bytes;
+  cost.bytesWritten = *bytes;
+  return cost;
+}
+
 mlir::LogicalResult TransposeOp::verify() {
   auto inputType = getOperand().getType().dyn_cast<RankedTensorType>();
   auto resultType = getType().dyn_cast<RankedTensorType>();
@@ -0,0 +1,186 @@
+//===- Evaluator.cpp - In-process evaluation of Pony operations -----------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the evaluation of Pony operations on concrete tensors.
+// The kernels follow exactly the loop nests emitted by the affine lowering so
+// that evaluated results are bit-identical to the compiled ones.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Evaluator.h"
+#include "pony/Dialect.h"
+#include "pony/Runtime.h"
+
+#include "llvm/ADT/TypeSwitch.h"
+
+#include <functional>
+#include <numeric>
+
+using namespace mlir;
+using namespace mlir::pony;
+
+/// Return the number of elements of a tensor with the given shape.
+static int64_t getNumElements(ArrayRef<int64_t> shape) {
+  return std::accumulate(shape.begin(), shape.end(), int64_t(1),
+                         std::multiplies<int64_t>());
+}
+
+/// Apply `fn` element-wise to two tensors of identical shape. `fn` is inlined
+/// into a loop over plain arrays, which the host compiler vectorizes.
+template <typename Fn>
+static LogicalResult evaluateBinary(ArrayRef<const TensorValue *> operands,
+                                    TensorValue &result, Fn fn) {
+  const TensorValue &lhs = *operands[0], &rhs = *operands[1];
+  if (lhs.shape != rhs.shape)
+    return failure();
+
+  result.shape = lhs.shape;
+  result.data.resize(lhs.data.size());
+  const double *lhsData = lhs.data.data(), *rhsData = rhs.data.data();
+  double *resultData = result.data.data();
+  for (size_t i = 0, e = lhs.data.size(); i != e; ++i)
+    resultData[i] = fn(lhsData[i], rhsData[i]);
+  return success();
+}
+
+/// Reverse the dimensions of the input, the same as `pony.transpose`.
+static LogicalResult evaluateTranspose(const TensorValue &input,
+                                       TensorValue &result) {
+  int64_t rank = input.shape.size();
+  result.shape.assign(input.shape.rbegin(), input.shape.rend());
+  result.data.resize(input.data.size());
+
+  // Element (i0, ..., in) of the input lands at (in, ..., i0) of the result,
+  // so walk the input in order and step through the result with the reversed
+  // strides.
+  SmallVector<int64_t, 4> resultStrides(rank, 1);
+  for (int64_t i = rank - 2; i >= 0; --i)
+    resultStrides[i] = resultStrides[i + 1] * result.shape[i + 1];
+
+  SmallVector<int64_t, 4> index(rank, 0);
+  int64_t resultOffset = 0;
+  for (double element : input.data) {
+    result.data[resultOffset] = element;
+    // Increment the multi-dimensional input index, keeping the result offset
+    // in sync.
+    for (int64_t dim = rank - 1; dim >= 0; --dim) {
+      int64_t stride = resultStrides[rank - 1 - dim];
+      resultOffset += stride;
+      if (++index[dim] != input.shape[dim])
+        break;
+      resultOffset -= stride * index[dim];
+      index[dim] = 0;
+    }
+  }
+  return success();
+}
+
+/// Multiply `lhs` (MxK) with `rhs` (NxK) into an MxN result. As in the affine
+/// lowering, the right-hand side is indexed by (column, k).
+static LogicalResult evaluateGemm(const TensorValue &lhs,
+                                  const TensorValue &rhs,
+                                  TensorValue &result) {
+  if (lhs.shape.size() != 2 || rhs.shape.size() != 2 ||
+      lhs.shape[1] != rhs.shape[1])
+    return failure();
+
+  int64_t m = lhs.shape[0], n = rhs.shape[0], k = lhs.shape[1];
+  result.shape = {m, n};
+  result.data.assign(m * n, 0.0);
+  for (int64_t i = 0; i != m; ++i) {
+    const double *lhsRow = &lhs.data[i * k];
+    for (int64_t j = 0; j != n; ++j) {
+      const double *rhsRow = &rhs.data[j * k];
+      // Accumulate in the same order as the generated loop nest.
+      double sum = 0.0;
+      for (int64_t x = 0; x != k; ++x)
+        sum = sum + lhsRow[x] * rhsRow[x];
+      result.data[i * n + j] = sum;
+    }
+  }
+  return success();
+}
+
+LogicalResult mlir::pony::evaluateOp(Operation *op,
+                                     ArrayRef<const TensorValue *> operands,
+                                     TensorValue &result) {
+  return llvm::TypeSwitch<Operation *, LogicalResult>(op)
+      .Case<ConstantOp>([&](ConstantOp op) {
+        DenseElementsAttr value = op.getValue();
+        auto shape = value.getType().getShape();
+        result.shape.assign(shape.begin(), shape.end());
+        result.data.clear();
+        result.data.reserve(getNumElements(shape));
+        for (double element : value.getValues<double>())
+          result.data.push_back(element);
+        return success();
+      })
+      .Case<AddOp>([&](AddOp) {
+        return evaluateBinary(operands, result,
+                              [](double lhs, double rhs) { return lhs + rhs; });
+      })
+      .Case<MulOp>([&](MulOp) {
+        return evaluateBinary(operands, result,
+                              [](double lhs, double rhs) { return lhs * rhs; });
+      })
+      .Case<GemmOp>([&](GemmOp) {
+        return evaluateGemm(*operands[0], *operands[1], result);
+      })
+      .Case<TransposeOp>([&](TransposeOp) {
+        return evaluateTranspose(*operands[0], result);
+      })
+      .Case<ReshapeOp>([&](ReshapeOp op) {
+        auto shape = op.getType().cast<RankedTensorType>().getShape();
+        if (getNumElements(shape) != (int64_t)operands[0]->data.size())
+          return failure();
+        result.shape.assign(shape.begin(), shape.end());
+        result.data = operands[0]->data;
+        return success();
+      })
+      .Case<CastOp>([&](CastOp) {
+        result = *operands[0];
+        return success();
+      })
+      .Default([](Operation *) { return failure(); });
+}
+
+uint64_t mlir::pony::estimateWork(Operation *op,
+                                  ArrayRef<const TensorValue *> operands) {
+  if (auto constant = dyn_cast<ConstantOp>(op))
+    return constant.getValue().getNumElements();
+  if (isa<GemmOp>(op)) {
+    const TensorValue &lhs = *operands[0], &rhs = *operands[1];
+    if (lhs.shape.size() != 2 || rhs.shape.size() != 2)
+      return 0;
+    return uint64_t(lhs.shape[0]) * rhs.shape[0] * lhs.shape[1];
+  }
+  uint64_t work = 0;
+  for (const TensorValue *operand : operands)
+    work = std::max<uint64_t>(work, operand->data.size());
+  return work;
+}
+
+/// Recursively walk the dimensions of `value`, mirroring the layout produced
+/// by `pony_print_memref`.
+static void renderDimension(const TensorValue &value, size_t dim,
+                            const double *&element, std::string &out) {
+  if (dim == value.shape.size()) {
+    char buffer[kFormatF64MaxLength + 1];
+    size_t length = pony_format_f64(*element++, buffer);
+    buffer[length++] = ' ';
+    out.append(buffer, length);
+    return;
+  }
+
+  for (int64_t i = 0, e = value.shape[dim]; i != e; ++i) {
+    renderDimension(value, dim + 1, element, out);
+    if (dim != value.shape.size() - 1)
+      out.push_back('\n');
+  }
+}
+
+void mlir::pony::renderTensor(const TensorValue &value, std::string &out) {
+  const double *element = value.data.data();
+  renderDimension(value, /*dim=*/0, element, out);
+}
@@ -0,0 +1,474 @@
+//===- FastCodegen.cpp - Direct translation of Pony to LLVM IR ------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the fast back end of the compiler. Each operation of a
+// specialized Pony function becomes one loop nest over heap buffers, the same
+// loops the affine lowering emits before any optimization, or one call into
+// the runtime:
+//
+//   pony.constant         --> private global, never written to
+//   pony.add / pony.mul   --> one loop over the elements
+//   pony.transpose        --> loop nest over the input
+//   pony.gemm             --> (m, n, k) loop nest accumulating in the result
+//   pony.reshape / cast   --> the operand's buffer, as is
+//   pony.generic_call     --> call returning a buffer the caller owns
+//   pony.print            --> call to pony_print_memref
+//   pony.print_string     --> call to pony_print_string
+//
+// Every buffer a function allocates or gets from a call is freed when it
+// returns, except the one it returns. Returning anything else, an argument or
+// a constant, copies it first.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/FastCodegen.h"
+#include "pony/Dialect.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include <functional>
+#include <numeric>
+
+using namespace mlir;
+using namespace mlir::pony;
+
+/// Return the number of elements of a tensor with the given shape.
+static int64_t getNumElements(ArrayRef<int64_t> shape) {
+  return std::accumulate(shape.begin(), shape.end(), int64_t(1),
+                         std::multiplies<int64_t>());
+}
+
+/// Return the row-major strides of a tensor with the given shape.
+static SmallVector<int64_t, 4> getStrides(ArrayRef<int64_t> shape) {
+  SmallVector<int64_t, 4> strides(shape.size(), 1);
+  for (int64_t i = (int64_t)shape.size() - 2; i >= 0; --i)
+    strides[i] = strides[i + 1] * shape[i + 1];
+  return strides;
+}
+
+/// Return the static shape of the tensor `value`.
+static ArrayRef<int64_t> getShape(Value value) {
+  return value.getType().cast<RankedTensorType>().getShape();
+}
+
+/// Return whether every tensor `function` takes, returns or computes has a
+/// static shape.
+static bool hasStaticShapes(pony::FuncOp function) {
+  auto isStatic = [](Type type) {
+    auto tensorType = type.dyn_cast<RankedTensorType>();
+    return tensorType && tensorType.hasStaticShape();
+  };
+  FunctionType type = function.getFunctionType();
+  if (!llvm::all_of(type.getInputs(), isStatic) ||
+      !llvm::all_of(type.getResults(), isStatic))
+    return false;
+  return !function
+              .walk([&](Operation *op) {
+                return llvm::all_of(op->getResultTypes(), isStatic)
+                           ? WalkResult::advance()
+                           : WalkResult::interrupt();
+              })
+              .wasInterrupted();
+}
+
+namespace {
+/// Translates a specialized Pony module to LLVM IR, one function at a time.
+class FastCodegen {
+public:
+  FastCodegen(ModuleOp module, llvm::LLVMContext &llvmContext)
+      : module(module), llvmContext(llvmContext),
+        llvmModule(std::make_unique<llvm::Module>("pony", llvmContext)),
+        builder(llvmContext) {}
+
+  std::unique_ptr<llvm::Module> translate();
+
+private:
+  /// Declare the LLVM function `function` translates to.
+  void declareFunction(pony::FuncOp function);
+
+  /// Translate the body of `function`.
+  LogicalResult translateFunction(pony::FuncOp function);
+
+  /// Translate `op`, one of the operations of the function being translated.
+  LogicalResult translateOperation(Operation &op);
+
+  /// Translate the return of `value`, or of nothing if it is null.
+  void translateReturn(Value value);
+
+  /// Return the runtime or libc function `name` of the given type, declaring
+  /// it if needed.
+  llvm::FunctionCallee getFunction(StringRef name, llvm::Type *result,
+                                   ArrayRef<llvm::Type *> params);
+
+  /// Allocate a buffer of `numElements` f64, freed when the function returns.
+  llvm::Value *allocate(int64_t numElements);
+
+  /// Return a pointer to element `index` of `buffer`.
+  llvm::Value *getElement(llvm::Value *buffer, llvm::Value *index);
+
+  /// Return a pointer to the first element of a private constant array.
+  llvm::Value *getGlobalArray(llvm::Constant *init, StringRef name);
+
+  /// Emit a loop running `body` for every index from 0 to `count` - 1, and
+  /// leave the builder after it.
+  void emitLoop(int64_t count, function_ref<void(llvm::Value *)> body);
+
+  /// Emit the loop nest running `body` for every index into `shape`, in
+  /// row-major order.
+  void emitLoopNest(ArrayRef<int64_t> shape,
+                    function_ref<void(ArrayRef<llvm::Value *>)> body);
+  void emitLoopNest(ArrayRef<int64_t> shape,
+                    SmallVectorImpl<llvm::Value *> &indices,
+                    function_ref<void(ArrayRef<llvm::Value *>)> body);
+
+  /// Return the offset of the element at `indices` with the given strides.
+  llvm::Value *emitOffset(ArrayRef<llvm::Value *> indices,
+                          ArrayRef<int64_t> strides);
+
+  llvm::Value *emitBinary(
+      Value lhs, Value rhs,
+      function_ref<llvm::Value *(llvm::Value *, llvm::Value *)> combine);
+  llvm::Value *emitTranspose(Value input);
+  llvm::Value *emitGemm(Value lhs, Value rhs);
+  void emitPrint(Value input);
+  void emitPrintString(StringRef value);
+
+  ModuleOp module;
+  llvm::LLVMContext &llvmContext;
+  std::unique_ptr<llvm::Module> llvmModule;
+  llvm::IRBuilder<> builder;
+  llvm::Type *f64PtrTy = builder.getDoubleTy()->getPointerTo();
+
+  /// The buffer of every value of the function being translated, and the
+  /// buffers it has to free.
+  llvm::DenseMap<Value, llvm::Value *> buffers;
+  llvm::SetVector<llvm::Value *> ownedBuffers;
+};
+} // namespace
+
+std::unique_ptr<llvm::Module> FastCodegen::translate() {
+  // Declare everything first, calls may come before their callee.
+  auto functions = module.getOps<pony::FuncOp>();
+  for (pony::FuncOp function : functions) {
+    if (!hasStaticShapes(function)) {
+      function.emitError("the fast back end needs every shape to be static");
+      return nullptr;
+    }
+    declareFunction(function);
+  }
+  for (pony::FuncOp function : functions)
+    if (!function.isExternal() && failed(translateFunction(function)))
+      return nullptr;
+  return std::move(llvmModule);
+}
+
+void FastCodegen::declareFunction(pony::FuncOp function) {
+  FunctionType type = function.getFunctionType();
+  SmallVector<llvm::Type *, 4> params(type.getNumInputs(), f64PtrTy);
+  llvm::Type *result =
+      type.getNumResults() ? f64PtrTy : builder.getVoidTy();
+  llvm::Function::Create(
+      llvm::FunctionType::get(result, params, /*isVarArg=*/false),
+      function.isPrivate() ? llvm::GlobalValue::InternalLinkage
+                           : llvm::GlobalValue::ExternalLinkage,
+      function.getName(), *llvmModule);
+}
+
+LogicalResult FastCodegen::translateFunction(pony::FuncOp function) {
+  llvm::Function *llvmFunction = llvmModule->getFunction(function.getName());
+  builder.SetInsertPoint(
+      llvm::BasicBlock::Create(llvmContext, "entry", llvmFunction));
+
+  buffers.clear();
+  ownedBuffers.clear();
+  for (auto it : llvm::zip(function.getArguments(), llvmFunction->args()))
+    buffers[std::get<0>(it)] = &std::get<1>(it);
+
+  for (Operation &op : function.getBody().front())
+    if (failed(translateOperation(op)))
+      return failure();
+  return success();
+}
+
+LogicalResult FastCodegen::translateOperation(Operation &op) {
+  llvm::Value *result = nullptr;
+  if (auto constant = dyn_cast<ConstantOp>(op)) {
+    auto values = constant.getValue().getValues<double>();
+    SmallVector<double, 16> data(values.begin(), values.end());
+    result = getGlobalArray(
+        llvm::ConstantDataArray::get(llvmContext, makeArrayRef(data)),
+        "pony_cst");
+  } else if (auto add = dyn_cast<AddOp>(op)) {
+    result = emitBinary(add.getLhs(), add.getRhs(),
+                        [&](llvm::Value *lhs, llvm::Value *rhs) {
+                          return builder.CreateFAdd(lhs, rhs);
+                        });
+  } else if (auto mul = dyn_cast<MulOp>(op)) {
+    result = emitBinary(mul.getLhs(), mul.getRhs(),
+                        [&](llvm::Value *lhs, llvm::Value *rhs) {
+                          return builder.CreateFMul(lhs, rhs);
+                        });
+  } else if (auto transpose = dyn_cast<TransposeOp>(op)) {
+    result = emitTranspose(transpose.getInput());
+  } else if (auto gemm = dyn_cast<GemmOp>(op)) {
+    result = emitGemm(gemm.getLhs(), gemm.getRhs());
+  } else if (isa<ReshapeOp, CastOp>(op)) {
+    // The shape is only in the types, the buffer stays the same.
+    result = buffers.lookup(op.getOperand(0));
+  } else if (auto call = dyn_cast<GenericCallOp>(op)) {
+    llvm::Function *callee = llvmModule->getFunction(call.getCallee());
+    if (!callee)
+      return call.emitError("call to unknown function '")
+             << call.getCallee() << "'";
+    SmallVector<llvm::Value *, 4> args;
+    for (Value operand : call.getOperands())
+      args.push_back(buffers.lookup(operand));
+    result = builder.CreateCall(callee, args);
+    if (callee->getReturnType()->isVoidTy())
+      result = llvm::ConstantPointerNull::get(
+          llvm::cast<llvm::PointerType>(f64PtrTy));
+    else
+      ownedBuffers.insert(result);
+  } else if (isa<PrintOp>(op)) {
+    emitPrint(op.getOperand(0));
+    return success();
+  } else if (auto printString = dyn_cast<PrintStringOp>(op)) {
+    emitPrintString(printString.getValue());
+    return success();
+  } else if (isa<ReturnOp>(op)) {
+    translateReturn(op.getNumOperands() ? op.getOperand(0) : Value());
+    return success();
+  } else {
+    return op.emitError("the fast back end can't translate this operation");
+  }
+  buffers[op.getResult(0)] = result;
+  return success();
+}
+
+void FastCodegen::translateReturn(Value value) {
+  llvm::Value *result = nullptr;
+  if (value) {
+    result = buffers.lookup(value);
+    // The caller frees what it gets back, so it has to be a buffer of its own.
+    if (!ownedBuffers.remove(result)) {
+      int64_t numElements = getNumElements(getShape(value));
+      llvm::Value *copy = allocate(numElements);
+      ownedBuffers.remove(copy);
+      builder.CreateMemCpy(copy, llvm::MaybeAlign(8), result,
+                           llvm::MaybeAlign(8), numElements * sizeof(double));
+      result = copy;
+    }
+  }
+
+  llvm::FunctionCallee free = getFunction("free", builder.getVoidTy(),
+                                          {builder.getInt8PtrTy()});
+  for (llvm::Value *buffer : ownedBuffers)
+    builder.CreateCall(free,
+                       builder.CreateBitCast(buffer, builder.getInt8PtrTy()));
+  if (result)
+    builder.CreateRet(result);
+  else
+    builder.CreateRetVoid();
+}
+
+llvm::FunctionCallee FastCodegen::getFunction(StringRef name,
+                                              llvm::Type *result,
+                                              ArrayRef<llvm::Type *> params) {
+  return llvmModule->getOrInsertFunction(
+      name, llvm::FunctionType::get(result, params, /*isVarArg=*/false));
+}
+
+llvm::Value *FastCodegen::allocate(int64_t numElements) {
+  llvm::FunctionCallee malloc = getFunction(
+      "malloc", builder.getInt8PtrTy(), {builder.getInt64Ty()});
+  llvm::Value *buffer = builder.CreateBitCast(
+      builder.CreateCall(malloc,
+                         builder.getInt64(numElements * sizeof(double))),
+      f64PtrTy);
+  ownedBuffers.insert(buffer);
+  return buffer;
+}
+
+llvm::Value *FastCodegen::getElement(llvm::Value *buffer,
+                                     llvm::Value *index) {
+  return builder.CreateInBoundsGEP(builder.getDoubleTy(), buffer, index);
+}
+
+llvm::Value *FastCodegen::getGlobalArray(llvm::Constant *init,
+                                         StringRef name) {
+  auto *global = new llvm::GlobalVariable(
+      *llvmModule, init->getType(), /*isConstant=*/true,
+      llvm::GlobalValue::PrivateLinkage, init, name);
+  global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  return builder.CreateConstInBoundsGEP2_64(init->getType(), global, 0, 0);
+}
+
+void FastCodegen::emitLoop(int64_t count,
+                           function_ref<void(llvm::Value *)> body) {
+  if (count == 0)
+    return;
+
+  // The trip count is known not to be zero, test it at the end only.
+  llvm::BasicBlock *preheader = builder.GetInsertBlock();
+  llvm::Function *function = preheader->getParent();
+  auto *header = llvm::BasicBlock::Create(llvmContext, "loop", function);
+  auto *exit = llvm::BasicBlock::Create(llvmContext, "loop.exit", function);
+  builder.CreateBr(header);
+
+  builder.SetInsertPoint(header);
+  llvm::PHINode *index = builder.CreatePHI(builder.getInt64Ty(), 2, "i");
+  index->addIncoming(builder.getInt64(0), preheader);
+  body(index);
+  llvm::Value *next = builder.CreateAdd(index, builder.getInt64(1), "",
+                                        /*HasNUW=*/true, /*HasNSW=*/true);
+  index->addIncoming(next, builder.GetInsertBlock());
+  builder.CreateCondBr(builder.CreateICmpULT(next, builder.getInt64(count)),
+                       header, exit);
+  builder.SetInsertPoint(exit);
+}
+
+void FastCodegen::emitLoopNest(
+    ArrayRef<int64_t> shape,
+    function_ref<void(ArrayRef<llvm::Value *>)> body) {
+  SmallVector<llvm::Value *, 4> indices;
+  emitLoopNest(shape, indices, body);
+}
+
+void FastCodegen::emitLoopNest(
+    ArrayRef<int64_t> shape, SmallVectorImpl<llvm::Value *> &indices,
+    function_ref<void(ArrayRef<llvm::Value *>)> body) {
+  if (indices.size() == shape.size())
+    return body(indices);
+  emitLoop(shape[indices.size()], [&](llvm::Value *index) {
+    indices.push_back(index);
+    emitLoopNest(shape, indices, body);
+    indices.pop_back();
+  });
+}
+
+llvm::Value *FastCodegen::emitOffset(ArrayRef<llvm::Value *> indices,
+                                     ArrayRef<int64_t> strides) {
+  llvm::Value *offset = builder.getInt64(0);
+  for (auto it : llvm::zip(indices, strides))
+    offset = builder.CreateAdd(
+        offset, builder.CreateMul(std::get<0>(it),
+                                  builder.getInt64(std::get<1>(it))));
+  return offset;
+}
+
+llvm::Value *FastCodegen::emitBinary(
+    Value lhs, Value rhs,
+    function_ref<llvm::Value *(llvm::Value *, llvm::Value *)> combine) {
+  // Both operands have the shape of the result, walk them as flat arrays.
+  int64_t numElements = getNumElements(getShape(lhs));
+  llvm::Value *lhsBuffer = buffers.lookup(lhs);
+  llvm::Value *rhsBuffer = buffers.lookup(rhs);
+  llvm::Value *result = allocate(numElements);
+  emitLoop(numElements, [&](llvm::Value *index) {
+    llvm::Type *f64Ty = builder.getDoubleTy();
+    llvm::Value *lhsElement =
+        builder.CreateLoad(f64Ty, getElement(lhsBuffer, index));
+    llvm::Value *rhsElement =
+        builder.CreateLoad(f64Ty, getElement(rhsBuffer, index));
+    builder.CreateStore(combine(lhsElement, rhsElement),
+                        getElement(result, index));
+  });
+  return result;
+}
+
+llvm::Value *FastCodegen::emitTranspose(Value input) {
+  ArrayRef<int64_t> shape = getShape(input);
+  SmallVector<int64_t, 4> resultShape(shape.rbegin(), shape.rend());
+  SmallVector<int64_t, 4> strides = getStrides(shape);
+  SmallVector<int64_t, 4> resultStrides = getStrides(resultShape);
+
+  // Element (i0, ..., in) of the input lands at (in, ..., i0) of the result.
+  llvm::Value *inputBuffer = buffers.lookup(input);
+  llvm::Value *result = allocate(getNumElements(shape));
+  emitLoopNest(shape, [&](ArrayRef<llvm::Value *> indices) {
+    SmallVector<llvm::Value *, 4> resultIndices(indices.rbegin(),
+                                                indices.rend());
+    llvm::Value *element = builder.CreateLoad(
+        builder.getDoubleTy(),
+        getElement(inputBuffer, emitOffset(indices, strides)));
+    builder.CreateStore(
+        element,
+        getElement(result, emitOffset(resultIndices, resultStrides)));
+  });
+  return result;
+}
+
+llvm::Value *FastCodegen::emitGemm(Value lhs, Value rhs) {
+  // Multiply `lhs` (MxK) with `rhs` (NxK), indexed by (column, k) as in the
+  // affine lowering, and accumulate in the same order.
+  int64_t m = getShape(lhs)[0], n = getShape(rhs)[0], k = getShape(lhs)[1];
+  llvm::Value *lhsBuffer = buffers.lookup(lhs);
+  llvm::Value *rhsBuffer = buffers.lookup(rhs);
+  llvm::Value *result = allocate(m * n);
+  llvm::Type *f64Ty = builder.getDoubleTy();
+  emitLoopNest({m, n}, [&](ArrayRef<llvm::Value *> indices) {
+    llvm::Value *resultElement =
+        getElement(result, emitOffset(indices, {n, 1}));
+    builder.CreateStore(llvm::ConstantFP::get(f64Ty, 0.0), resultElement);
+    emitLoop(k, [&](llvm::Value *x) {
+      llvm::Value *lhsElement = builder.CreateLoad(
+          f64Ty, getElement(lhsBuffer, emitOffset({indices[0], x}, {k, 1})));
+      llvm::Value *rhsElement = builder.CreateLoad(
+          f64Ty, getElement(rhsBuffer, emitOffset({indices[1], x}, {k, 1})));
+      llvm::Value *sum = builder.CreateLoad(f64Ty, resultElement);
+      builder.CreateStore(
+          builder.CreateFAdd(sum, builder.CreateFMul(lhsElement, rhsElement)),
+          resultElement);
+    });
+  });
+  return result;
+}
+
+void FastCodegen::emitPrint(Value input) {
+  ArrayRef<int64_t> shape = getShape(input);
+  llvm::Type *i64PtrTy = builder.getInt64Ty()->getPointerTo();
+  llvm::Value *sizes = llvm::ConstantPointerNull::get(
+      llvm::cast<llvm::PointerType>(i64PtrTy));
+  llvm::Value *strides = sizes;
+  if (!shape.empty()) {
+    SmallVector<uint64_t, 4> sizeValues(shape.begin(), shape.end());
+    SmallVector<uint64_t, 4> strideValues;
+    for (int64_t stride : getStrides(shape))
+      strideValues.push_back(stride);
+    sizes = getGlobalArray(
+        llvm::ConstantDataArray::get(llvmContext, makeArrayRef(sizeValues)),
+        "pony_sizes");
+    strides = getGlobalArray(
+        llvm::ConstantDataArray::get(llvmContext, makeArrayRef(strideValues)),
+        "pony_strides");
+  }
+
+  llvm::FunctionCallee print =
+      getFunction("pony_print_memref", builder.getVoidTy(),
+                  {f64PtrTy, builder.getInt64Ty(), i64PtrTy, i64PtrTy});
+  builder.CreateCall(print, {buffers.lookup(input),
+                             builder.getInt64(shape.size()), sizes, strides});
+}
+
+void FastCodegen::emitPrintString(StringRef value) {
+  llvm::Value *data = getGlobalArray(
+      llvm::ConstantDataArray::getString(llvmContext, value,
+                                         /*AddNull=*/false),
+      "pony_str");
+  llvm::FunctionCallee print =
+      getFunction("pony_print_string", builder.getVoidTy(),
+                  {builder.getInt8PtrTy(), builder.getInt64Ty()});
+  builder.CreateCall(print, {data, builder.getInt64(value.size())});
+}
+
+std::unique_ptr<llvm::Module>
+mlir::pony::translateToLLVMIRDirectly(ModuleOp module,
+                                      llvm::LLVMContext &llvmContext) {
+  return FastCodegen(module, llvmContext).translate();
+}
@@ -0,0 +1,129 @@
+//===- FoldProgramPass.cpp - Compile-time evaluation of Pony programs -----===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a Function level pass that evaluates the constant
+// computations of a function at compile time and replaces every `pony.print`
+// whose input is fully known with a pre-rendered `pony.print_string`.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/Builders.h"
+#include "mlir/Pass/Pass.h"
+#include "pony/Dialect.h"
+#include "pony/Evaluator.h"
+#include "pony/Passes.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "fold-program"
+
+using namespace mlir;
+using namespace pony;
+
+namespace {
+/// The FoldProgramPass walks the body of a shape-inferred function in order,
+/// evaluating every operation whose operands are all known. A `pony.print` of
+/// a known value is rendered into a string; the output of consecutive folded
+/// prints is accumulated and written by a single `pony.print_string`, so a
+/// fully constant function ends up writing its whole output at once. The pass
+/// stops folding prints once the rendered output of the function would exceed
+/// `maxOutputBytes`, leaving them to be computed at runtime, and stops
+/// evaluating once the next operation would take the work done past
+/// `maxWork`, leaving the rest of the function as it is. Computations that are
+/// no longer used are left for the canonicalizer to clean up.
+class FoldProgramPass
+    : public mlir::PassWrapper<FoldProgramPass, OperationPass<pony::FuncOp>> {
+public:
+  FoldProgramPass(size_t maxOutputBytes, uint64_t maxWork)
+      : maxOutputBytes(maxOutputBytes), maxWork(maxWork) {}
+
+  void runOnOperation() override {
+    auto f = getOperation();
+    if (f.isExternal())
+      return;
+    Block &body = f.getBody().front();
+    llvm::DenseMap<Value, TensorValue> values;
+    size_t foldedBytes = 0;
+    uint64_t work = 0;
+
+    // The output of the folded prints since the last print or call that
+    // stays, written at the location of the first of them once the run ends.
+    std::string pendingOutput;
+    Optional<Location> pendingLoc;
+    auto flushBefore = [&](Operation *op) {
+      if (!pendingLoc)
+        return;
+      OpBuilder builder(op);
+      builder.create<PrintStringOp>(*pendingLoc, pendingOutput);
+      pendingOutput.clear();
+      pendingLoc = llvm::None;
+    };
+
+    Operation *end = body.getTerminator();
+    for (Operation &op : llvm::make_early_inc_range(body)) {
+      if (auto print = dyn_cast<PrintOp>(op)) {
+        auto it = values.find(print.getInput());
+        size_t pendingBytes = pendingOutput.size();
+        if (it != values.end())
+          renderTensor(it->second, pendingOutput);
+        size_t renderedBytes = pendingOutput.size() - pendingBytes;
+        if (it == values.end() ||
+            foldedBytes + renderedBytes > maxOutputBytes) {
+          // This print stays, later output can't be merged across it.
+          pendingOutput.resize(pendingBytes);
+          flushBefore(print);
+          continue;
+        }
+        foldedBytes += renderedBytes;
+        if (!pendingLoc)
+          pendingLoc = print.getLoc();
+        print.erase();
+        continue;
+      }
+
+      // Calls may print, so output can't be merged across them either.
+      if (isa<GenericCallOp>(op))
+        flushBefore(&op);
+
+      if (op.getNumResults() != 1)
+        continue;
+      SmallVector<const TensorValue *, 2> operands;
+      for (Value operand : op.getOperands()) {
+        auto it = values.find(operand);
+        if (it == values.end())
+          break;
+        operands.push_back(&it->second);
+      }
+      if (operands.size() != op.getNumOperands())
+        continue;
+
+      uint64_t opWork = estimateWork(&op, operands);
+      if (opWork > maxWork - work) {
+        LLVM_DEBUG(llvm::dbgs() << "Work limit reached at: " << op << "\n");
+        end = &op;
+        break;
+      }
+      work += opWork;
+
+      TensorValue result;
+      if (failed(evaluateOp(&op, operands, result))) {
+        LLVM_DEBUG(llvm::dbgs() << "Unable to evaluate: " << op << "\n");
+        continue;
+      }
+      values.try_emplace(op.getResult(0), std::move(result));
+    }
+    flushBefore(end);
+  }
+
+private:
+  size_t maxOutputBytes;
+  uint64_t maxWork;
+};
+} // namespace
+
+/// Create a pass evaluating constant Pony programs at compile time.
+std::unique_ptr<mlir::Pass>
+mlir::pony::createFoldProgramPass(size_t maxOutputBytes, uint64_t maxWork) {
+  return std::make_unique<FoldProgramPass>(maxOutputBytes, maxWork);
+}
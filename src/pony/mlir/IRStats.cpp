@@ -0,0 +1,230 @@
+//===- IRStats.cpp - Size of the IR and memory of the compiler ------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the statistics of -ir-stats and the pass
+// instrumentation recording them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/IRStats.h"
+
+#include "mlir/IR/BuiltinAttributes.h"
+#include "mlir/IR/Operation.h"
+#include "mlir/Pass/Pass.h"
+#include "mlir/Pass/PassInstrumentation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace pony;
+
+/// Return the resident memory of the process, and its peak so far in `peak`,
+/// in bytes, or 0 where unknown.
+static uint64_t getResidentBytes(uint64_t &peak) {
+  uint64_t resident = 0;
+  peak = 0;
+#ifdef __linux__
+  if (FILE *statm = std::fopen("/proc/self/statm", "r")) {
+    unsigned long long size, pages;
+    if (std::fscanf(statm, "%llu %llu", &size, &pages) == 2)
+      resident = pages * sysconf(_SC_PAGESIZE);
+    std::fclose(statm);
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    peak = uint64_t(usage.ru_maxrss) * 1024;
+#endif
+  return resident;
+}
+
+/// Add the bytes `attr` holds, and those of the attributes it is made of, to
+/// `bytes` unless `seen` has it already: attributes are uniqued in the
+/// context, so each is only held once however many operations use it.
+static void addAttributeBytes(mlir::Attribute attr,
+                              llvm::DenseSet<mlir::Attribute> &seen,
+                              uint64_t &bytes, uint64_t &denseBytes) {
+  if (!seen.insert(attr).second)
+    return;
+  if (auto dense = attr.dyn_cast<mlir::DenseIntOrFPElementsAttr>()) {
+    bytes += dense.getRawData().size();
+    denseBytes += dense.getRawData().size();
+  } else if (auto string = attr.dyn_cast<mlir::StringAttr>()) {
+    bytes += string.getValue().size();
+  } else if (auto array = attr.dyn_cast<mlir::ArrayAttr>()) {
+    for (mlir::Attribute element : array)
+      addAttributeBytes(element, seen, bytes, denseBytes);
+  } else if (auto dictionary = attr.dyn_cast<mlir::DictionaryAttr>()) {
+    for (mlir::NamedAttribute named : dictionary)
+      addAttributeBytes(named.getValue(), seen, bytes, denseBytes);
+  }
+}
+
+unsigned IRStats::beginPipeline() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return ++numPipelines;
+}
+
+void IRStats::record(unsigned pipeline, llvm::StringRef passName,
+                     mlir::Operation *module) {
+  Snapshot snapshot;
+  snapshot.pipeline = pipeline;
+  snapshot.passName = passName.str();
+
+  // Count by operation name first, it is much cheaper to hash than a string.
+  llvm::DenseMap<mlir::OperationName, uint64_t> counts;
+  llvm::DenseSet<mlir::Attribute> seen;
+  module->walk([&](mlir::Operation *op) {
+    ++counts[op->getName()];
+    for (mlir::NamedAttribute named : op->getAttrs())
+      addAttributeBytes(named.getValue(), seen, snapshot.attributeBytes,
+                        snapshot.denseBytes);
+  });
+  for (auto &it : counts) {
+    snapshot.numOperations += it.second;
+    snapshot.opCounts[it.first.getStringRef().str()] += it.second;
+    snapshot.dialectCounts[it.first.getDialectNamespace().str()] += it.second;
+  }
+  snapshot.residentBytes = getResidentBytes(snapshot.peakResidentBytes);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  snapshots.push_back(std::move(snapshot));
+}
+
+void IRStats::print(llvm::raw_ostream &os) const {
+  std::vector<Snapshot> sorted;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    sorted = snapshots;
+  }
+  // The pipelines may have run side by side, list each on its own.
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Snapshot &lhs, const Snapshot &rhs) {
+                     return lhs.pipeline < rhs.pipeline;
+                   });
+
+  auto toKB = [](uint64_t bytes) { return bytes / 1024.0; };
+  auto toMB = [](uint64_t bytes) { return bytes / (1024.0 * 1024.0); };
+  const Snapshot *previous = nullptr;
+  for (const Snapshot &snapshot : sorted) {
+    if (!previous || previous->pipeline != snapshot.pipeline) {
+      os << (previous ? "\n" : "") << "IR statistics of pipeline "
+         << snapshot.pipeline << ":\n";
+      os << llvm::format("  %-40s %10s %10s %12s %12s %10s %10s %10s\n",
+                         "Pass", "Ops", "+/- Ops", "Attrs (KB)",
+                         "Dense (KB)", "RSS (MB)", "+/- (MB)", "Peak (MB)");
+      previous = nullptr;
+    }
+    int64_t opsDelta = previous ? int64_t(snapshot.numOperations) -
+                                      int64_t(previous->numOperations)
+                                : 0;
+    double rssDelta =
+        previous ? toMB(snapshot.residentBytes) - toMB(previous->residentBytes)
+                 : 0;
+    os << llvm::format("  %-40s %10llu %+10lld %12.1f %12.1f %10.1f %+10.1f "
+                       "%10.1f\n",
+                       snapshot.passName.c_str(),
+                       (unsigned long long)snapshot.numOperations,
+                       (long long)opsDelta, toKB(snapshot.attributeBytes),
+                       toKB(snapshot.denseBytes),
+                       toMB(snapshot.residentBytes), rssDelta,
+                       toMB(snapshot.peakResidentBytes));
+
+    os << "    ";
+    llvm::interleaveComma(snapshot.dialectCounts, os, [&](const auto &it) {
+      os << it.first << " " << it.second;
+    });
+    os << "\n";
+    previous = &snapshot;
+  }
+}
+
+void IRStats::writeJSON(llvm::raw_ostream &os) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  llvm::json::OStream json(os, /*IndentSize=*/2);
+  json.object([&] {
+    json.attributeArray("passes", [&] {
+      for (const Snapshot &snapshot : snapshots) {
+        json.object([&] {
+          json.attribute("pipeline", int64_t(snapshot.pipeline));
+          json.attribute("pass", snapshot.passName);
+          json.attribute("operations", int64_t(snapshot.numOperations));
+          json.attributeObject("dialects", [&] {
+            for (auto &it : snapshot.dialectCounts)
+              json.attribute(it.first, int64_t(it.second));
+          });
+          json.attributeObject("ops", [&] {
+            for (auto &it : snapshot.opCounts)
+              json.attribute(it.first, int64_t(it.second));
+          });
+          json.attribute("attributeBytes", int64_t(snapshot.attributeBytes));
+          json.attribute("denseElementsBytes", int64_t(snapshot.denseBytes));
+          json.attribute("residentBytes", int64_t(snapshot.residentBytes));
+          json.attribute("peakResidentBytes",
+                         int64_t(snapshot.peakResidentBytes));
+        });
+      }
+    });
+  });
+  os << "\n";
+}
+
+namespace {
+/// Records the module before the first pass and after every pass running on
+/// it. The passes nested on functions run within a pass manager adaptor, on
+/// other threads than it when the context is multithreaded: their names are
+/// collected until the adaptor is done and the module is recorded under them.
+class IRStatsInstrumentation : public mlir::PassInstrumentation {
+public:
+  explicit IRStatsInstrumentation(IRStats &stats)
+      : stats(stats), pipeline(stats.beginPipeline()) {}
+
+  void runBeforePass(mlir::Pass *pass, mlir::Operation *op) override {
+    if (op->getParentOp() || recordedInput)
+      return;
+    recordedInput = true;
+    stats.record(pipeline, "(input)", op);
+  }
+
+  void runAfterPass(mlir::Pass *pass, mlir::Operation *op) override {
+    std::string passName = pass->getName().str();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (op->getParentOp()) {
+        if (!llvm::is_contained(nestedPassNames, passName))
+          nestedPassNames.push_back(passName);
+        return;
+      }
+      if (!nestedPassNames.empty()) {
+        passName = llvm::join(nestedPassNames, ", ");
+        nestedPassNames.clear();
+      }
+    }
+    stats.record(pipeline, passName, op);
+  }
+
+private:
+  IRStats &stats;
+  unsigned pipeline;
+  bool recordedInput = false;
+  std::mutex mutex;
+  std::vector<std::string> nestedPassNames;
+};
+} // namespace
+
+std::unique_ptr<mlir::PassInstrumentation>
+pony::createIRStatsInstrumentation(IRStats &stats) {
+  return std::make_unique<IRStatsInstrumentation>(stats);
+}
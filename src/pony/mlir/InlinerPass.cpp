@@ -0,0 +1,62 @@
+//===- InlinerPass.cpp - Inlining of small Pony functions -----------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a Module level pass inlining the calls to small Pony
+// functions, leaving the larger ones to be specialized for their shapes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Pass/Pass.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Transforms/Passes.h"
+#include "pony/Dialect.h"
+#include "pony/Passes.h"
+#include "llvm/ADT/STLExtras.h"
+
+using namespace mlir;
+using namespace pony;
+
+namespace {
+/// The InlinerPass marks the calls to functions of at most `threshold`
+/// operations, which the inliner interface of the dialect lets the inliner
+/// inline, then runs the inliner. The threshold is an option of the pass
+/// rather than state of the dialect, so that pipelines compiling with
+/// different thresholds can share a context.
+class InlinerPass
+    : public mlir::PassWrapper<InlinerPass, OperationPass<ModuleOp>> {
+public:
+  InlinerPass(unsigned threshold) : threshold(threshold) {
+    inlinerPM.addPass(mlir::createInlinerPass());
+  }
+
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    SymbolTable symbolTable(module);
+
+    // The calls in the bodies of inlined functions are copied with their
+    // marks, so the calls they bring in are judged by the same threshold.
+    UnitAttr mark = UnitAttr::get(&getContext());
+    module.walk([&](GenericCallOp call) {
+      auto callee = symbolTable.lookup<pony::FuncOp>(call.getCallee());
+      if (callee && !callee.isExternal() &&
+          llvm::hasNItemsOrLess(callee.getBody().front(), threshold))
+        call->setAttr(kInlineAttrName, mark);
+    });
+
+    if (failed(runPipeline(inlinerPM, module)))
+      return signalPassFailure();
+    module.walk([](GenericCallOp call) { call->removeAttr(kInlineAttrName); });
+  }
+
+private:
+  unsigned threshold;
+  OpPassManager inlinerPM{ModuleOp::getOperationName()};
+};
+} // namespace
+
+/// Create a pass inlining the calls to small Pony functions.
+std::unique_ptr<mlir::Pass> mlir::pony::createInlinerPass(unsigned threshold) {
+  return std::make_unique<InlinerPass>(threshold);
+}
@@ -0,0 +1,124 @@
+//===- Interpreter.cpp - Direct execution of Pony programs ----------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the interpreter of the Pony dialect.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Interpreter.h"
+#include "pony/Dialect.h"
+#include "pony/Evaluator.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/SymbolTable.h"
+#include "llvm/ADT/DenseMap.h"
+
+using namespace mlir;
+using namespace mlir::pony;
+
+/// The deepest chain of calls interpreted. Pony has no recursion, so only a
+/// program the compiler would reject gets there.
+static constexpr unsigned kMaxCallDepth = 256;
+
+namespace {
+/// Runs the functions of a module one operation at a time, keeping the value
+/// of every SSA value computed so far.
+class Interpreter {
+public:
+  Interpreter(ModuleOp module, std::string &output, uint64_t workLimit)
+      : symbolTable(module), output(output), workLimit(workLimit) {}
+
+  /// Run `function` on `args`, storing what it returns, if anything, into
+  /// `result`.
+  InterpretResult call(pony::FuncOp function,
+                       ArrayRef<const TensorValue *> args, TensorValue &result,
+                       unsigned depth);
+
+private:
+  SymbolTable symbolTable;
+  std::string &output;
+  uint64_t workLimit;
+  uint64_t work = 0;
+};
+} // namespace
+
+InterpretResult Interpreter::call(pony::FuncOp function,
+                                  ArrayRef<const TensorValue *> args,
+                                  TensorValue &result, unsigned depth) {
+  if (depth == kMaxCallDepth) {
+    function.emitError("calls nested too deeply to interpret");
+    return InterpretResult::Failure;
+  }
+  if (function.isExternal() || function.getNumArguments() != args.size()) {
+    function.emitError("unable to interpret a call to this function");
+    return InterpretResult::Failure;
+  }
+
+  llvm::DenseMap<Value, TensorValue> values;
+  for (auto it : llvm::zip(function.getArguments(), args))
+    values[std::get<0>(it)] = *std::get<1>(it);
+
+  for (Operation &op : function.getBody().front()) {
+    SmallVector<const TensorValue *, 2> operands;
+    for (Value operand : op.getOperands())
+      operands.push_back(&values.find(operand)->second);
+
+    if (auto returnOp = dyn_cast<ReturnOp>(op)) {
+      if (returnOp.hasOperand())
+        result = *operands[0];
+      return InterpretResult::Success;
+    }
+
+    uint64_t opWork = estimateWork(&op, operands);
+    if (opWork > workLimit - work)
+      return InterpretResult::WorkLimitExceeded;
+    work += opWork;
+
+    if (isa<PrintOp>(op)) {
+      renderTensor(*operands[0], output);
+      continue;
+    }
+    if (auto printString = dyn_cast<PrintStringOp>(op)) {
+      output += printString.getValue().str();
+      continue;
+    }
+
+    // The operands point into `values`, the result only goes there once
+    // they are no longer used.
+    TensorValue opResult;
+    if (auto callOp = dyn_cast<GenericCallOp>(op)) {
+      auto callee = symbolTable.lookup<pony::FuncOp>(callOp.getCallee());
+      if (!callee) {
+        callOp.emitError("call to unknown function '")
+            << callOp.getCallee() << "'";
+        return InterpretResult::Failure;
+      }
+      if (callee.getResultTypes().empty()) {
+        callOp.emitError("call to '")
+            << callOp.getCallee() << "' which returns no value";
+        return InterpretResult::Failure;
+      }
+      InterpretResult status = call(callee, operands, opResult, depth + 1);
+      if (status != InterpretResult::Success)
+        return status;
+    } else if (failed(evaluateOp(&op, operands, opResult))) {
+      op.emitError("unable to interpret operation");
+      return InterpretResult::Failure;
+    }
+    values[op.getResult(0)] = std::move(opResult);
+  }
+  return InterpretResult::Success;
+}
+
+InterpretResult mlir::pony::interpretMain(ModuleOp module, std::string &output,
+                                          uint64_t workLimit) {
+  auto main = module.lookupSymbol<pony::FuncOp>("main");
+  if (!main) {
+    module.emitError("no 'main' function to interpret");
+    return InterpretResult::Failure;
+  }
+  TensorValue result;
+  return Interpreter(module, output, workLimit)
+      .call(main, /*args=*/{}, result, /*depth=*/0);
+}
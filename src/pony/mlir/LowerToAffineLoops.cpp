@@ -4,11 +4,15 @@
 //
 // This file implements a partial lowering of Pony operations to a combination of
 // affine loops, memref operations and standard operations. This lowering
-// expects that all calls have been inlined, and all shapes have been resolved.
+// expects that all shapes have been resolved, calls that weren't inlined
+// targeting functions specialized for the shapes of their operands. With
+// -profile-ops, the loops of every operation are timed and recorded under its
+// location.
 //
 //===----------------------------------------------------------------------===//
 
 #include "mlir/IR/BuiltinDialect.h"
+#include "pony/CostModel.h"
 #include "pony/Dialect.h"
 #include "pony/Passes.h"
 
@@ -48,6 +52,21 @@ static Value insertAllocAndDealloc(MemRefType type, Location loc,
   return alloc;
 }
 
+/// Read the cycle counter ahead of the loops of an operation at `loc`.
+static Value insertProfileStart(Location loc, OpBuilder &builder) {
+  return builder.create<pony::ProfileStartOp>(loc, builder.getI64Type());
+}
+
+/// Record, after its loops, that `op` took from `start` until now to do the
+/// work the cost model gives it.
+static void insertProfileEnd(Operation *op, Value start, OpBuilder &builder) {
+  pony::OpCost cost =
+      pony::CostAnalysis::getOpCost(op).getValueOr(pony::OpCost());
+  builder.create<pony::ProfileEndOp>(op->getLoc(), start,
+                                     op->getName().getStringRef(), cost.flops,
+                                     cost.getBytes());
+}
+
 /// This defines the function type used to process an iteration of a lowered
 /// loop. It takes as input an OpBuilder, an range of memRefOperands
 /// corresponding to the operands of the input operation, and the range of loop
@@ -56,9 +75,12 @@ static Value insertAllocAndDealloc(MemRefType type, Location loc,
 using LoopIterationFn = function_ref<Value(
     OpBuilder &rewriter, ValueRange memRefOperands, ValueRange loopIvs)>;
 
+/// Lower `op` to a loop nest over its result computing each element with
+/// `processIteration`, timed if `profile`.
 static void lowerOpToLoops(Operation *op, ValueRange operands,
                            PatternRewriter &rewriter,
-                           LoopIterationFn processIteration) {
+                           LoopIterationFn processIteration,
+                           bool profile = false) {
   auto tensorType = (*op->result_type_begin()).cast<TensorType>();
   auto loc = op->getLoc();
 
@@ -72,6 +94,9 @@ static void lowerOpToLoops(Operation *op, ValueRange operands,
   // loop induction variables.
   SmallVector<int64_t, 4> lowerBounds(tensorType.getRank(), /*Value=*/0);
   SmallVector<int64_t, 4> steps(tensorType.getRank(), /*Value=*/1);
+  Value profileStart;
+  if (profile)
+    profileStart = insertProfileStart(loc, rewriter);
   buildAffineLoopNest(
       rewriter, loc, lowerBounds, tensorType.getShape(), steps,
       [&](OpBuilder &nestedBuilder, Location loc, ValueRange ivs) {
@@ -81,6 +106,8 @@ static void lowerOpToLoops(Operation *op, ValueRange operands,
         Value valueToStore = processIteration(nestedBuilder, operands, ivs);
         nestedBuilder.create<AffineStoreOp>(loc, valueToStore, alloc, ivs);
       });
+  if (profile)
+    insertProfileEnd(op, profileStart, rewriter);
 
   // Replace this operation with the generated alloc.
   rewriter.replaceOp(op, alloc);
@@ -93,8 +120,9 @@ namespace {
 
 template <typename BinaryOp, typename LoweredBinaryOp>
 struct BinaryOpLowering : public ConversionPattern {
-  BinaryOpLowering(MLIRContext *ctx)
-      : ConversionPattern(BinaryOp::getOperationName(), 1, ctx) {}
+  BinaryOpLowering(MLIRContext *ctx, bool profile)
+      : ConversionPattern(BinaryOp::getOperationName(), 1, ctx),
+        profile(profile) {}
 
   LogicalResult
   matchAndRewrite(Operation *op, ArrayRef<Value> operands,
@@ -118,16 +146,21 @@ struct BinaryOpLowering : public ConversionPattern {
 
           // Create the binary operation performed on the loaded values.
           return builder.create<LoweredBinaryOp>(loc, loadedLhs, loadedRhs);
-        });
+        },
+        profile);
     return success();
   }
+
+private:
+  bool profile;
 };
 using AddOpLowering = BinaryOpLowering<pony::AddOp, arith::AddFOp>;
 using MulOpLowering = BinaryOpLowering<pony::MulOp, arith::MulFOp>;
 
 struct GemmOpLowering : public ConversionPattern {
-  GemmOpLowering(MLIRContext *ctx)
-      : ConversionPattern(pony::GemmOp::getOperationName(), 1, ctx) {}
+  GemmOpLowering(MLIRContext *ctx, bool profile)
+      : ConversionPattern(pony::GemmOp::getOperationName(), 1, ctx),
+        profile(profile) {}
 
   LogicalResult
   matchAndRewrite(Operation *op, ArrayRef<Value> operands,
@@ -156,6 +189,20 @@ struct GemmOpLowering : public ConversionPattern {
     upperBounds[1] = N;
     upperBounds[2] = K;
 
+    Value profileStart;
+    if (profile)
+      profileStart = insertProfileStart(loc, rewriter);
+
+    // The products accumulate into the result, which must start out as zeros:
+    // a fresh allocation may reuse the memory of a freed buffer.
+    Value zero = rewriter.create<arith::ConstantOp>(
+        loc, rewriter.getZeroAttr(tensorType.getElementType()));
+    buildAffineLoopNest(
+        rewriter, loc, {0, 0}, {M, N}, {1, 1},
+        [&](OpBuilder &nestedBuilder, Location loc, ValueRange ivs) {
+          nestedBuilder.create<AffineStoreOp>(loc, zero, alloc, ivs);
+        });
+
     buildAffineLoopNest(
         rewriter, loc, lowerBounds, upperBounds, steps,
         [&](OpBuilder &nestedBuilder, Location loc, ValueRange ivs) {
@@ -175,10 +222,15 @@ struct GemmOpLowering : public ConversionPattern {
           // Store the result of the multiplication.
           nestedBuilder.create<AffineStoreOp>(loc, updated, alloc, ValueRange{i, j});
         });
+    if (profile)
+      insertProfileEnd(op, profileStart, rewriter);
 
     rewriter.replaceOp(op, alloc);
     return success();
   }
+
+private:
+  bool profile;
 };
 
 //===----------------------------------------------------------------------===//
@@ -186,7 +238,8 @@ struct GemmOpLowering : public ConversionPattern {
 //===----------------------------------------------------------------------===//
 
 struct ConstantOpLowering : public OpRewritePattern<pony::ConstantOp> {
-  using OpRewritePattern<pony::ConstantOp>::OpRewritePattern;
+  ConstantOpLowering(MLIRContext *ctx, bool profile)
+      : OpRewritePattern<pony::ConstantOp>(ctx), profile(profile) {}
 
   LogicalResult matchAndRewrite(pony::ConstantOp op,
                                 PatternRewriter &rewriter) const final {
@@ -204,6 +257,9 @@ struct ConstantOpLowering : public OpRewritePattern<pony::ConstantOp> {
     // operations.
     auto valueShape = memRefType.getShape();
     SmallVector<Value, 8> constantIndices;
+    Value profileStart;
+    if (profile)
+      profileStart = insertProfileStart(loc, rewriter);
 
     if (!valueShape.empty()) {
       for (auto i : llvm::seq<int64_t>(
@@ -243,11 +299,16 @@ struct ConstantOpLowering : public OpRewritePattern<pony::ConstantOp> {
 
     // Start the element storing recursion from the first dimension.
     storeElements(/*dimension=*/0);
+    if (profile)
+      insertProfileEnd(op, profileStart, rewriter);
 
     // Replace this operation with the generated alloc.
     rewriter.replaceOp(op, alloc);
     return success();
   }
+
+private:
+  bool profile;
 };
 
 //===----------------------------------------------------------------------===//
@@ -260,27 +321,73 @@ struct FuncOpLowering : public OpConversionPattern<pony::FuncOp> {
   LogicalResult
   matchAndRewrite(pony::FuncOp op, OpAdaptor adaptor,
                   ConversionPatternRewriter &rewriter) const final {
-    // We only lower the main function as we expect that all other functions
-    // have been inlined.
-    if (op.getName() != "main")
-      return failure();
-
-    // Verify that the given main has no inputs and results.
-    if (op.getNumArguments() || op.getFunctionType().getNumResults()) {
+    // Every function must have been specialized for the shapes it is called
+    // with, or, for entry functions, declared with. They take and return
+    // buffers.
+    FunctionType type = op.getFunctionType();
+    auto isRanked = [](Type type) { return type.isa<RankedTensorType>(); };
+    if (!llvm::all_of(type.getInputs(), isRanked) ||
+        !llvm::all_of(type.getResults(), isRanked))
       return rewriter.notifyMatchFailure(op, [](Diagnostic &diag) {
-        diag << "expected 'main' to have 0 inputs and 0 results";
+        diag << "expected a function specialized for ranked shapes";
       });
-    }
+    TypeConverter::SignatureConversion signature(type.getNumInputs());
+    for (auto it : llvm::enumerate(type.getInputs()))
+      signature.addInputs(
+          it.index(), convertTensorToMemRef(it.value().cast<TensorType>()));
+    SmallVector<Type, 1> resultTypes;
+    for (Type result : type.getResults())
+      resultTypes.push_back(convertTensorToMemRef(result.cast<TensorType>()));
 
     // Create a new non-pony function, with the same region.
-    auto func = rewriter.create<mlir::FuncOp>(op.getLoc(), op.getName(),
-                                              op.getFunctionType());
-    rewriter.inlineRegionBefore(op.getRegion(), func.getBody(), func.end());
+    auto func = rewriter.create<mlir::FuncOp>(
+        op.getLoc(), op.getName(),
+        rewriter.getFunctionType(signature.getConvertedTypes(), resultTypes));
+    if (op.isPrivate()) {
+      func.setPrivate();
+    } else {
+      // Entry functions get a wrapper taking memref descriptors by pointer,
+      // for callers outside of Pony, and keep their Pony signature around so
+      // that these callers can check what they pass.
+      func->setAttr("llvm.emit_c_interface", rewriter.getUnitAttr());
+      func->setAttr("pony.signature", TypeAttr::get(type));
+    }
+    if (!op.isExternal()) {
+      rewriter.inlineRegionBefore(op.getRegion(), func.getBody(), func.end());
+      rewriter.applySignatureConversion(&func.getBody(), signature);
+    }
     rewriter.eraseOp(op);
     return success();
   }
 };
 
+//===----------------------------------------------------------------------===//
+// PonyToAffine RewritePatterns: Call operations
+//===----------------------------------------------------------------------===//
+
+struct GenericCallOpLowering : public OpConversionPattern<pony::GenericCallOp> {
+  using OpConversionPattern<pony::GenericCallOp>::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(pony::GenericCallOp op, OpAdaptor adaptor,
+                  ConversionPatternRewriter &rewriter) const final {
+    auto tensorType = op.getType().dyn_cast<RankedTensorType>();
+    if (!tensorType)
+      return failure();
+
+    // The callee returns a buffer the caller owns, deallocate it at the end of
+    // the block like any other buffer.
+    auto memRefType = convertTensorToMemRef(tensorType);
+    auto call = rewriter.create<func::CallOp>(op.getLoc(), op.getCallee(),
+                                              memRefType, adaptor.getInputs());
+    auto dealloc =
+        rewriter.create<memref::DeallocOp>(op.getLoc(), call.getResult(0));
+    dealloc->moveBefore(&call->getBlock()->back());
+    rewriter.replaceOp(op, call.getResults());
+    return success();
+  }
+};
+
 //===----------------------------------------------------------------------===//
 // PonyToAffine RewritePatterns: Print operations
 //===----------------------------------------------------------------------===//
@@ -303,18 +410,39 @@ struct PrintOpLowering : public OpConversionPattern<pony::PrintOp> {
 // PonyToAffine RewritePatterns: Return operations
 //===----------------------------------------------------------------------===//
 
-struct ReturnOpLowering : public OpRewritePattern<pony::ReturnOp> {
-  using OpRewritePattern<pony::ReturnOp>::OpRewritePattern;
+struct ReturnOpLowering : public OpConversionPattern<pony::ReturnOp> {
+  using OpConversionPattern<pony::ReturnOp>::OpConversionPattern;
 
-  LogicalResult matchAndRewrite(pony::ReturnOp op,
-                                PatternRewriter &rewriter) const final {
-    // During this lowering, we expect that all function calls have been
-    // inlined.
-    if (op.hasOperand())
-      return failure();
+  LogicalResult
+  matchAndRewrite(pony::ReturnOp op, OpAdaptor adaptor,
+                  ConversionPatternRewriter &rewriter) const final {
+    // We lower "pony.return" directly to "func.return". Who owns the returned
+    // buffer is sorted out once the whole function is lowered.
+    rewriter.replaceOpWithNewOp<func::ReturnOp>(op, adaptor.getOperands());
+    return success();
+  }
+};
 
-    // We lower "pony.return" directly to "func.return".
-    rewriter.replaceOpWithNewOp<func::ReturnOp>(op);
+//===----------------------------------------------------------------------===//
+// PonyToAffine RewritePatterns: Reshape operations
+//===----------------------------------------------------------------------===//
+
+struct ReshapeOpLowering : public OpConversionPattern<pony::ReshapeOp> {
+  using OpConversionPattern<pony::ReshapeOp>::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(pony::ReshapeOp op, OpAdaptor adaptor,
+                  ConversionPatternRewriter &rewriter) const final {
+    // Reshapes of constants are folded away, the ones left reshape function
+    // arguments. Buffers are contiguous, so the result is just another view
+    // of the same buffer.
+    auto memRefType = convertTensorToMemRef(op.getType().cast<TensorType>());
+    ArrayRef<int64_t> shape = memRefType.getShape();
+    SmallVector<int64_t, 4> strides(shape.size(), 1);
+    for (int64_t i = (int64_t)shape.size() - 2; i >= 0; --i)
+      strides[i] = strides[i + 1] * shape[i + 1];
+    rewriter.replaceOpWithNewOp<memref::ReinterpretCastOp>(
+        op, memRefType, adaptor.getInput(), /*offset=*/0, shape, strides);
     return success();
   }
 };
@@ -324,8 +452,9 @@ struct ReturnOpLowering : public OpRewritePattern<pony::ReturnOp> {
 //===----------------------------------------------------------------------===//
 
 struct TransposeOpLowering : public ConversionPattern {
-  TransposeOpLowering(MLIRContext *ctx)
-      : ConversionPattern(pony::TransposeOp::getOperationName(), 1, ctx) {}
+  TransposeOpLowering(MLIRContext *ctx, bool profile)
+      : ConversionPattern(pony::TransposeOp::getOperationName(), 1, ctx),
+        profile(profile) {}
 
   LogicalResult
   matchAndRewrite(Operation *op, ArrayRef<Value> operands,
@@ -345,9 +474,13 @@ struct TransposeOpLowering : public ConversionPattern {
                      SmallVector<Value, 2> reverseIvs(llvm::reverse(loopIvs));
                      return builder.create<AffineLoadOp>(loc, input,
                                                          reverseIvs);
-                   });
+                   },
+                   profile);
     return success();
   }
+
+private:
+  bool profile;
 };
 
 } // namespace
@@ -362,10 +495,15 @@ struct TransposeOpLowering : public ConversionPattern {
 namespace {
 struct PonyToAffineLoweringPass
     : public PassWrapper<PonyToAffineLoweringPass, OperationPass<ModuleOp>> {
+  PonyToAffineLoweringPass(bool profileOps) : profileOps(profileOps) {}
+
   void getDependentDialects(DialectRegistry &registry) const override {
     registry.insert<AffineDialect, func::FuncDialect, memref::MemRefDialect>();
   }
   void runOnOperation() final;
+
+private:
+  bool profileOps;
 };
 } // namespace
 
@@ -386,30 +524,61 @@ void PonyToAffineLoweringPass::runOnOperation() {
   // a partial lowering, we explicitly mark the Pony operations that don't want
   // to lower, `pony.print`, as `legal`. `pony.print` will still need its operands
   // to be updated though (as we convert from TensorType to MemRefType), so we
-  // only treat it as `legal` if its operands are legal.
+  // only treat it as `legal` if its operands are legal. `pony.print_string`
+  // has no operands and is lowered together with `pony.print`, as are the
+  // profiling operations the loops are wrapped in.
   target.addIllegalDialect<pony::PonyDialect>();
   target.addDynamicallyLegalOp<pony::PrintOp>([](pony::PrintOp op) {
     return llvm::none_of(op->getOperandTypes(),
                          [](Type type) { return type.isa<TensorType>(); });
   });
+  target.addLegalOp<pony::PrintStringOp, pony::ProfileEndOp,
+                    pony::ProfileStartOp>();
 
   // Now that the conversion target has been defined, we just need to provide
   // the set of patterns that will lower the Pony operations.
   RewritePatternSet patterns(&getContext());
-  patterns.add<AddOpLowering, ConstantOpLowering, FuncOpLowering, MulOpLowering,
-               PrintOpLowering, ReturnOpLowering, TransposeOpLowering, GemmOpLowering>(
-      &getContext());
+  patterns.add<FuncOpLowering, GenericCallOpLowering, PrintOpLowering,
+               ReshapeOpLowering, ReturnOpLowering>(&getContext());
+  patterns.add<AddOpLowering, ConstantOpLowering, GemmOpLowering,
+               MulOpLowering, TransposeOpLowering>(&getContext(), profileOps);
 
   // With the target and rewrite patterns defined, we can now attempt the
   // conversion. The conversion will signal failure if any of our `illegal`
   // operations were not converted successfully.
   if (failed(
           applyPartialConversion(getOperation(), target, std::move(patterns))))
-    signalPassFailure();
+    return signalPassFailure();
+
+  // A function hands the buffer it returns over to its caller. A buffer the
+  // function allocated itself, or got from a call, just must not be
+  // deallocated anymore, whether it is returned as is or through the views of
+  // reshapes. Anything else is an argument or a view of one, which the
+  // function never deallocates, and is returned as a copy.
+  getOperation().walk([](func::ReturnOp op) {
+    OpBuilder builder(op);
+    for (OpOperand &operand : op->getOpOperands()) {
+      Value value = operand.get();
+      Value buffer = value;
+      while (auto view = buffer.getDefiningOp<memref::ReinterpretCastOp>())
+        buffer = view->getOperand(0);
+      if (isa_and_nonnull<memref::AllocOp, func::CallOp>(
+              buffer.getDefiningOp())) {
+        for (Operation *user : llvm::make_early_inc_range(buffer.getUsers()))
+          if (isa<memref::DeallocOp>(user))
+            user->erase();
+        continue;
+      }
+      auto copy = builder.create<memref::AllocOp>(
+          op.getLoc(), value.getType().cast<MemRefType>());
+      builder.create<memref::CopyOp>(op.getLoc(), value, copy);
+      operand.set(copy);
+    }
+  });
 }
 
 /// Create a pass for lowering operations in the `Affine` and `Std` dialects,
 /// for a subset of the Pony IR (e.g. matmul).
-std::unique_ptr<Pass> mlir::pony::createLowerToAffinePass() {
-  return std::make_unique<PonyToAffineLoweringPass>();
+std::unique_ptr<Pass> mlir::pony::createLowerToAffinePass(bool profileOps) {
+  return std::make_unique<PonyToAffineLoweringPass>(profileOps);
 }
@@ -3,10 +3,13 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements full lowering of Pony operations to LLVM MLIR dialect.
-// 'pony.print' is lowered to a loop nest that calls `printf` on each element of
-// the input array. The file also sets up the PonyToLLVMLoweringPass. This pass
-// lowers the combination of Arithmetic + Affine + SCF + Func dialects to the
-// LLVM one:
+// 'pony.print' is lowered to a call into the `pony_print_memref` runtime
+// function, which formats the whole tensor at once, and the profiling
+// operations of -profile-ops to calls recording into the profile the runtime
+// keeps. With -track-allocs, the calls to `malloc` and `free` the memref
+// allocations are lowered to go through the runtime as well. The file also
+// sets up the PonyToLLVMLoweringPass. This pass lowers the combination of
+// Arithmetic + Affine + SCF + Func dialects to the LLVM one:
 //
 //                         Affine --
 //                                  |
@@ -14,7 +17,7 @@
 //                       Arithmetic + Func --> LLVM (Dialect)
 //                                  ^
 //                                  |
-//     'pony.print' --> Loop (SCF) --
+//     'pony.print' --> Runtime call --
 //
 //===----------------------------------------------------------------------===//
 
@@ -27,18 +30,25 @@
 #include "mlir/Conversion/FuncToLLVM/ConvertFuncToLLVM.h"
 #include "mlir/Conversion/FuncToLLVM/ConvertFuncToLLVMPass.h"
 #include "mlir/Conversion/LLVMCommon/ConversionTarget.h"
+#include "mlir/Conversion/LLVMCommon/MemRefBuilder.h"
+#include "mlir/Conversion/LLVMCommon/Pattern.h"
 #include "mlir/Conversion/LLVMCommon/TypeConverter.h"
 #include "mlir/Conversion/MemRefToLLVM/MemRefToLLVM.h"
 #include "mlir/Conversion/SCFToControlFlow/SCFToControlFlow.h"
+#include "mlir/Conversion/VectorToLLVM/ConvertVectorToLLVM.h"
+#include "mlir/Conversion/VectorToSCF/VectorToSCF.h"
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
 #include "mlir/Dialect/Arithmetic/IR/Arithmetic.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/SCF/SCF.h"
+#include "mlir/Dialect/Vector/Transforms/VectorRewritePatterns.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/Transforms/DialectConversion.h"
+#include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "llvm/ADT/Sequence.h"
+#include "llvm/ADT/StringMap.h"
 
 using namespace mlir;
 
@@ -46,121 +56,319 @@ using namespace mlir;
 // PonyToLLVM RewritePatterns
 //===----------------------------------------------------------------------===//
 
+/// Return a symbol reference to the runtime function `name` of type `type`,
+/// declaring it in `module` if necessary.
+static FlatSymbolRefAttr
+getOrInsertRuntimeFunction(OpBuilder &builder, ModuleOp module, StringRef name,
+                           LLVM::LLVMFunctionType type) {
+  if (!module.lookupSymbol<LLVM::LLVMFuncOp>(name)) {
+    OpBuilder::InsertionGuard insertGuard(builder);
+    builder.setInsertionPointToStart(module.getBody());
+    builder.create<LLVM::LLVMFuncOp>(module.getLoc(), name, type);
+  }
+  return SymbolRefAttr::get(module.getContext(), name);
+}
+
+namespace {
+/// The string constants of a module being lowered to LLVM, each held once as
+/// a nul-terminated string in a global, however many operations use it. The
+/// globals are named `pony_str_<n>` in the order they are created: this
+/// lowering is the only one creating them, so the names are free without
+/// looking them up in the module.
+class GlobalStrings {
+public:
+  explicit GlobalStrings(ModuleOp module) : module(module) {}
+
+  /// Return a pointer to the first character of the global holding `value`,
+  /// creating the global at the start of the module if there is none yet.
+  Value getPointer(OpBuilder &builder, Location loc, StringRef value) {
+    LLVM::GlobalOp &global = globals[value];
+    if (!global) {
+      OpBuilder::InsertionGuard insertGuard(builder);
+      builder.setInsertionPointToStart(module.getBody());
+      std::string terminated = (value + Twine('\0')).str();
+      auto type = LLVM::LLVMArrayType::get(builder.getIntegerType(8),
+                                           terminated.size());
+      global = builder.create<LLVM::GlobalOp>(
+          loc, type, /*isConstant=*/true, LLVM::Linkage::Internal,
+          "pony_str_" + std::to_string(numGlobals++),
+          builder.getStringAttr(terminated), /*alignment=*/0);
+    }
+
+    Value globalPtr = builder.create<LLVM::AddressOfOp>(loc, global);
+    Value cst0 = builder.create<LLVM::ConstantOp>(loc, builder.getI64Type(),
+                                                  builder.getI64IntegerAttr(0));
+    return builder.create<LLVM::GEPOp>(
+        loc, LLVM::LLVMPointerType::get(builder.getIntegerType(8)), globalPtr,
+        ArrayRef<Value>({cst0, cst0}));
+  }
+
+private:
+  ModuleOp module;
+  llvm::StringMap<LLVM::GlobalOp> globals;
+  unsigned numGlobals = 0;
+};
+} // namespace
+
+/// Return the file, line and column `loc` points at, looking through the call
+/// sites of inlined operations and the names of values, or null if it points
+/// at none.
+static FileLineColLoc getFileLineColLoc(Location loc) {
+  FileLineColLoc result;
+  loc->walk([&](Location nested) {
+    result = nested.dyn_cast<FileLineColLoc>();
+    return result ? WalkResult::interrupt() : WalkResult::advance();
+  });
+  return result;
+}
+
 namespace {
-/// Lowers `pony.print` to a loop nest calling `printf` on each of the individual
-/// elements of the array.
-class PrintOpLowering : public ConversionPattern {
+/// Lowers `pony.print` to a single call to the `pony_print_memref` runtime
+/// function, passing the data pointer along with the shape and strides of the
+/// input memref.
+class PrintOpLowering : public ConvertOpToLLVMPattern<pony::PrintOp> {
 public:
-  explicit PrintOpLowering(MLIRContext *context)
-      : ConversionPattern(pony::PrintOp::getOperationName(), 1, context) {}
+  using ConvertOpToLLVMPattern<pony::PrintOp>::ConvertOpToLLVMPattern;
 
   LogicalResult
-  matchAndRewrite(Operation *op, ArrayRef<Value> operands,
+  matchAndRewrite(pony::PrintOp op, OpAdaptor adaptor,
                   ConversionPatternRewriter &rewriter) const override {
-    auto memRefType = (*op->operand_type_begin()).cast<MemRefType>();
-    auto memRefShape = memRefType.getShape();
-    auto loc = op->getLoc();
+    auto memRefType = op.getInput().getType().cast<MemRefType>();
+    int64_t rank = memRefType.getRank();
+    auto loc = op.getLoc();
+    auto *context = rewriter.getContext();
 
-    ModuleOp parentModule = op->getParentOfType<ModuleOp>();
+    // Get a symbol reference to the runtime print function, inserting it if
+    // necessary. The signature is:
+    //   * `void (double*, i64, i64*, i64*)`
+    auto llvmI64Ty = IntegerType::get(context, 64);
+    auto llvmI64PtrTy = LLVM::LLVMPointerType::get(llvmI64Ty);
+    auto llvmF64PtrTy = LLVM::LLVMPointerType::get(Float64Type::get(context));
+    auto printRef = getOrInsertRuntimeFunction(
+        rewriter, op->getParentOfType<ModuleOp>(), "pony_print_memref",
+        LLVM::LLVMFunctionType::get(
+            LLVM::LLVMVoidType::get(context),
+            {llvmF64PtrTy, llvmI64Ty, llvmI64PtrTy, llvmI64PtrTy},
+            /*isVarArg=*/false));
+
+    // Unpack the converted memref descriptor: the runtime wants a pointer to
+    // the first element, plus the sizes and strides of every dimension.
+    MemRefDescriptor descriptor(adaptor.getInput());
+    Value dataPtr = rewriter.create<LLVM::GEPOp>(
+        loc, llvmF64PtrTy, descriptor.alignedPtr(rewriter, loc),
+        ArrayRef<Value>({descriptor.offset(rewriter, loc)}));
 
-    // Get a symbol reference to the printf function, inserting it if necessary.
-    auto printfRef = getOrInsertPrintf(rewriter, parentModule);
-    Value formatSpecifierCst = getOrCreateGlobalString(
-        loc, rewriter, "frmt_spec", StringRef("%f \0", 4), parentModule);
-    Value newLineCst = getOrCreateGlobalString(
-        loc, rewriter, "nl", StringRef("\n\0", 2), parentModule);
-
-    // Create a loop for each of the dimensions within the shape.
-    SmallVector<Value, 4> loopIvs;
-    for (unsigned i = 0, e = memRefShape.size(); i != e; ++i) {
-      auto lowerBound = rewriter.create<arith::ConstantIndexOp>(loc, 0);
-      auto upperBound =
-          rewriter.create<arith::ConstantIndexOp>(loc, memRefShape[i]);
-      auto step = rewriter.create<arith::ConstantIndexOp>(loc, 1);
-      auto loop =
-          rewriter.create<scf::ForOp>(loc, lowerBound, upperBound, step);
-      for (Operation &nested : *loop.getBody())
-        rewriter.eraseOp(&nested);
-      loopIvs.push_back(loop.getInductionVar());
-
-      // Terminate the loop body.
-      rewriter.setInsertionPointToEnd(loop.getBody());
-
-      // Insert a newline after each of the inner dimensions of the shape.
-      if (i != e - 1)
-        rewriter.create<func::CallOp>(loc, printfRef,
-                                      rewriter.getIntegerType(32), newLineCst);
-      rewriter.create<scf::YieldOp>(loc);
-      rewriter.setInsertionPointToStart(loop.getBody());
+    auto createI64Constant = [&](int64_t value) -> Value {
+      return rewriter.create<LLVM::ConstantOp>(
+          loc, llvmI64Ty, rewriter.getI64IntegerAttr(value));
+    };
+    Value arraySize = createI64Constant(std::max<int64_t>(rank, 1));
+    Value sizes = rewriter.create<LLVM::AllocaOp>(loc, llvmI64PtrTy, arraySize,
+                                                  /*alignment=*/0);
+    Value strides = rewriter.create<LLVM::AllocaOp>(
+        loc, llvmI64PtrTy, arraySize, /*alignment=*/0);
+    for (int64_t i = 0; i != rank; ++i) {
+      Value index = createI64Constant(i);
+      Value sizePtr = rewriter.create<LLVM::GEPOp>(loc, llvmI64PtrTy, sizes,
+                                                   ArrayRef<Value>({index}));
+      rewriter.create<LLVM::StoreOp>(loc, descriptor.size(rewriter, loc, i),
+                                     sizePtr);
+      Value stridePtr = rewriter.create<LLVM::GEPOp>(
+          loc, llvmI64PtrTy, strides, ArrayRef<Value>({index}));
+      rewriter.create<LLVM::StoreOp>(loc, descriptor.stride(rewriter, loc, i),
+                                     stridePtr);
     }
 
-    // Generate a call to printf for the current element of the loop.
-    auto printOp = cast<pony::PrintOp>(op);
-    auto elementLoad =
-        rewriter.create<memref::LoadOp>(loc, printOp.getInput(), loopIvs);
     rewriter.create<func::CallOp>(
-        loc, printfRef, rewriter.getIntegerType(32),
-        ArrayRef<Value>({formatSpecifierCst, elementLoad}));
+        loc, printRef, TypeRange(),
+        ArrayRef<Value>({dataPtr, createI64Constant(rank), sizes, strides}));
 
     // Notify the rewriter that this operation has been removed.
     rewriter.eraseOp(op);
     return success();
   }
+};
 
-private:
-  /// Return a symbol reference to the printf function, inserting it into the
-  /// module if necessary.
-  static FlatSymbolRefAttr getOrInsertPrintf(PatternRewriter &rewriter,
-                                             ModuleOp module) {
-    auto *context = module.getContext();
-    if (module.lookupSymbol<LLVM::LLVMFuncOp>("printf"))
-      return SymbolRefAttr::get(context, "printf");
-
-    // Create a function declaration for printf, the signature is:
-    //   * `i32 (i8*, ...)`
-    auto llvmI32Ty = IntegerType::get(context, 32);
+/// Lowers `pony.print_string` to a global holding the pre-rendered output and
+/// a single call to the `pony_print_string` runtime function.
+class PrintStringOpLowering : public OpConversionPattern<pony::PrintStringOp> {
+public:
+  PrintStringOpLowering(MLIRContext *context, GlobalStrings &strings)
+      : OpConversionPattern<pony::PrintStringOp>(context), strings(strings) {}
+
+  LogicalResult
+  matchAndRewrite(pony::PrintStringOp op, OpAdaptor adaptor,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto loc = op.getLoc();
+    auto *context = rewriter.getContext();
+    ModuleOp parentModule = op->getParentOfType<ModuleOp>();
+    StringRef value = op.getValue();
+
+    // Get a symbol reference to the runtime function, inserting it if
+    // necessary. The signature is:
+    //   * `void (i8*, i64)`
+    auto llvmI64Ty = IntegerType::get(context, 64);
     auto llvmI8PtrTy = LLVM::LLVMPointerType::get(IntegerType::get(context, 8));
-    auto llvmFnType = LLVM::LLVMFunctionType::get(llvmI32Ty, llvmI8PtrTy,
-                                                  /*isVarArg=*/true);
-
-    // Insert the printf function into the body of the parent module.
-    PatternRewriter::InsertionGuard insertGuard(rewriter);
-    rewriter.setInsertionPointToStart(module.getBody());
-    rewriter.create<LLVM::LLVMFuncOp>(module.getLoc(), "printf", llvmFnType);
-    return SymbolRefAttr::get(context, "printf");
+    auto printRef = getOrInsertRuntimeFunction(
+        rewriter, parentModule, "pony_print_string",
+        LLVM::LLVMFunctionType::get(LLVM::LLVMVoidType::get(context),
+                                    {llvmI8PtrTy, llvmI64Ty},
+                                    /*isVarArg=*/false));
+
+    // The string is passed along with its length, the nul terminating it in
+    // its global isn't printed.
+    Value strPtr = strings.getPointer(rewriter, loc, value);
+    Value length = rewriter.create<LLVM::ConstantOp>(
+        loc, llvmI64Ty, rewriter.getI64IntegerAttr(value.size()));
+
+    rewriter.create<func::CallOp>(loc, printRef, TypeRange(),
+                                  ArrayRef<Value>({strPtr, length}));
+    rewriter.eraseOp(op);
+    return success();
   }
 
-  /// Return a value representing an access into a global string with the given
-  /// name, creating the string if necessary.
-  static Value getOrCreateGlobalString(Location loc, OpBuilder &builder,
-                                       StringRef name, StringRef value,
-                                       ModuleOp module) {
-    // Create the global at the entry of the module.
-    LLVM::GlobalOp global;
-    if (!(global = module.lookupSymbol<LLVM::GlobalOp>(name))) {
-      OpBuilder::InsertionGuard insertGuard(builder);
-      builder.setInsertionPointToStart(module.getBody());
-      auto type = LLVM::LLVMArrayType::get(
-          IntegerType::get(builder.getContext(), 8), value.size());
-      global = builder.create<LLVM::GlobalOp>(loc, type, /*isConstant=*/true,
-                                              LLVM::Linkage::Internal, name,
-                                              builder.getStringAttr(value),
-                                              /*alignment=*/0);
-    }
+private:
+  GlobalStrings &strings;
+};
 
-    // Get the pointer to the first character in the global string.
-    Value globalPtr = builder.create<LLVM::AddressOfOp>(loc, global);
-    Value cst0 = builder.create<LLVM::ConstantOp>(
-        loc, IntegerType::get(builder.getContext(), 64),
-        builder.getIntegerAttr(builder.getIndexType(), 0));
-    return builder.create<LLVM::GEPOp>(
-        loc,
-        LLVM::LLVMPointerType::get(IntegerType::get(builder.getContext(), 8)),
-        globalPtr, ArrayRef<Value>({cst0, cst0}));
+/// Lowers `pony.profile_start` to a call to the `pony_profile_start` runtime
+/// function, reading the cycle counter.
+class ProfileStartOpLowering
+    : public OpConversionPattern<pony::ProfileStartOp> {
+public:
+  using OpConversionPattern<pony::ProfileStartOp>::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(pony::ProfileStartOp op, OpAdaptor adaptor,
+                  ConversionPatternRewriter &rewriter) const override {
+    // The signature is:
+    //   * `i64 ()`
+    auto llvmI64Ty = IntegerType::get(rewriter.getContext(), 64);
+    auto startRef = getOrInsertRuntimeFunction(
+        rewriter, op->getParentOfType<ModuleOp>(), "pony_profile_start",
+        LLVM::LLVMFunctionType::get(llvmI64Ty, {}, /*isVarArg=*/false));
+    rewriter.replaceOpWithNewOp<func::CallOp>(op, startRef, llvmI64Ty,
+                                              ValueRange());
+    return success();
   }
 };
+
+/// Lowers `pony.profile_end` to a call to the `pony_profile_end` runtime
+/// function, passing the name of the operation and the file it comes from as
+/// nul-terminated strings in globals, along with its line and column.
+class ProfileEndOpLowering : public OpConversionPattern<pony::ProfileEndOp> {
+public:
+  ProfileEndOpLowering(MLIRContext *context, GlobalStrings &strings)
+      : OpConversionPattern<pony::ProfileEndOp>(context), strings(strings) {}
+
+  LogicalResult
+  matchAndRewrite(pony::ProfileEndOp op, OpAdaptor adaptor,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto loc = op.getLoc();
+    auto *context = rewriter.getContext();
+    ModuleOp parentModule = op->getParentOfType<ModuleOp>();
+
+    // The signature is:
+    //   * `void (i64, i8*, i8*, i64, i64, i64, i64)`
+    auto llvmI64Ty = IntegerType::get(context, 64);
+    auto llvmI8PtrTy = LLVM::LLVMPointerType::get(IntegerType::get(context, 8));
+    auto endRef = getOrInsertRuntimeFunction(
+        rewriter, parentModule, "pony_profile_end",
+        LLVM::LLVMFunctionType::get(
+            LLVM::LLVMVoidType::get(context),
+            {llvmI64Ty, llvmI8PtrTy, llvmI8PtrTy, llvmI64Ty, llvmI64Ty,
+             llvmI64Ty, llvmI64Ty},
+            /*isVarArg=*/false));
+
+    auto createI64Constant = [&](int64_t value) -> Value {
+      return rewriter.create<LLVM::ConstantOp>(
+          loc, llvmI64Ty, rewriter.getI64IntegerAttr(value));
+    };
+    auto createString = [&](StringRef value) -> Value {
+      return strings.getPointer(rewriter, loc, value);
+    };
+
+    FileLineColLoc fileLoc = getFileLineColLoc(loc);
+    Value args[] = {
+        adaptor.getStart(),
+        createString(op.getName()),
+        createString(fileLoc ? fileLoc.getFilename().getValue() : "<unknown>"),
+        createI64Constant(fileLoc ? fileLoc.getLine() : 0),
+        createI64Constant(fileLoc ? fileLoc.getColumn() : 0),
+        createI64Constant(op.getFlops()),
+        createI64Constant(op.getBytes())};
+    rewriter.replaceOpWithNewOp<func::CallOp>(op, endRef, TypeRange(), args);
+    return success();
+  }
+
+private:
+  GlobalStrings &strings;
+};
 } // namespace
 
+/// Route the calls to `malloc` and `free` that the memref allocations of
+/// `module` were lowered to through the `pony_alloc` and `pony_free` runtime
+/// functions. The runtime tracks the memory the program uses under the
+/// location of every allocation.
+static void instrumentAllocations(ModuleOp module, GlobalStrings &strings) {
+  OpBuilder builder(module.getContext());
+  auto llvmI64Ty = builder.getI64Type();
+  auto llvmI8PtrTy = LLVM::LLVMPointerType::get(builder.getIntegerType(8));
+
+  // The signatures are:
+  //   * `i8* (i64, i8*, i64, i64)` for pony_alloc
+  //   * `void (i8*)` for pony_free
+  auto allocRef = getOrInsertRuntimeFunction(
+      builder, module, "pony_alloc",
+      LLVM::LLVMFunctionType::get(
+          llvmI8PtrTy, {llvmI64Ty, llvmI8PtrTy, llvmI64Ty, llvmI64Ty},
+          /*isVarArg=*/false));
+  auto freeRef = getOrInsertRuntimeFunction(
+      builder, module, "pony_free",
+      LLVM::LLVMFunctionType::get(LLVM::LLVMVoidType::get(module.getContext()),
+                                  {llvmI8PtrTy}, /*isVarArg=*/false));
+
+  SmallVector<LLVM::CallOp, 16> calls;
+  module.walk([&](LLVM::CallOp call) {
+    Optional<StringRef> callee = call.getCallee();
+    if (callee && (*callee == "malloc" || *callee == "free"))
+      calls.push_back(call);
+  });
+
+  for (LLVM::CallOp call : calls) {
+    Location loc = call.getLoc();
+    builder.setInsertionPoint(call);
+    if (*call.getCallee() == "free") {
+      builder.create<LLVM::CallOp>(loc, TypeRange(), freeRef,
+                                   call.getOperands());
+      call.erase();
+      continue;
+    }
+
+    FileLineColLoc fileLoc = getFileLineColLoc(loc);
+    StringRef fileName =
+        fileLoc ? fileLoc.getFilename().getValue() : "<unknown>";
+    auto createI64Constant = [&](int64_t value) -> Value {
+      return builder.create<LLVM::ConstantOp>(
+          loc, llvmI64Ty, builder.getI64IntegerAttr(value));
+    };
+    Value args[] = {call.getOperand(0),
+                    strings.getPointer(builder, loc, fileName),
+                    createI64Constant(fileLoc ? fileLoc.getLine() : 0),
+                    createI64Constant(fileLoc ? fileLoc.getColumn() : 0)};
+    auto alloc =
+        builder.create<LLVM::CallOp>(loc, llvmI8PtrTy, allocRef, args);
+    call.getResult(0).replaceAllUsesWith(alloc.getResult(0));
+    call.erase();
+  }
+
+  // Nothing calls the C allocator anymore.
+  for (StringRef name : {"malloc", "free"})
+    if (auto function = module.lookupSymbol<LLVM::LLVMFuncOp>(name))
+      if (function.symbolKnownUseEmpty(module))
+        function.erase();
+}
+
 //===----------------------------------------------------------------------===//
 // PonyToLLVMLoweringPass
 //===----------------------------------------------------------------------===//
@@ -168,14 +376,34 @@ private:
 namespace {
 struct PonyToLLVMLoweringPass
     : public PassWrapper<PonyToLLVMLoweringPass, OperationPass<ModuleOp>> {
+  PonyToLLVMLoweringPass(bool trackAllocations)
+      : trackAllocations(trackAllocations) {}
+
   void getDependentDialects(DialectRegistry &registry) const override {
     registry.insert<LLVM::LLVMDialect, scf::SCFDialect>();
   }
   void runOnOperation() final;
+
+private:
+  bool trackAllocations;
 };
 } // namespace
 
 void PonyToLLVMLoweringPass::runOnOperation() {
+  // Loops vectorized at -O3 access memory through vector transfers. Turn them
+  // into plain vector loads and stores, masked where they run past the end of
+  // the buffer, or into scalar loops where they are strided, both of which
+  // have a direct lowering to LLVM.
+  {
+    RewritePatternSet patterns(&getContext());
+    vector::populateVectorBroadcastLoweringPatterns(patterns);
+    vector::populateVectorMaskOpLoweringPatterns(patterns);
+    vector::populateVectorTransferLoweringPatterns(patterns,
+                                                   /*maxTransferRank=*/1);
+    populateVectorToSCFConversionPatterns(patterns);
+    (void)applyPatternsAndFoldGreedily(getOperation(), std::move(patterns));
+  }
+
   // The first thing to define is the conversion target. This will define the
   // final target for this lowering. For this lowering, we are only targeting
   // the LLVM dialect.
@@ -205,20 +433,31 @@ void PonyToLLVMLoweringPass::runOnOperation() {
   populateMemRefToLLVMConversionPatterns(typeConverter, patterns);
   cf::populateControlFlowToLLVMConversionPatterns(typeConverter, patterns);
   populateFuncToLLVMConversionPatterns(typeConverter, patterns);
+  populateVectorToLLVMConversionPatterns(typeConverter, patterns);
 
-  // The only remaining operation to lower from the `pony` dialect, is the
-  // PrintOp.
-  patterns.add<PrintOpLowering>(&getContext());
+  // The only remaining operations to lower from the `pony` dialect, are the
+  // PrintOp, the pre-rendered PrintStringOp and the profiling operations.
+  // The strings they pass to the runtime, and the file names of the tracked
+  // allocations, share their globals.
+  auto module = getOperation();
+  GlobalStrings strings(module);
+  patterns.add<PrintOpLowering>(typeConverter);
+  patterns.add<PrintStringOpLowering, ProfileEndOpLowering>(&getContext(),
+                                                            strings);
+  patterns.add<ProfileStartOpLowering>(&getContext());
 
   // We want to completely lower to LLVM, so we use a `FullConversion`. This
   // ensures that only legal operations will remain after the conversion.
-  auto module = getOperation();
   if (failed(applyFullConversion(module, target, std::move(patterns))))
-    signalPassFailure();
+    return signalPassFailure();
+
+  if (trackAllocations)
+    instrumentAllocations(module, strings);
 }
 
 /// Create a pass for lowering operations the remaining `Pony` operations, as
 /// well as `Affine` and `Std`, to the LLVM dialect for codegen.
-std::unique_ptr<mlir::Pass> mlir::pony::createLowerToLLVMPass() {
-  return std::make_unique<PonyToLLVMLoweringPass>();
+std::unique_ptr<mlir::Pass>
+mlir::pony::createLowerToLLVMPass(bool trackAllocations) {
+  return std::make_unique<PonyToLLVMLoweringPass>(trackAllocations);
 }
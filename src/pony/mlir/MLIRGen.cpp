@@ -72,6 +72,21 @@ public:
     return theModule;
   }
 
+  /// Public API: convert the AST for a single Pony function to an MLIR
+  /// function at the end of `module`.
+  mlir::LogicalResult mlirGen(mlir::ModuleOp module, FunctionAST &funcAST) {
+    theModule = module;
+    mlir::pony::FuncOp function = mlirGen(funcAST);
+    if (!function)
+      return mlir::failure();
+    if (failed(mlir::verify(function))) {
+      function.emitError("function verification error");
+      function.erase();
+      return mlir::failure();
+    }
+    return mlir::success();
+  }
+
 private:
   /// A "module" matches a Pony source file: containing a list of functions.
   mlir::ModuleOp theModule;
@@ -450,4 +465,8 @@ mlir::OwningOpRef<mlir::ModuleOp> mlirGen(mlir::MLIRContext &context,
   return MLIRGenImpl(context).mlirGen(moduleAST);
 }
 
+mlir::LogicalResult mlirGen(mlir::ModuleOp module, FunctionAST &functionAST) {
+  return MLIRGenImpl(*module.getContext()).mlirGen(module, functionAST);
+}
+
 } // namespace pony
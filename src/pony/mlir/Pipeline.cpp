@@ -0,0 +1,132 @@
+//===- Pipeline.cpp - The Pony compilation pipeline -----------------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the pass pipeline lowering Pony modules.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Pipeline.h"
+#include "pony/Dialect.h"
+#include "pony/Passes.h"
+
+#include "mlir/Dialect/Affine/Passes.h"
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Transforms/Passes.h"
+#include "llvm/ADT/StringSwitch.h"
+
+#include <algorithm>
+
+/// The number of doubles in the vectors the affine loops are vectorized to,
+/// that of a 256-bit register. Wider or narrower targets get the vectors split
+/// or combined by the LLVM code generator.
+static constexpr int64_t kVectorWidth = 4;
+
+/// The module attribute holding the stage of a module.
+static constexpr llvm::StringLiteral kStageAttrName = "pony.stage";
+
+pony::Stage pony::getStage(mlir::ModuleOp module) {
+  auto stage = module->getAttrOfType<mlir::StringAttr>(kStageAttrName);
+  if (!stage)
+    return Stage::Pony;
+  return llvm::StringSwitch<Stage>(stage.getValue())
+      .Case("specialized", Stage::Specialized)
+      .Case("affine", Stage::Affine)
+      .Case("llvm", Stage::LLVM)
+      .Default(Stage::Pony);
+}
+
+void pony::setStage(mlir::ModuleOp module, Stage stage) {
+  static const char *const names[] = {"pony", "specialized", "affine",
+                                      "llvm"};
+  module->setAttr(kStageAttrName,
+                  mlir::StringAttr::get(module.getContext(),
+                                        names[static_cast<unsigned>(stage)]));
+}
+
+pony::Stage pony::getStageAfter(LoweringTarget target,
+                                const CompileOptions &options, Stage from) {
+  Stage reached = Stage::Pony;
+  if (target == LoweringTarget::LLVM)
+    reached = Stage::LLVM;
+  else if (target == LoweringTarget::Affine)
+    reached = Stage::Affine;
+  else if (target == LoweringTarget::Specialized || options.optLevel > 0 ||
+           options.foldProgram)
+    reached = Stage::Specialized;
+  return std::max(reached, from);
+}
+
+/// Add the passes optimizing the affine loops at `options.optLevel` to `pm`.
+static void buildLoopOptimizationPipeline(mlir::OpPassManager &pm,
+                                          const pony::CompileOptions &options) {
+  if (options.optLevel == 0)
+    return;
+
+  pm.addPass(mlir::createCanonicalizerPass());
+  pm.addPass(mlir::createCSEPass());
+  if (options.optLevel == 1)
+    return;
+
+  // Fuse the loops of consecutive operations, then forward the stores to the
+  // loads of the fused loops and hoist what does not depend on them.
+  pm.addPass(mlir::createLoopFusionPass());
+  pm.addPass(mlir::createAffineScalarReplacementPass());
+  pm.addPass(mlir::createAffineLoopInvariantCodeMotionPass());
+
+  // Unrolling and vectorizing grow the code, which -Os is not after.
+  if (options.optLevel >= 3 && options.sizeLevel == 0) {
+    pm.addPass(mlir::createLoopTilingPass());
+    pm.addPass(mlir::createLoopUnrollAndJamPass());
+    pm.addPass(mlir::createSuperVectorizePass({kVectorWidth}));
+  }
+  pm.addPass(mlir::createCanonicalizerPass());
+}
+
+void pony::buildPipeline(mlir::PassManager &pm, LoweringTarget target,
+                         const CompileOptions &options,
+                         mlir::pony::SpecializationCache *cache,
+                         Stage from) {
+  // Check to see what granularity of MLIR we are compiling to.
+  bool isSpecializing = target >= LoweringTarget::Specialized;
+  bool isLoweringToAffine = target >= LoweringTarget::Affine;
+  bool isLoweringToLLVM = target >= LoweringTarget::LLVM;
+
+  if (from < Stage::Specialized &&
+      (options.optLevel > 0 || options.foldProgram || isSpecializing)) {
+    // Inline the small functions, then specialize what is left for the shapes
+    // it is called with. Both need to see the whole module.
+    if (options.optLevel > 0)
+      pm.addPass(mlir::pony::createInlinerPass(options.inlineThreshold));
+    pm.addPass(mlir::pony::createShapeSpecializationPass(cache));
+
+    // Every function now has its shapes resolved and is optimized on its own,
+    // in parallel with the others.
+    mlir::OpPassManager &optPM = pm.nest<mlir::pony::FuncOp>();
+    if (options.optLevel > 0) {
+      optPM.addPass(mlir::createCanonicalizerPass());
+      optPM.addPass(mlir::createCSEPass());
+    }
+
+    // With every shape known, evaluate what can be computed at compile time
+    // and let the canonicalizer drop the computations nothing uses anymore.
+    if (options.foldProgram) {
+      optPM.addPass(mlir::pony::createFoldProgramPass(
+          options.foldProgramLimit, options.foldProgramWorkLimit));
+      optPM.addPass(mlir::createCanonicalizerPass());
+    }
+  }
+
+  if (from < Stage::Affine && isLoweringToAffine) {
+    // Partially lower the pony dialect, then optimize the loops.
+    pm.addPass(mlir::pony::createLowerToAffinePass(options.profileOps));
+    buildLoopOptimizationPipeline(pm.nest<mlir::FuncOp>(), options);
+  }
+
+  if (from < Stage::LLVM && isLoweringToLLVM) {
+    // Finish lowering the pony IR to the LLVM dialect.
+    pm.addPass(mlir::pony::createLowerToLLVMPass(options.trackAllocations));
+  }
+}
@@ -2,8 +2,9 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements a Function level pass performing interprocedural
-// propagation of array shapes through function specialization.
+// This file implements a Module level pass performing interprocedural
+// propagation of array shapes through function specialization, on top of
+// intraprocedural shape inference.
 //
 //===----------------------------------------------------------------------===//
 
@@ -11,7 +12,11 @@
 #include "pony/Dialect.h"
 #include "pony/Passes.h"
 #include "pony/ShapeInferenceInterface.h"
+#include "pony/SpecializationCache.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -23,9 +28,23 @@ using namespace pony;
 /// Include the auto-generated definitions for the shape inference interfaces.
 #include "pony/ShapeInferenceOpInterfaces.cpp.inc"
 
-namespace {
-/// The ShapeInferencePass is a pass that performs intra-procedural
-/// shape inference.
+/// A utility method that returns if the given operation has all of its
+/// operands inferred.
+static bool allOperandsInferred(Operation *op) {
+  return llvm::all_of(op->getOperandTypes(), [](Type operandType) {
+    return operandType.isa<RankedTensorType>();
+  });
+}
+
+/// A utility method that returns if the given operation has a dynamically
+/// shaped result.
+static bool returnsDynamicShape(Operation *op) {
+  return llvm::any_of(op->getResultTypes(), [](Type resultType) {
+    return !resultType.isa<RankedTensorType>();
+  });
+}
+
+/// Perform intra-procedural shape inference on `f`.
 ///
 ///    Algorithm:
 ///
@@ -37,73 +56,203 @@ namespace {
 ///        worklist has all of its arguments non-generic,
 ///     b) if no operation is found, break out of the loop,
 ///     c) remove the operation from the worklist,
-///     d) infer the shape of its output from the argument types.
+///     d) infer the shape of its output from the argument types, calls going
+///        through `inferCall`.
 ///   3) If the worklist is empty, the algorithm succeeded.
 ///
-class ShapeInferencePass
-    : public mlir::PassWrapper<ShapeInferencePass, OperationPass<pony::FuncOp>> {
+/// The worklist keeps the operations in program order, so that calls are
+/// visited in a deterministic order.
+static LogicalResult
+inferShapes(pony::FuncOp f,
+            function_ref<LogicalResult(GenericCallOp)> inferCall) {
+  // Populate the worklist with the operations that need shape inference:
+  // these are operations that return a dynamic shape.
+  llvm::SetVector<mlir::Operation *> opWorklist;
+  f.walk([&](mlir::Operation *op) {
+    if (returnsDynamicShape(op))
+      opWorklist.insert(op);
+  });
+
+  // Iterate on the operations in the worklist until all operations have been
+  // inferred or no change happened (fix point).
+  while (!opWorklist.empty()) {
+    // Find the next operation ready for inference, that is an operation
+    // with all operands already resolved (non-generic).
+    auto nextop = llvm::find_if(opWorklist, allOperandsInferred);
+    if (nextop == opWorklist.end())
+      break;
+
+    Operation *op = *nextop;
+    opWorklist.remove(op);
+
+    // Ask the operation to infer its output shapes.
+    LLVM_DEBUG(llvm::dbgs() << "Inferring shape for: " << *op << "\n");
+    if (auto shapeOp = dyn_cast<ShapeInference>(op)) {
+      shapeOp.inferShapes();
+    } else if (auto call = dyn_cast<GenericCallOp>(op)) {
+      if (failed(inferCall(call)))
+        return failure();
+    } else {
+      return op->emitError("unable to infer shape of operation without shape "
+                           "inference interface");
+    }
+  }
+
+  // If the operation worklist isn't empty, this indicates a failure.
+  if (!opWorklist.empty())
+    return f.emitError("Shape inference failed, ")
+           << opWorklist.size() << " operations couldn't be inferred\n";
+  return success();
+}
+
+namespace {
+/// The ShapeSpecializationPass performs inter-procedural shape inference.
+/// Starting from the public functions, `main` and the entry functions declared
+/// with argument shapes, it infers the shapes within a function as above, and
+/// when it reaches a call whose operand shapes are known, it clones the callee
+/// into a version specialized for these shapes, shared by every call with the
+/// same shapes. The specialization is inferred in turn, which gives the shape
+/// of the result of the call. Once done, the generic functions are erased:
+/// every remaining function is fully shaped and independent of the others.
+///
+/// With a SpecializationCache, generic functions are only emitted once a call
+/// needs them, and specializations the cache already has are just declared.
+class ShapeSpecializationPass
+    : public mlir::PassWrapper<ShapeSpecializationPass,
+                               OperationPass<ModuleOp>> {
 public:
+  ShapeSpecializationPass(SpecializationCache *cache) : cache(cache) {}
+
   void runOnOperation() override {
-    auto f = getOperation();
-
-    // Populate the worklist with the operations that need shape inference:
-    // these are operations that return a dynamic shape.
-    llvm::SmallPtrSet<mlir::Operation *, 16> opWorklist;
-    f.walk([&](mlir::Operation *op) {
-      if (returnsDynamicShape(op))
-        opWorklist.insert(op);
-    });
-
-    // Iterate on the operations in the worklist until all operations have been
-    // inferred or no change happened (fix point).
-    while (!opWorklist.empty()) {
-      // Find the next operation ready for inference, that is an operation
-      // with all operands already resolved (non-generic).
-      auto nextop = llvm::find_if(opWorklist, allOperandsInferred);
-      if (nextop == opWorklist.end())
-        break;
-
-      Operation *op = *nextop;
-      opWorklist.erase(op);
-
-      // Ask the operation to infer its output shapes.
-      LLVM_DEBUG(llvm::dbgs() << "Inferring shape for: " << *op << "\n");
-      if (auto shapeOp = dyn_cast<ShapeInference>(op)) {
-        shapeOp.inferShapes();
-      } else {
-        op->emitError("unable to infer shape of operation without shape "
-                      "inference interface");
+    ModuleOp module = getOperation();
+    SymbolTable symbolTable(module);
+
+    // The same pass manager may run over many modules, start afresh.
+    specializations.clear();
+    inProgress.clear();
+
+    // The public functions, `main` and the entry functions of embedders, are
+    // where shapes come from.
+    SmallVector<pony::FuncOp, 4> entries;
+    for (auto func : module.getOps<pony::FuncOp>())
+      if (!func.isPrivate() && !func.isExternal())
+        entries.push_back(func);
+    if (entries.empty())
+      return;
+
+    llvm::SmallPtrSet<Operation *, 16> specialized;
+    for (pony::FuncOp entry : entries)
+      if (failed(specialize(entry, entry.getName(), symbolTable, specialized)))
         return signalPassFailure();
-      }
-    }
 
-    // If the operation worklist isn't empty, this indicates a failure.
-    if (!opWorklist.empty()) {
-      f.emitError("Shape inference failed, ")
-          << opWorklist.size() << " operations couldn't be inferred\n";
-      signalPassFailure();
-    }
+    for (auto func :
+         llvm::make_early_inc_range(module.getOps<pony::FuncOp>()))
+      if (!specialized.count(func))
+        func.erase();
   }
 
-  /// A utility method that returns if the given operation has all of its
-  /// operands inferred.
-  static bool allOperandsInferred(Operation *op) {
-    return llvm::all_of(op->getOperandTypes(), [](Type operandType) {
-      return operandType.isa<RankedTensorType>();
-    });
+private:
+  /// Infer the shapes within `f`, a specialization of `callee`, specializing
+  /// the functions it calls, and derive its result types from what it returns.
+  LogicalResult specialize(pony::FuncOp f, StringRef callee,
+                           SymbolTable &symbolTable,
+                           llvm::SmallPtrSetImpl<Operation *> &specialized) {
+    specialized.insert(f);
+    inProgress.insert(f);
+    auto inferCall = [&](GenericCallOp call) {
+      return specializeCall(call, symbolTable, specialized);
+    };
+    if (failed(inferShapes(f, inferCall)))
+      return failure();
+    inProgress.erase(f);
+
+    auto returnOp = cast<ReturnOp>(f.getBody().back().getTerminator());
+    f.setType(FunctionType::get(f.getContext(), f.getArgumentTypes(),
+                                returnOp.getOperandTypes()));
+    if (cache)
+      cache->notifySpecialized(f, callee);
+    return success();
   }
 
-  /// A utility method that returns if the given operation has a dynamically
-  /// shaped result.
-  static bool returnsDynamicShape(Operation *op) {
-    return llvm::any_of(op->getResultTypes(), [](Type resultType) {
-      return !resultType.isa<RankedTensorType>();
-    });
+  /// Retarget `call` to the specialization of its callee for its operand
+  /// shapes, creating it if needed.
+  LogicalResult
+  specializeCall(GenericCallOp call, SymbolTable &symbolTable,
+                 llvm::SmallPtrSetImpl<Operation *> &specialized) {
+    // Name the specialization after the callee and the operand shapes, e.g.
+    // `multiply_transpose_2x3_2x3`.
+    StringRef calleeName = call.getCallee();
+    std::string name = calleeName.str();
+    for (Type type : call.getOperandTypes()) {
+      name += '_';
+      llvm::raw_string_ostream os(name);
+      llvm::interleave(type.cast<RankedTensorType>().getShape(), os, "x");
+    }
+
+    pony::FuncOp specialization = specializations.lookup(name);
+    SmallVector<Type, 1> resultTypes;
+    if (!specialization && cache &&
+        cache->lookup(name, calleeName, resultTypes)) {
+      // Compiled before, a declaration is all the caller needs.
+      OpBuilder builder(symbolTable.getOp()->getRegion(0));
+      specialization = builder.create<pony::FuncOp>(
+          call.getLoc(), name,
+          builder.getFunctionType(call.getOperandTypes(), resultTypes));
+      specialization.eraseBody();
+      specialization.setPrivate();
+      symbolTable.insert(specialization);
+      specializations[name] = specialization;
+      specialized.insert(specialization);
+    } else if (!specialization) {
+      auto callee = symbolTable.lookup<pony::FuncOp>(calleeName);
+      if (!callee && cache)
+        callee = cache->getFunction(calleeName,
+                                    cast<ModuleOp>(symbolTable.getOp()));
+      if (!callee)
+        return call.emitError("call to unknown function '")
+               << calleeName << "'";
+
+      specialization = callee.clone();
+      specialization.setName(name);
+      specialization.setType(FunctionType::get(
+          call.getContext(), call.getOperandTypes(), callee.getResultTypes()));
+      for (auto it : llvm::zip(specialization.getArguments(),
+                               call.getOperandTypes()))
+        std::get<0>(it).setType(std::get<1>(it));
+      symbolTable.insert(specialization);
+      specializations[name] = specialization;
+      if (failed(specialize(specialization, calleeName, symbolTable,
+                            specialized)))
+        return failure();
+    } else if (inProgress.count(specialization)) {
+      return call.emitError("recursive call to '")
+             << calleeName << "' is not supported";
+    }
+
+    // A call is an expression: the callee must return the value it stands
+    // for, even if the caller ignores it.
+    if (specialization.getResultTypes().empty())
+      return call.emitError("call to '")
+             << calleeName << "' which returns no value";
+
+    call->setAttr("callee", SymbolRefAttr::get(specialization));
+    call.getResult().setType(specialization.getResultTypes().front());
+    return success();
   }
+
+  /// The specializations created so far, by name.
+  llvm::StringMap<pony::FuncOp> specializations;
+
+  /// The functions whose inference is under way, to detect recursion.
+  llvm::SmallPtrSet<Operation *, 8> inProgress;
+
+  /// Where earlier specializations are looked up, if anywhere.
+  SpecializationCache *cache;
 };
 } // namespace
 
-/// Create a Shape Inference pass.
-std::unique_ptr<mlir::Pass> mlir::pony::createShapeInferencePass() {
-  return std::make_unique<ShapeInferencePass>();
+/// Create a pass specializing functions for the shapes of their arguments.
+std::unique_ptr<mlir::Pass>
+mlir::pony::createShapeSpecializationPass(SpecializationCache *cache) {
+  return std::make_unique<ShapeSpecializationPass>(cache);
 }
@@ -0,0 +1,123 @@
+//===- Trace.cpp - Timeline of the phases of the compiler -----------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the tracer of the compiler and the pass
+// instrumentation feeding it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Trace.h"
+
+#include "mlir/IR/BuiltinAttributes.h"
+#include "mlir/IR/Operation.h"
+#include "mlir/IR/SymbolTable.h"
+#include "mlir/Pass/Pass.h"
+#include "mlir/Pass/PassInstrumentation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace pony;
+
+void Tracer::record(llvm::StringRef name, llvm::StringRef detail,
+                    Clock::time_point start, Clock::time_point end) {
+  uint64_t threadId = llvm::get_threadid();
+  std::lock_guard<std::mutex> lock(mutex);
+  events.push_back({name.str(), detail.str(), threadId, start, end});
+}
+
+void Tracer::write(llvm::raw_ostream &os) const {
+  std::vector<Event> sorted;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    sorted = events;
+  }
+  // Enclosing scopes first, so that viewers nest the others into them.
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Event &lhs, const Event &rhs) {
+                     return lhs.start < rhs.start ||
+                            (lhs.start == rhs.start && lhs.end > rhs.end);
+                   });
+
+  auto toMicroseconds = [](Clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+  };
+  llvm::json::OStream json(os);
+  json.object([&] {
+    json.attributeArray("traceEvents", [&] {
+      json.object([&] {
+        json.attribute("name", "process_name");
+        json.attribute("ph", "M");
+        json.attribute("pid", 1);
+        json.attributeObject("args", [&] { json.attribute("name", "ponyc"); });
+      });
+      for (const Event &event : sorted) {
+        json.object([&] {
+          json.attribute("name", event.name);
+          json.attribute("cat", "pony");
+          json.attribute("ph", "X");
+          json.attribute("pid", 1);
+          json.attribute("tid", int64_t(event.threadId));
+          json.attribute("ts", toMicroseconds(event.start - origin));
+          json.attribute("dur", toMicroseconds(event.end - event.start));
+          if (!event.detail.empty())
+            json.attributeObject(
+                "args", [&] { json.attribute("detail", event.detail); });
+        });
+      }
+    });
+    json.attribute("displayTimeUnit", "ms");
+  });
+}
+
+namespace {
+/// Times every pass, keeping a stack of the passes running on each thread:
+/// the passes nested on functions run within their pass manager adaptor, and
+/// on other threads than it when the context is multithreaded.
+class TraceInstrumentation : public mlir::PassInstrumentation {
+public:
+  explicit TraceInstrumentation(Tracer &tracer) : tracer(tracer) {}
+
+  void runBeforePass(mlir::Pass *pass, mlir::Operation *op) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    starts[llvm::get_threadid()].push_back(Tracer::Clock::now());
+  }
+  void runAfterPass(mlir::Pass *pass, mlir::Operation *op) override {
+    recordPass(pass, op);
+  }
+  void runAfterPassFailed(mlir::Pass *pass, mlir::Operation *op) override {
+    recordPass(pass, op);
+  }
+
+private:
+  void recordPass(mlir::Pass *pass, mlir::Operation *op) {
+    Tracer::Clock::time_point start;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto &threadStarts = starts[llvm::get_threadid()];
+      start = threadStarts.pop_back_val();
+    }
+    // Name functions by their symbol, anything else by its operation name.
+    llvm::StringRef detail = op->getName().getStringRef();
+    if (auto symbol = op->getAttrOfType<mlir::StringAttr>(
+            mlir::SymbolTable::getSymbolAttrName()))
+      detail = symbol.getValue();
+    tracer.record(pass->getName(), detail, start, Tracer::Clock::now());
+  }
+
+  Tracer &tracer;
+  std::mutex mutex;
+  llvm::DenseMap<uint64_t, llvm::SmallVector<Tracer::Clock::time_point, 4>>
+      starts;
+};
+} // namespace
+
+std::unique_ptr<mlir::PassInstrumentation>
+pony::createTraceInstrumentation(Tracer &tracer) {
+  return std::make_unique<TraceInstrumentation>(tracer);
+}
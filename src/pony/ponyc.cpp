@@ -7,338 +7,455 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/StringRef.h"
-#include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
-#include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/MemoryBuffer.h"
-#include "llvm/Support/SourceMgr.h"
-#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
-#include "mlir/Dialect/Affine/Passes.h"
-#include "mlir/ExecutionEngine/ExecutionEngine.h"
-#include "mlir/ExecutionEngine/OptUtils.h"
 #include "mlir/IR/AsmState.h"
-#include "mlir/IR/BuiltinOps.h"
 #include "mlir/IR/MLIRContext.h"
-#include "mlir/IR/Verifier.h"
-#include "mlir/InitAllDialects.h"
-#include "mlir/Parser/Parser.h"
-#include "mlir/Pass/Pass.h"
 #include "mlir/Pass/PassManager.h"
-#include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
-#include "mlir/Target/LLVMIR/Export.h"
-#include "mlir/Transforms/Passes.h"
-#include "pony/Dialect.h"
-#include "pony/MLIRGen.h"
-#include "pony/Parser.h"
-#include "pony/Passes.h"
+#include "mlir/Support/FileUtilities.h"
+#include "pony/CompileServer.h"
+#include "pony/Driver.h"
+#include "pony/IRStats.h"
+#include "pony/Trace.h"
+
+#include <string>
+#include <vector>
 
 using namespace pony;
 namespace cl = llvm::cl;
 
-static cl::opt<std::string> inputFilename(cl::Positional,
-                                          cl::desc("<input pony file>"),
-                                          cl::init("-"),
-                                          cl::value_desc("filename"));
-namespace {
-enum InputType { Pony, MLIR };
-}  // namespace
-static cl::opt<enum InputType> inputType(
-    "x", cl::init(Pony), cl::desc("Decided the kind of output desired"),
-    cl::values(clEnumValN(Pony, "pony",
+static cl::list<std::string> inputFilenames(cl::Positional,
+                                            cl::desc("<input pony files>"),
+                                            cl::ZeroOrMore,
+                                            cl::value_desc("filename"));
+static cl::opt<std::string> manifestFilename(
+    "manifest",
+    cl::desc("Also compile every file listed in this file, one per line"),
+    cl::value_desc("filename"));
+
+static cl::opt<InputType> inputType(
+    "x", cl::init(InputType::Pony),
+    cl::desc("Decided the kind of output desired"),
+    cl::values(clEnumValN(InputType::Pony, "pony",
                           "load the input file as a Pony source.")),
-    cl::values(clEnumValN(MLIR, "mlir",
+    cl::values(clEnumValN(InputType::MLIR, "mlir",
                           "load the input file as an MLIR file")));
 
-namespace {
-enum Action {
-  None,
-  DumpToken,
-  DumpAST,
-  DumpMLIR,
-  DumpMLIRAffine,
-  DumpMLIRLLVM,
-  DumpLLVMIR,
-  RunJIT
-};
-}  // namespace
-static cl::opt<enum Action> emitAction(
+static cl::opt<Action> emitAction(
     "emit", cl::desc("Select the kind of output desired"),
-    cl::values(clEnumValN(DumpToken, "token", "output the token dump")),
-    cl::values(clEnumValN(DumpAST, "ast", "output the AST dump")),
-    cl::values(clEnumValN(DumpMLIR, "mlir", "output the MLIR dump")),
-    cl::values(clEnumValN(DumpMLIRAffine, "mlir-affine",
+    cl::values(clEnumValN(Action::DumpToken, "token", "output the token dump")),
+    cl::values(clEnumValN(Action::DumpAST, "ast", "output the AST dump")),
+    cl::values(clEnumValN(Action::DumpMLIR, "mlir", "output the MLIR dump")),
+    cl::values(clEnumValN(Action::DumpMLIRAffine, "mlir-affine",
                           "output the MLIR dump after affine lowering")),
-    cl::values(clEnumValN(DumpMLIRLLVM, "mlir-llvm",
+    cl::values(clEnumValN(Action::DumpMLIRLLVM, "mlir-llvm",
                           "output the MLIR dump after llvm lowering")),
-    cl::values(clEnumValN(DumpLLVMIR, "llvm", "output the LLVM IR dump")),
     cl::values(
-        clEnumValN(RunJIT, "jit",
-                   "JIT the code and run it by invoking the main function")));
-
-static cl::opt<bool> enableOpt("opt", cl::desc("Enable optimizations"));
-
-/// Returns a Pony AST resulting from parsing the file or a nullptr on error.
-std::unique_ptr<pony::ModuleAST> parseInputFile(llvm::StringRef filename) {
-  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
-      llvm::MemoryBuffer::getFileOrSTDIN(filename);
-  if (std::error_code ec = fileOrErr.getError()) {
-    llvm::errs() << "Could not open input file: " << ec.message() << "\n";
-    return nullptr;
+        clEnumValN(Action::DumpLLVMIR, "llvm", "output the LLVM IR dump")),
+    cl::values(clEnumValN(Action::EmitAssembly, "asm",
+                          "compile ahead of time to target assembly")),
+    cl::values(clEnumValN(Action::EmitObject, "obj",
+                          "compile ahead of time to a relocatable object")),
+    cl::values(clEnumValN(Action::EmitShared, "shared",
+                          "compile ahead of time to a shared library")),
+    cl::values(
+        clEnumValN(Action::RunJIT, "jit",
+                   "JIT the code and run it by invoking the main function")),
+    cl::values(clEnumValN(Action::Interpret, "interp",
+                          "run the main function in the interpreter, "
+                          "without compiling the code")),
+    cl::values(clEnumValN(Action::DumpCost, "cost",
+                          "output the static cost and roofline report of "
+                          "every operation")));
+
+static cl::opt<char>
+    optLevel("O", cl::Prefix, cl::init('1'),
+             cl::desc("Optimization level: -O0, -O1, -O2, -O3 or -Os "
+                      "(default -O1, or -O0 with -emit=mlir)"));
+static cl::opt<bool> enableOpt("opt", cl::desc("Enable optimizations, as -O3"));
+
+static cl::opt<unsigned> inlineThreshold(
+    "inline-threshold",
+    cl::desc("Inline calls to functions of at most this many operations, "
+             "specialize larger ones and optimize them in parallel"),
+    cl::init(32));
+
+static cl::opt<bool> profileOps(
+    "profile-ops",
+    cl::desc("Time the loops of every operation of the compiled program and "
+             "report the time, FLOPs and bytes of each source location when "
+             "it exits"));
+static cl::opt<bool> trackAllocs(
+    "track-allocs",
+    cl::desc("Allocate the buffers of the compiled program through the "
+             "runtime, and report its peak memory and what each source "
+             "location allocated when it exits"));
+
+static cl::opt<std::string> outputFilename(
+    "o",
+    cl::desc("Output file for -emit=asm, -emit=obj and -emit=shared "
+             "(defaults to the input name with the matching extension), or "
+             "to save the module at an -emit=mlir* stage to resume from"),
+    cl::value_desc("filename"));
+static cl::opt<std::string> outputDirectory(
+    "output-dir",
+    cl::desc("Directory the outputs go to when compiling several files, each "
+             "named after its input with the matching extension"),
+    cl::init("."), cl::value_desc("directory"));
+static cl::opt<unsigned>
+    numJobs("j",
+            cl::desc("Number of files compiled in parallel when compiling "
+                     "several files (defaults to one per hardware thread)"),
+            cl::init(0));
+static cl::opt<unsigned> codegenThreads(
+    "codegen-threads",
+    cl::desc("Split the LLVM module of a single input into this many "
+             "partitions, optimized and compiled in parallel, for -emit=obj, "
+             "-emit=shared and -emit=jit"),
+    cl::init(1));
+static cl::opt<bool> fastCompile(
+    "fast-compile",
+    cl::desc("Translate the specialized Pony IR straight to LLVM IR, without "
+             "the affine and LLVM dialects: much faster to compile, slower "
+             "to run"));
+
+static cl::opt<std::string>
+    targetTriple("mtriple",
+                 cl::desc("Target triple to compile for (defaults to the "
+                          "host)"));
+static cl::opt<std::string>
+    targetCPU("mcpu",
+              cl::desc("Target a specific cpu type (defaults to the host cpu "
+                       "when compiling for the host)"),
+              cl::value_desc("cpu-name"));
+static cl::list<std::string>
+    targetAttrs("mattr", cl::CommaSeparated,
+                cl::desc("Target specific attributes to enable or disable on "
+                         "top of the cpu's own"),
+                cl::value_desc("+a1,-a2,..."));
+
+static cl::opt<bool> foldProgram(
+    "fold-program",
+    cl::desc("Evaluate constant computations at compile time and replace "
+             "prints of known values with pre-rendered output"));
+static cl::opt<unsigned> foldProgramLimit(
+    "fold-program-limit",
+    cl::desc("Maximum number of bytes of output pre-rendered per function "
+             "with -fold-program"),
+    cl::init(1 << 20));
+static cl::opt<uint64_t> foldProgramWorkLimit(
+    "fold-program-work-limit",
+    cl::desc("Maximum number of arithmetic operations and element moves "
+             "evaluated per function with -fold-program"),
+    cl::init(1 << 24));
+
+static cl::opt<std::string> jitCacheDir(
+    "jit-cache-dir",
+    cl::desc("Keep the objects compiled by -emit=jit in this directory and "
+             "reuse them when the same program runs again"),
+    cl::value_desc("directory"));
+static cl::opt<unsigned> jitCacheSizeMB(
+    "jit-cache-size-mb",
+    cl::desc("Maximum size of the -jit-cache-dir directory in megabytes"),
+    cl::init(256));
+static cl::opt<bool> incremental(
+    "incremental",
+    cl::desc("With -emit=jit, cache every function in -jit-cache-dir on its "
+             "own and only recompile the ones affected by a change"));
+static cl::opt<bool>
+    jitCacheStats("jit-cache-stats",
+                  cl::desc("Print the hit and miss counts of the JIT cache"));
+static cl::opt<bool>
+    jitLazy("jit-lazy",
+            cl::desc("Compile each function on its first call rather than the "
+                     "whole module before running main"));
+static cl::opt<bool> jitStartupTime(
+    "jit-startup-time",
+    cl::desc("Print the time from the start of JIT compilation to the first "
+             "instruction of main"));
+static cl::opt<unsigned>
+    repeat("repeat",
+           cl::desc("With -emit=jit, call main this many times in the same "
+                    "process and report its latency and throughput"),
+           cl::init(1));
+static cl::opt<unsigned>
+    warmup("warmup",
+           cl::desc("With -repeat, call main this many more times first, "
+                    "without timing them"),
+           cl::init(0));
+static cl::list<std::string> mainArgs(
+    "main-arg",
+    cl::desc("With -emit=jit, pass the f64 values of a binary file, in "
+             "row-major order, as the next argument of main"),
+    cl::value_desc("file:shape, e.g. a.bin:2x3"));
+static cl::opt<bool> perfCounters(
+    "perf-counters",
+    cl::desc("With -emit=jit, count the cycles, instructions, cache and "
+             "branch misses of main with the hardware counters, and report "
+             "them along with the FLOP and byte rates its shapes make for"));
+static cl::opt<uint64_t> interpThreshold(
+    "interp-threshold",
+    cl::desc("With -emit=jit, interpret programs doing at most this many "
+             "arithmetic operations rather than compiling them (0 always "
+             "compiles)"),
+    cl::init(1 << 20));
+
+static cl::opt<double> rooflineGflops(
+    "roofline-gflops",
+    cl::desc("Peak arithmetic throughput, in GFLOP/s, of the machine the "
+             "report of -emit=cost bounds the operations by"),
+    cl::init(32));
+static cl::opt<double> rooflineBandwidth(
+    "roofline-bandwidth",
+    cl::desc("Peak memory bandwidth, in GB/s, of the machine the report of "
+             "-emit=cost bounds the operations by"),
+    cl::init(16));
+
+static cl::opt<std::string> traceFile(
+    "trace",
+    cl::desc("Write a timeline of every phase of the compiler, in the Chrome "
+             "trace event format, to this file"),
+    cl::value_desc("filename"));
+
+static cl::opt<bool> irStats(
+    "ir-stats",
+    cl::desc("After every pass, report the operations of the module by "
+             "dialect, the bytes its attributes hold and the resident memory "
+             "of the compiler"));
+static cl::opt<std::string> irStatsJSON(
+    "ir-stats-json",
+    cl::desc("Write the statistics of -ir-stats, with the operations by name "
+             "as well, as JSON to this file"),
+    cl::value_desc("filename"));
+
+static cl::opt<bool> serve(
+    "serve",
+    cl::desc("Keep running and serve compile-and-run requests from stdin, or "
+             "from -serve-socket, with warm compiler and JIT state"));
+static cl::opt<bool> interactive(
+    "repl", cl::desc("Read definitions and statements from stdin and run "
+                     "each statement as it is entered"));
+static cl::opt<std::string>
+    serveSocket("serve-socket",
+                cl::desc("Listen for -serve requests on this unix domain "
+                         "socket instead of stdin"),
+                cl::value_desc("path"));
+static cl::opt<unsigned> serveWorkers(
+    "serve-workers",
+    cl::desc("Number of threads serving requests (defaults to one per "
+             "hardware thread)"),
+    cl::init(0));
+
+/// Return the options given on the command line.
+static DriverOptions getDriverOptions() {
+  DriverOptions options;
+  options.inputType = inputType;
+  options.action = emitAction;
+  options.outputFilename = outputFilename;
+  options.outputDirectory = outputDirectory;
+  options.numJobs = numJobs;
+  options.targetTriple = targetTriple;
+  options.targetCPU = targetCPU;
+  options.targetAttrs.assign(targetAttrs.begin(), targetAttrs.end());
+  options.runtimeLibrary = PONY_RUNTIME_LIBRARY;
+
+  if (enableOpt) {
+    options.compile.optLevel = 3;
+  } else if (optLevel == 's') {
+    options.compile.optLevel = 2;
+    options.compile.sizeLevel = 1;
+  } else if (!optLevel.getNumOccurrences() && emitAction == Action::DumpMLIR) {
+    // -emit=mlir prints the module as generated unless asked to optimize it.
+    options.compile.optLevel = 0;
+  } else {
+    options.compile.optLevel = optLevel - '0';
   }
-  auto buffer = fileOrErr.get()->getBuffer();
-  LexerBuffer lexer(buffer.begin(), buffer.end(), std::string(filename));
-  Parser parser(lexer);
-  return parser.parseModule();
+  options.compile.foldProgram = foldProgram;
+  options.compile.foldProgramLimit = foldProgramLimit;
+  options.compile.foldProgramWorkLimit = foldProgramWorkLimit;
+  options.compile.inlineThreshold = inlineThreshold;
+  options.compile.profileOps = profileOps;
+  options.compile.trackAllocations = trackAllocs;
+  options.codegenThreads = codegenThreads;
+  options.fastCompile = fastCompile;
+
+  options.jitCacheDir = jitCacheDir;
+  options.jitCacheSize = uint64_t(jitCacheSizeMB) << 20;
+  options.incremental = incremental;
+  options.jitCacheStats = jitCacheStats;
+  options.jitLazy = jitLazy;
+  options.jitStartupTime = jitStartupTime;
+  options.repeat = repeat;
+  options.warmup = warmup;
+  options.mainArgs.assign(mainArgs.begin(), mainArgs.end());
+  options.perfCounters = perfCounters;
+  options.interpThreshold = interpThreshold;
+  options.roofline.peakGflops = rooflineGflops;
+  options.roofline.peakBandwidth = rooflineBandwidth;
+  options.traceFile = traceFile;
+  options.irStats = irStats;
+  options.irStatsJSONFile = irStatsJSON;
+  return options;
 }
 
-int loadMLIR(mlir::MLIRContext &context,
-             mlir::OwningOpRef<mlir::ModuleOp> &module) {
-  // Handle '.pony' input to the compiler.
-  if (inputType != InputType::MLIR &&
-      !llvm::StringRef(inputFilename).endswith(".mlir")) {
-    auto moduleAST = parseInputFile(inputFilename);
-    if (!moduleAST) return 6;
-    module = mlirGen(context, *moduleAST);
-    return !module ? 1 : 0;
-  }
-
-  // Otherwise, the input is '.mlir'.
-  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
-      llvm::MemoryBuffer::getFileOrSTDIN(inputFilename);
+/// Append the files listed in the manifest at `path` to `inputs`: one per
+/// line, skipping blank lines and lines starting with '#'.
+static bool readManifest(llvm::StringRef path,
+                         std::vector<std::string> &inputs) {
+  auto fileOrErr = llvm::MemoryBuffer::getFile(path);
   if (std::error_code ec = fileOrErr.getError()) {
-    llvm::errs() << "Could not open input file: " << ec.message() << "\n";
-    return -1;
+    llvm::errs() << "Could not open manifest " << path << ": " << ec.message()
+                 << "\n";
+    return false;
   }
-
-  // Parse the input mlir.
-  llvm::SourceMgr sourceMgr;
-  sourceMgr.AddNewSourceBuffer(std::move(*fileOrErr), llvm::SMLoc());
-  module = mlir::parseSourceFile<mlir::ModuleOp>(sourceMgr, &context);
-  if (!module) {
-    llvm::errs() << "Error can't load file " << inputFilename << "\n";
-    return 3;
+  llvm::SmallVector<llvm::StringRef, 0> lines;
+  (*fileOrErr)->getBuffer().split(lines, '\n');
+  for (llvm::StringRef line : lines) {
+    line = line.trim();
+    if (!line.empty() && !line.startswith("#"))
+      inputs.push_back(line.str());
   }
-  return 0;
+  return true;
 }
 
-int loadAndProcessMLIR(mlir::MLIRContext &context,
-                       mlir::OwningOpRef<mlir::ModuleOp> &module) {
-  if (int error = loadMLIR(context, module)) return error;
-
-  mlir::PassManager pm(&context);
-  // Apply any generic pass manager command line options and run the pipeline.
-  applyPassManagerCLOptions(pm);
-
-  // Check to see what granularity of MLIR we are compiling to.
-  bool isLoweringToAffine = emitAction >= Action::DumpMLIRAffine;
-  bool isLoweringToLLVM = emitAction >= Action::DumpMLIRLLVM;
+int main(int argc, char **argv) {
+  // Register any command line options.
+  mlir::registerAsmPrinterCLOptions();
+  mlir::registerMLIRContextCLOptions();
+  mlir::registerPassManagerCLOptions();
 
-  if (enableOpt || isLoweringToAffine) {
-    // Inline all functions into main and then delete them.
-    pm.addPass(mlir::createInlinerPass());
+  cl::ParseCommandLineOptions(argc, argv, "pony compiler\n");
 
-    // Now that there is only one function, we can infer the shapes of each of
-    // the operations.
-    mlir::OpPassManager &optPM = pm.nest<mlir::pony::FuncOp>();
-    optPM.addPass(mlir::pony::createShapeInferencePass());
-    optPM.addPass(mlir::createCanonicalizerPass());
-    optPM.addPass(mlir::createCSEPass());
+  if (!llvm::StringRef("0123s").contains(optLevel)) {
+    llvm::errs() << "Unknown optimization level -O" << optLevel << "\n";
+    return -1;
   }
-
-  if (isLoweringToAffine) {
-    // Partially lower the pony dialect.
-    pm.addPass(mlir::pony::createLowerToAffinePass());
-
-    // Add a few cleanups post lowering.
-    mlir::OpPassManager &optPM = pm.nest<mlir::FuncOp>();
-    optPM.addPass(mlir::createCanonicalizerPass());
-    optPM.addPass(mlir::createCSEPass());
-
-    // Add optimizations if enabled.
-    if (enableOpt) {
-      optPM.addPass(mlir::createLoopFusionPass());
-      optPM.addPass(mlir::createAffineScalarReplacementPass());
+  DriverOptions options = getDriverOptions();
+
+  // Write the trace out however the driver returns. The root scope is declared
+  // after, so it is recorded before the trace is written.
+  std::unique_ptr<Tracer> tracer;
+  if (!options.traceFile.empty())
+    tracer = std::make_unique<Tracer>();
+  options.tracer = tracer.get();
+  auto writeTrace = llvm::make_scope_exit([&] {
+    if (!tracer)
+      return;
+    std::string errorMessage;
+    auto output = mlir::openOutputFile(options.traceFile, &errorMessage);
+    if (!output) {
+      llvm::errs() << errorMessage << "\n";
+      return;
     }
-  }
-
-  if (isLoweringToLLVM) {
-    // Finish lowering the pony IR to the LLVM dialect.
-    pm.addPass(mlir::pony::createLowerToLLVMPass());
-  }
-
-  if (mlir::failed(pm.run(*module))) return 4;
-  return 0;
-}
+    tracer->write(output->os());
+    output->keep();
+  });
+  TraceScope rootScope(options.tracer, "ponyc");
+
+  // Likewise report the size of the IR once the driver is done with it.
+  std::unique_ptr<IRStats> irStatsRecorder;
+  if (options.irStats || !options.irStatsJSONFile.empty())
+    irStatsRecorder = std::make_unique<IRStats>();
+  options.irStatsRecorder = irStatsRecorder.get();
+  auto reportIRStats = llvm::make_scope_exit([&] {
+    if (!irStatsRecorder)
+      return;
+    if (options.irStats)
+      irStatsRecorder->print(llvm::errs());
+    if (options.irStatsJSONFile.empty())
+      return;
+    std::string errorMessage;
+    auto output =
+        mlir::openOutputFile(options.irStatsJSONFile, &errorMessage);
+    if (!output) {
+      llvm::errs() << errorMessage << "\n";
+      return;
+    }
+    irStatsRecorder->writeJSON(output->os());
+    output->keep();
+  });
 
-int dumpToken() {
-  
-  if (inputType == InputType::MLIR) {
-    llvm::errs() << "Can't dump Pony Tokens when the input is MLIR\n";
-    return 5;
+  if (options.repeat == 0) {
+    llvm::errs() << "-repeat must be at least 1\n";
+    return -1;
   }
-  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
-      llvm::MemoryBuffer::getFileOrSTDIN(inputFilename);
-  if (std::error_code ec = fileOrErr.getError()) {
-    llvm::errs() << "Could not open input file: " << ec.message() << "\n";
-    return 0;
+  if (isBenchmarking(options) &&
+      (options.action != Action::RunJIT || options.fastCompile ||
+       options.jitLazy || options.jitStartupTime ||
+       !options.jitCacheDir.empty() || options.incremental ||
+       options.codegenThreads > 1)) {
+    llvm::errs() << "-repeat, -warmup, -main-arg and -perf-counters need "
+                    "-emit=jit, without -fast-compile, -jit-lazy, "
+                    "-jit-startup-time, -jit-cache-dir, -incremental or "
+                    "-codegen-threads\n";
+    return -1;
   }
-  auto buffer = fileOrErr.get()->getBuffer();
-  // 初始化lexer
-  LexerBuffer lexer(buffer.begin(), buffer.end(), std::string(inputFilename));
-
-  lexer.getNextToken();  // prime the lexer
-
-  // Consume and record all tokens until EOF
-  while (lexer.getCurToken() != pony::tok_eof) {
-    lexer.getNextToken();
+  if (options.fastCompile &&
+      (interactive || options.incremental ||
+       options.action == Action::DumpMLIRAffine ||
+       options.action == Action::DumpMLIRLLVM)) {
+    llvm::errs() << "-fast-compile can't be used with -repl, -incremental, "
+                    "-emit=mlir-affine or -emit=mlir-llvm\n";
+    return -1;
   }
-  // Include the EOF token
-  // lexer.getNextToken();
-
-  // If any lexical errors were detected, report and exit
-  if (lexer.hadLexError()) {
-    llvm::errs() << "\n Lexical analysis encountered errors.\n";
-    return 1;
+  bool isInstrumented =
+      options.compile.profileOps || options.compile.trackAllocations;
+  if (isInstrumented &&
+      (options.fastCompile || options.action == Action::Interpret)) {
+    llvm::errs() << "-profile-ops and -track-allocs instrument the code of the "
+                    "full pipeline, they can't be used with -fast-compile or "
+                    "-emit=interp\n";
+    return -1;
   }
-
-
-  // Otherwise, print all recorded tokens in order
-  // auto tokens = lexer.getRecordedTokens();
-  // for (auto tok : tokens) {
-  //   std::string name;
-  //   switch (tok) {
-  //   case pony::tok_eof:             name = "EOF"; break;
-  //   case pony::tok_return:          name = "return"; break;
-  //   case pony::tok_var:             name = "var"; break;
-  //   case pony::tok_def:             name = "def"; break;
-  //   case pony::tok_identifier:      name = "identifier"; break;
-  //   case pony::tok_number:          name = "number"; break;
-  //   case pony::tok_semicolon:       name = ";"; break;
-  //   case pony::tok_parenthese_open: name = "("; break;
-  //   case pony::tok_parenthese_close:name = ")"; break;
-  //   case pony::tok_bracket_open:    name = "{"; break;
-  //   case pony::tok_bracket_close:   name = "}"; break;
-  //   case pony::tok_sbracket_open:   name = "["; break;
-  //   case pony::tok_sbracket_close:  name = "]"; break;
-  //   case pony::tok_comma:          name = ","; break;
-  //   default:
-  //     // For other single-character tokens
-  //     name += char(tok); //output directly
-  //   }
-  //   llvm::outs() << name << ' ';
-  // }
-  return 0;
-}
-
-int dumpAST() {
-  if (inputType == InputType::MLIR) {
-    llvm::errs() << "Can't dump a Pony AST when the input is MLIR\n";
-    return 5;
+  if (options.jitLazy &&
+      (!options.jitCacheDir.empty() || options.incremental)) {
+    llvm::errs() << "-jit-lazy can't be used with -jit-cache-dir or "
+                    "-incremental\n";
+    return -1;
   }
-
-  auto moduleAST = parseInputFile(inputFilename);
-  if (!moduleAST) return 1;
-
-  dump(*moduleAST);
-  return 0;
-}
-
-int dumpLLVMIR(mlir::ModuleOp module) {
-  // Register the translation to LLVM IR with the MLIR context.
-  mlir::registerLLVMDialectTranslation(*module->getContext());
-  // Convert the module to LLVM IR in a new LLVM IR context.
-  llvm::LLVMContext llvmContext;
-  auto llvmModule = mlir::translateModuleToLLVMIR(module, llvmContext);
-  if (!llvmModule) {
-    llvm::errs() << "Failed to emit LLVM IR\n";
+  if (options.codegenThreads == 0) {
+    llvm::errs() << "-codegen-threads must be at least 1\n";
     return -1;
   }
-
-  // Initialize LLVM targets.
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmPrinter();
-  mlir::ExecutionEngine::setupTargetTriple(llvmModule.get());
-
-  /// Optionally run an optimization pipeline over the llvm module.
-  auto optPipeline = mlir::makeOptimizingTransformer(
-      /*optLevel=*/enableOpt ? 3 : 0, /*sizeLevel=*/0,
-      /*targetMachine=*/nullptr);
-  if (auto err = optPipeline(llvmModule.get())) {
-    llvm::errs() << "Failed to optimize LLVM IR " << err << "\n";
+  if (options.codegenThreads > 1 &&
+      (options.jitLazy || options.jitStartupTime ||
+       !options.jitCacheDir.empty())) {
+    llvm::errs() << "-codegen-threads can't be used with -jit-lazy, "
+                    "-jit-startup-time or -jit-cache-dir\n";
     return -1;
   }
-  llvm::errs() << *llvmModule << "\n";
-  return 0;
-}
-
-int runJit(mlir::ModuleOp module) {
-  // Initialize LLVM targets.
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmPrinter();
-
-  // Register the translation from MLIR to LLVM IR, which must happen before we
-  // can JIT-compile.
-  mlir::registerLLVMDialectTranslation(*module->getContext());
 
-  // An optimization pipeline to use within the execution engine.
-  auto optPipeline = mlir::makeOptimizingTransformer(
-      /*optLevel=*/enableOpt ? 3 : 0, /*sizeLevel=*/0,
-      /*targetMachine=*/nullptr);
-
-  // Create an MLIR execution engine. The execution engine eagerly JIT-compiles
-  // the module.
-  mlir::ExecutionEngineOptions engineOptions;
-  engineOptions.transformer = optPipeline;
-  auto maybeEngine = mlir::ExecutionEngine::create(module, engineOptions);
-  assert(maybeEngine && "failed to construct an execution engine");
-  auto &engine = maybeEngine.get();
-
-  // Invoke the JIT-compiled function.
-  auto invocationResult = engine->invokePacked("main");
-  if (invocationResult) {
-    llvm::errs() << "JIT invocation failed\n";
+  if (interactive)
+    return runRepl(options);
+  if (serve)
+    return runCompileServer(
+        [&](llvm::StringRef source, std::string &output) {
+          return serveRequest(options, source, output);
+        },
+        serveSocket, serveWorkers);
+
+  // Compile several files at once, or carry on with the single input.
+  std::vector<std::string> inputs(inputFilenames.begin(),
+                                  inputFilenames.end());
+  if (!manifestFilename.empty() && !readManifest(manifestFilename, inputs))
+    return -1;
+  if (inputs.size() > 1 || !manifestFilename.empty())
+    return compileBatch(options, inputs);
+  if (!inputs.empty())
+    options.inputFilename = inputs.front();
+
+  if (options.incremental &&
+      (options.action != Action::RunJIT || options.jitCacheDir.empty() ||
+       options.inputType == InputType::MLIR ||
+       llvm::StringRef(options.inputFilename).endswith(".mlir"))) {
+    llvm::errs() << "-incremental needs a Pony input, -emit=jit and "
+                    "-jit-cache-dir\n";
     return -1;
   }
 
-  return 0;
+  return compileInput(options);
 }
-
-int main(int argc, char **argv) {
-  // Register any command line options.
-  mlir::registerAsmPrinterCLOptions();
-  mlir::registerMLIRContextCLOptions();
-  mlir::registerPassManagerCLOptions();
-
-  cl::ParseCommandLineOptions(argc, argv, "pony compiler\n");
-
-  if (emitAction == Action::DumpToken) return dumpToken();
-
-  if (emitAction == Action::DumpAST) return dumpAST();
-
-  // If we aren't dumping the AST, then we are compiling with/to MLIR.
-
-  mlir::MLIRContext context;
-  // Load our Dialect in this MLIR Context.
-  context.getOrLoadDialect<mlir::pony::PonyDialect>();
-
-  mlir::OwningOpRef<mlir::ModuleOp> module;
-  if (int error = loadAndProcessMLIR(context, module)) return error;
-
-  // If we aren't exporting to non-mlir, then we are done.
-  bool isOutputingMLIR = emitAction <= Action::DumpMLIRLLVM;
-  if (isOutputingMLIR) {
-    module->dump();
-    return 0;
-  }
-
-  // Check to see if we are compiling to LLVM IR.
-  if (emitAction == Action::DumpLLVMIR) return dumpLLVMIR(*module);
-
-  // Otherwise, we must be running the jit.
-  if (emitAction == Action::RunJIT) return runJit(*module);
-
-  llvm::errs() << "No action specified (parsing only?), use -emit=<action>\n";
-  return -1;
-}
\ No newline at end of file
@@ -0,0 +1,441 @@
+//===- PonyRuntime.cpp - Runtime support library for Pony programs --------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the runtime entry points declared in pony/Runtime.h.
+// Tensor printing formats every element into a large buffer and flushes it
+// with a handful of `write` calls instead of one `printf` per element. The
+// profile of -profile-ops is a table keyed by operation and source location,
+// reported at exit, and so are the allocations of -track-allocs.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Runtime.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace pony;
+
+namespace {
+
+/// Where the output of the current thread goes, see `pony_set_output`.
+thread_local pony_output_fn outputFn = nullptr;
+thread_local void *outputContext = nullptr;
+
+/// Accumulates output in a fixed-size buffer and hands it to `write(2)` only
+/// when full or when the writer goes out of scope.
+class BufferedWriter {
+public:
+  BufferedWriter(int fd) : fd(fd) {
+    // Anything already sitting in stdio buffers has to come out first to keep
+    // the ordering of mixed output intact.
+    fflush(stdout);
+  }
+  ~BufferedWriter() { flush(); }
+
+  /// Reserve room for `count` characters and return where to put them.
+  char *reserve(size_t count) {
+    if (size + count > sizeof(buffer))
+      flush();
+    return buffer + size;
+  }
+  void commit(size_t count) { size += count; }
+
+  void append(char c) {
+    *reserve(1) = c;
+    commit(1);
+  }
+
+  /// Write `count` characters, bypassing the buffer for large chunks.
+  void write(const char *data, size_t count) {
+    if (size + count <= sizeof(buffer)) {
+      memcpy(reserve(count), data, count);
+      commit(count);
+      return;
+    }
+    flush();
+    writeAll(data, count);
+  }
+
+  void flush() {
+    writeAll(buffer, size);
+    size = 0;
+  }
+
+private:
+  void writeAll(const char *data, size_t count) {
+    if (outputFn) {
+      if (count)
+        outputFn(outputContext, data, count);
+      return;
+    }
+    while (count) {
+      ssize_t written = ::write(fd, data, count);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        break;
+      }
+      data += written;
+      count -= written;
+    }
+  }
+
+  int fd;
+  size_t size = 0;
+  char buffer[1 << 16];
+};
+
+/// Write the decimal digits of `value` to `out` and return how many there are.
+size_t formatUnsigned(uint64_t value, char *out) {
+  char digits[20];
+  size_t count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  for (size_t i = 0; i != count; ++i)
+    out[i] = digits[count - 1 - i];
+  return count;
+}
+
+/// Recursively walk the dimensions of a strided buffer, mirroring the loop
+/// nest the old `printf` lowering generated.
+void printDimension(BufferedWriter &writer, const double *data, int64_t dim,
+                    int64_t rank, const int64_t *sizes,
+                    const int64_t *strides) {
+  if (dim == rank) {
+    char *out = writer.reserve(kFormatF64MaxLength + 1);
+    size_t length = pony_format_f64(*data, out);
+    out[length++] = ' ';
+    writer.commit(length);
+    return;
+  }
+
+  for (int64_t i = 0, e = sizes[dim]; i != e; ++i) {
+    printDimension(writer, data + i * strides[dim], dim + 1, rank, sizes,
+                   strides);
+    // Insert a newline after each of the inner dimensions of the shape.
+    if (dim != rank - 1)
+      writer.append('\n');
+  }
+}
+
+/// Read the cycle counter, or a nanosecond clock where there is none.
+int64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+/// What the profile accumulates for an operation at a source location.
+struct ProfileEntry {
+  uint64_t cycles = 0;
+  uint64_t calls = 0;
+  uint64_t flops = 0;
+  uint64_t bytes = 0;
+};
+
+/// The profile of the program, and the cycle count and time of its first
+/// record, which together with those of the report convert cycles to time.
+struct Profile {
+  using Key = std::tuple<std::string, int64_t, int64_t, std::string>;
+
+  std::mutex mutex;
+  std::map<Key, ProfileEntry> entries;
+  int64_t firstCycles = 0;
+  std::chrono::steady_clock::time_point firstTime;
+};
+
+Profile &getProfile() {
+  // Never destroyed, so that the report at exit can still read it.
+  static Profile *profile = new Profile;
+  return *profile;
+}
+
+/// What was allocated at a source location.
+struct AllocationSite {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+  uint64_t liveBytes = 0;
+  uint64_t peakBytes = 0;
+};
+
+/// The memory allocated through `pony_alloc`, by live buffer and by source
+/// location.
+struct AllocationTracker {
+  using Key = std::tuple<std::string, int64_t, int64_t>;
+  struct Allocation {
+    uint64_t size;
+    AllocationSite *site;
+  };
+
+  std::mutex mutex;
+  std::map<Key, AllocationSite> sites;
+  std::unordered_map<void *, Allocation> live;
+  uint64_t liveBytes = 0;
+  uint64_t peakBytes = 0;
+};
+
+AllocationTracker &getAllocationTracker() {
+  // Never destroyed, so that the report at exit can still read it.
+  static AllocationTracker *tracker = new AllocationTracker;
+  return *tracker;
+}
+
+} // namespace
+
+size_t pony_format_f64(double value, char *out) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  bool negative = bits >> 63;
+  int exponent = (bits >> 52) & 0x7ff;
+  uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+
+#if defined(__SIZEOF_INT128__)
+  // The value is exactly `mantissa * 2^exponent`. Scaling it by 10^6 and
+  // rounding half-to-even reproduces glibc's correctly rounded `%f`, without
+  // going through the varargs machinery. Infinities, NaNs and integers that
+  // don't fit in 64 bits take the slow path below.
+  bool fastPath = exponent != 0x7ff;
+  uint64_t scaledInt = 0, scaledFrac = 0;
+  if (fastPath && (exponent != 0 || mantissa != 0)) {
+    if (exponent == 0)
+      exponent = 1;
+    else
+      mantissa |= uint64_t(1) << 52;
+    exponent -= 1075;
+
+    if (exponent >= 0) {
+      // mantissa < 2^53, so shifting by at most 10 keeps the value in range.
+      fastPath = exponent <= 10;
+      scaledInt = mantissa << (fastPath ? exponent : 0);
+    } else {
+      // mantissa * 10^6 < 2^73: anything shifted right by more than 74 bits is
+      // below one half and rounds to zero.
+      int shift = -exponent;
+      unsigned __int128 scaled = 0;
+      if (shift <= 74) {
+        unsigned __int128 product = (unsigned __int128)mantissa * 1000000;
+        unsigned __int128 half = (unsigned __int128)1 << (shift - 1);
+        unsigned __int128 remainder = product & ((half << 1) - 1);
+        scaled = product >> shift;
+        if (remainder > half || (remainder == half && (scaled & 1)))
+          ++scaled;
+      }
+      scaledInt = (uint64_t)(scaled / 1000000);
+      scaledFrac = (uint64_t)(scaled % 1000000);
+    }
+  }
+
+  if (fastPath) {
+    size_t length = 0;
+    if (negative)
+      out[length++] = '-';
+    length += formatUnsigned(scaledInt, out + length);
+    out[length++] = '.';
+    for (int i = 5; i >= 0; --i) {
+      out[length + i] = '0' + scaledFrac % 10;
+      scaledFrac /= 10;
+    }
+    return length + 6;
+  }
+#endif
+
+  int length = snprintf(out, kFormatF64MaxLength, "%f", value);
+  return length < 0 ? 0 : static_cast<size_t>(length);
+}
+
+void pony_print_memref(double *data, int64_t rank, const int64_t *sizes,
+                       const int64_t *strides) {
+  BufferedWriter writer(STDOUT_FILENO);
+  printDimension(writer, data, /*dim=*/0, rank, sizes, strides);
+}
+
+void pony_print_string(const char *data, int64_t length) {
+  BufferedWriter writer(STDOUT_FILENO);
+  writer.write(data, length);
+}
+
+void pony_set_output(pony_output_fn fn, void *context) {
+  outputFn = fn;
+  outputContext = context;
+}
+
+int64_t pony_profile_start(void) { return readCycleCounter(); }
+
+void pony_profile_end(int64_t start, const char *op, const char *file,
+                      int64_t line, int64_t col, int64_t flops,
+                      int64_t bytes) {
+  int64_t end = readCycleCounter();
+  Profile &profile = getProfile();
+  std::lock_guard<std::mutex> lock(profile.mutex);
+  if (profile.entries.empty()) {
+    profile.firstCycles = end;
+    profile.firstTime = std::chrono::steady_clock::now();
+    static bool registered = atexit(pony_profile_report) == 0;
+    (void)registered;
+  }
+  ProfileEntry &entry = profile.entries[{file, line, col, op}];
+  entry.cycles += end - start;
+  entry.calls += 1;
+  entry.flops += flops;
+  entry.bytes += bytes;
+}
+
+void pony_profile_report(void) {
+  Profile &profile = getProfile();
+  std::lock_guard<std::mutex> lock(profile.mutex);
+  if (profile.entries.empty())
+    return;
+
+  // Nanoseconds per cycle, measured from the first record until now.
+  int64_t cycles = readCycleCounter() - profile.firstCycles;
+  double nanoseconds = std::chrono::duration<double, std::nano>(
+                           std::chrono::steady_clock::now() - profile.firstTime)
+                           .count();
+  double nsPerCycle = cycles > 0 ? nanoseconds / cycles : 1.0;
+
+  using Entry = std::pair<const Profile::Key, ProfileEntry>;
+  std::vector<const Entry *> sorted;
+  uint64_t totalCycles = 0;
+  for (const Entry &entry : profile.entries) {
+    sorted.push_back(&entry);
+    totalCycles += entry.second.cycles;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Entry *lhs, const Entry *rhs) {
+                     return lhs->second.cycles > rhs->second.cycles;
+                   });
+
+  fflush(stdout);
+  fprintf(stderr, "===-------------------------------------------------------"
+                  "------------------===\n"
+                  "                         Pony operation profile\n"
+                  "===-------------------------------------------------------"
+                  "------------------===\n"
+                  "  %10s  %6s  %8s  %12s  %12s  %8s  %8s  %s\n",
+          "Time (ms)", "%", "Calls", "FLOPs", "Bytes", "GFLOP/s", "GB/s",
+          "Location");
+  for (const Entry *entry : sorted) {
+    const std::string &file = std::get<0>(entry->first);
+    int64_t line = std::get<1>(entry->first);
+    int64_t col = std::get<2>(entry->first);
+    const std::string &op = std::get<3>(entry->first);
+    const ProfileEntry &stats = entry->second;
+    double ns = stats.cycles * nsPerCycle;
+    fprintf(stderr,
+            "  %10.3f  %5.1f%%  %8llu  %12llu  %12llu  %8.2f  %8.2f  "
+            "%s:%lld:%lld %s\n",
+            ns / 1e6, totalCycles ? 100.0 * stats.cycles / totalCycles : 0.0,
+            (unsigned long long)stats.calls, (unsigned long long)stats.flops,
+            (unsigned long long)stats.bytes, ns > 0 ? stats.flops / ns : 0.0,
+            ns > 0 ? stats.bytes / ns : 0.0, file.c_str(), (long long)line,
+            (long long)col, op.c_str());
+  }
+}
+
+void *pony_alloc(int64_t size, const char *file, int64_t line, int64_t col) {
+  void *ptr = malloc(size);
+  if (!ptr)
+    return nullptr;
+  AllocationTracker &tracker = getAllocationTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  if (tracker.sites.empty()) {
+    static bool registered = atexit(pony_alloc_report) == 0;
+    (void)registered;
+  }
+  AllocationSite &site = tracker.sites[{file, line, col}];
+  site.allocations += 1;
+  site.bytes += size;
+  site.liveBytes += size;
+  site.peakBytes = std::max(site.peakBytes, site.liveBytes);
+  tracker.live[ptr] = {(uint64_t)size, &site};
+  tracker.liveBytes += size;
+  tracker.peakBytes = std::max(tracker.peakBytes, tracker.liveBytes);
+  return ptr;
+}
+
+void pony_free(void *ptr) {
+  if (ptr) {
+    AllocationTracker &tracker = getAllocationTracker();
+    std::lock_guard<std::mutex> lock(tracker.mutex);
+    auto it = tracker.live.find(ptr);
+    if (it != tracker.live.end()) {
+      it->second.site->liveBytes -= it->second.size;
+      tracker.liveBytes -= it->second.size;
+      tracker.live.erase(it);
+    }
+  }
+  free(ptr);
+}
+
+void pony_alloc_report(void) {
+  AllocationTracker &tracker = getAllocationTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  if (tracker.sites.empty())
+    return;
+
+  using Entry = std::pair<const AllocationTracker::Key, AllocationSite>;
+  std::vector<const Entry *> sorted;
+  uint64_t allocations = 0;
+  for (const Entry &entry : tracker.sites) {
+    sorted.push_back(&entry);
+    allocations += entry.second.allocations;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Entry *lhs, const Entry *rhs) {
+                     return lhs->second.peakBytes > rhs->second.peakBytes;
+                   });
+
+  // Buffers still live at exit are the ones handed over to the host, or
+  // leaked.
+  fflush(stdout);
+  fprintf(stderr,
+          "===-------------------------------------------------------"
+          "------------------===\n"
+          "                         Pony allocation report\n"
+          "===-------------------------------------------------------"
+          "------------------===\n"
+          "  Peak live memory: %llu bytes\n"
+          "  Allocations: %llu\n"
+          "  Live at exit: %llu bytes in %llu buffers\n\n"
+          "  %12s  %14s  %14s  %14s  %s\n",
+          (unsigned long long)tracker.peakBytes,
+          (unsigned long long)allocations,
+          (unsigned long long)tracker.liveBytes,
+          (unsigned long long)tracker.live.size(), "Allocations", "Bytes",
+          "Peak live", "Live at exit", "Location");
+  for (const Entry *entry : sorted) {
+    const std::string &file = std::get<0>(entry->first);
+    int64_t line = std::get<1>(entry->first);
+    int64_t col = std::get<2>(entry->first);
+    const AllocationSite &site = entry->second;
+    fprintf(stderr, "  %12llu  %14llu  %14llu  %14llu  %s:%lld:%lld\n",
+            (unsigned long long)site.allocations,
+            (unsigned long long)site.bytes,
+            (unsigned long long)site.peakBytes,
+            (unsigned long long)site.liveBytes, file.c_str(), (long long)line,
+            (long long)col);
+  }
+}
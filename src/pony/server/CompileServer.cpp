@@ -0,0 +1,206 @@
+//===- CompileServer.cpp - Long-lived compile-and-run server --------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the transport of `ponyc -serve`.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/CompileServer.h"
+
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace pony;
+
+namespace {
+
+/// One stream of requests and responses: stdin and stdout, or a socket.
+class Connection {
+public:
+  Connection(int inputFd, int outputFd, bool ownsFds)
+      : inputFd(inputFd), outputFd(outputFd), ownsFds(ownsFds) {}
+  ~Connection() {
+    if (ownsFds)
+      close(inputFd);
+  }
+
+  /// Read the next request. Returns false at end of input or on a malformed
+  /// frame.
+  bool readRequest(std::string &id, std::string &source) {
+    std::string header;
+    if (!readLine(header))
+      return false;
+    llvm::StringRef idStr, lengthStr;
+    std::tie(idStr, lengthStr) = llvm::StringRef(header).split(' ');
+    size_t length;
+    if (idStr.empty() || lengthStr.getAsInteger(10, length)) {
+      llvm::errs() << "Malformed request header '" << header << "'\n";
+      return false;
+    }
+    id = idStr.str();
+    return readBytes(length, source);
+  }
+
+  /// Send a response. Safe to call from any thread.
+  void respond(llvm::StringRef id, int status, llvm::StringRef output) {
+    std::string frame;
+    llvm::raw_string_ostream os(frame);
+    os << id << ' ' << status << ' ' << output.size() << '\n' << output;
+    os.flush();
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    const char *data = frame.data();
+    size_t count = frame.size();
+    while (count) {
+      ssize_t written = ::write(outputFd, data, count);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        // The client went away, there is nobody left to tell.
+        return;
+      }
+      data += written;
+      count -= written;
+    }
+  }
+
+private:
+  /// Make sure the buffer holds at least one unread byte.
+  bool fill() {
+    if (position != buffer.size())
+      return true;
+    buffer.resize(1 << 16);
+    position = 0;
+    while (true) {
+      ssize_t count = ::read(inputFd, &buffer[0], buffer.size());
+      if (count < 0 && errno == EINTR)
+        continue;
+      buffer.resize(count > 0 ? count : 0);
+      return count > 0;
+    }
+  }
+
+  bool readLine(std::string &line) {
+    line.clear();
+    while (fill()) {
+      size_t newline = buffer.find('\n', position);
+      size_t end = newline == std::string::npos ? buffer.size() : newline;
+      line.append(buffer, position, end - position);
+      position = end;
+      if (newline != std::string::npos) {
+        ++position;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool readBytes(size_t count, std::string &out) {
+    out.clear();
+    out.reserve(count);
+    while (out.size() != count) {
+      if (!fill())
+        return false;
+      size_t chunk = std::min(count - out.size(), buffer.size() - position);
+      out.append(buffer, position, chunk);
+      position += chunk;
+    }
+    return true;
+  }
+
+  int inputFd, outputFd;
+  bool ownsFds;
+  std::string buffer;
+  size_t position = 0;
+  std::mutex writeMutex;
+};
+
+/// Read every request of `connection` and queue it on `pool`.
+void serveConnection(const RequestHandler &handler, llvm::ThreadPool &pool,
+                     std::shared_ptr<Connection> connection) {
+  std::string id, source;
+  while (connection->readRequest(id, source)) {
+    pool.async([&handler, connection, id, source] {
+      std::string output;
+      int status = handler(source, output);
+      connection->respond(id, status, output);
+    });
+  }
+}
+
+/// Listen on a unix domain socket at `path`, serving each client from a
+/// thread of its own, which queues the client's requests on `pool`.
+int serveSocket(const RequestHandler &handler, llvm::ThreadPool &pool,
+                llvm::StringRef path) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    llvm::errs() << "Socket path '" << path << "' is too long\n";
+    return -1;
+  }
+  memcpy(address.sun_path, path.data(), path.size());
+
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0) {
+    llvm::errs() << "Could not create a socket: " << strerror(errno) << "\n";
+    return -1;
+  }
+  // Replace the socket of a server that didn't shut down cleanly.
+  unlink(address.sun_path);
+  if (bind(listenFd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listenFd, SOMAXCONN) < 0) {
+    llvm::errs() << "Could not listen on '" << path
+                 << "': " << strerror(errno) << "\n";
+    close(listenFd);
+    return -1;
+  }
+
+  while (true) {
+    int clientFd = accept(listenFd, nullptr, nullptr);
+    if (clientFd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      llvm::errs() << "Could not accept a connection: " << strerror(errno)
+                   << "\n";
+      close(listenFd);
+      return -1;
+    }
+    auto connection =
+        std::make_shared<Connection>(clientFd, clientFd, /*ownsFds=*/true);
+    std::thread(serveConnection, std::cref(handler), std::ref(pool),
+                std::move(connection))
+        .detach();
+  }
+}
+
+} // namespace
+
+int pony::runCompileServer(const RequestHandler &handler,
+                           llvm::StringRef socketPath, unsigned numWorkers) {
+  // A client hanging up must not take the server down with it.
+  signal(SIGPIPE, SIG_IGN);
+
+  llvm::ThreadPool pool(llvm::hardware_concurrency(numWorkers));
+  if (!socketPath.empty())
+    return serveSocket(handler, pool, socketPath);
+
+  serveConnection(handler, pool,
+                  std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO,
+                                               /*ownsFds=*/false));
+  pool.wait();
+  return 0;
+}
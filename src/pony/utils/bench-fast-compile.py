@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Compare the compile latency of the fast back end with the full pipeline.
+
+For every input, measures the time ahead-of-time compilation to an object
+takes at -O0 through the affine and LLVM dialects, then with -fast-compile,
+checks that both programs print the same, and prints the times as a Markdown
+table:
+
+  bench-fast-compile.py --pony build/bin/pony test/*.pony
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BACKENDS = [("full pipeline", []), ("-fast-compile", ["-fast-compile"])]
+
+
+def best_time(fn, repeat):
+    """Return the shortest of `repeat` runs of `fn`, in milliseconds."""
+    times = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        fn()
+        times.append((time.perf_counter() - start) * 1000)
+    return min(times)
+
+
+def compile_time(pony, source, flags, output, repeat):
+    command = [pony, source, "-emit=obj", "-O0", "-o", output] + flags
+
+    def run():
+        subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+
+    return best_time(run, repeat)
+
+
+def run_output(pony, source, flags):
+    result = subprocess.run(
+        [pony, source, "-emit=jit", "-O0", "-interp-threshold=0"] + flags,
+        check=True, capture_output=True, text=True)
+    return result.stdout
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("inputs", nargs="+", help="Pony programs to compile")
+    parser.add_argument("--pony", default="pony", help="the pony compiler")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="runs per measurement, the fastest is reported")
+    args = parser.parse_args()
+
+    times = {}
+    mismatches = 0
+    with tempfile.TemporaryDirectory() as directory:
+        output = os.path.join(directory, "out.o")
+        for source in args.inputs:
+            for name, flags in BACKENDS:
+                times[source, name] = compile_time(args.pony, source, flags,
+                                                   output, args.repeat)
+            outputs = [run_output(args.pony, source, flags)
+                       for _, flags in BACKENDS]
+            if outputs[0] != outputs[1]:
+                mismatches += 1
+                print(f"{source}: -fast-compile changes the output",
+                      file=sys.stderr)
+
+    names = [name for name, _ in BACKENDS]
+    print("### Compile time at -O0 (ms)\n")
+    print("| Input | " + " | ".join(names) + " | speedup |")
+    print("|---" * (len(names) + 2) + "|")
+    for source in args.inputs:
+        row = [times[source, name] for name in names]
+        print(f"| {os.path.basename(source)} | " +
+              " | ".join(f"{t:.2f}" for t in row) +
+              f" | {row[0] / row[1]:.2f}x |")
+    geomeans = [
+        statistics.geometric_mean(times[source, name] for source in args.inputs)
+        for name in names
+    ]
+    print("| geomean | " + " | ".join(f"{g:.2f}" for g in geomeans) +
+          f" | {geomeans[0] / geomeans[1]:.2f}x |")
+    return 1 if mismatches else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Compare the optimization levels of the Pony compiler.
+
+For every input and every level, measures the time ahead-of-time compilation
+to a shared library takes, then the time running the `main` function of the
+program, which the library exports as `pony_main`, takes, and prints both as
+Markdown tables:
+
+  bench-opt-levels.py --pony build/bin/pony test/*.pony
+"""
+
+import argparse
+import ctypes
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+LEVELS = ["-O0", "-O1", "-O2", "-Os", "-O3"]
+
+
+def best_time(fn, repeat):
+    """Return the shortest of `repeat` runs of `fn`, in milliseconds."""
+    times = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        fn()
+        times.append((time.perf_counter() - start) * 1000)
+    return min(times)
+
+
+def compile_time(pony, source, level, output, repeat):
+    command = [pony, source, "-emit=shared", level, "-o", output]
+
+    def run():
+        subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+
+    return best_time(run, repeat)
+
+
+def run_time(library, repeat):
+    # Run main in a child process so that what it prints can be discarded.
+    result = subprocess.run(
+        [sys.executable, __file__, "--run-main", library, "--repeat",
+         str(repeat)],
+        check=True, capture_output=True, text=True)
+    return float(result.stderr.strip().splitlines()[-1])
+
+
+def run_main(library, repeat):
+    """Time the `main` of `library`, printing the milliseconds to stderr."""
+    main = ctypes.CDLL(os.path.abspath(library)).pony_main
+    devnull = os.open(os.devnull, os.O_WRONLY)
+    os.dup2(devnull, 1)
+    print(best_time(main, repeat), file=sys.stderr)
+
+
+def print_table(title, inputs, results):
+    print(f"### {title} (ms)\n")
+    print("| Input | " + " | ".join(LEVELS) + " |")
+    print("|---" * (len(LEVELS) + 1) + "|")
+    for source in inputs:
+        row = [f"{results[source, level]:.2f}" for level in LEVELS]
+        print(f"| {os.path.basename(source)} | " + " | ".join(row) + " |")
+    geomeans = [
+        statistics.geometric_mean(results[source, level] for source in inputs)
+        for level in LEVELS
+    ]
+    print("| geomean | " + " | ".join(f"{g:.2f}" for g in geomeans) + " |\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("inputs", nargs="*", help="Pony programs to compile")
+    parser.add_argument("--pony", default="pony", help="the pony compiler")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="runs per measurement, the fastest is reported")
+    parser.add_argument("--run-main", metavar="LIBRARY", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.run_main:
+        run_main(args.run_main, args.repeat)
+        return
+
+    compile_times = {}
+    run_times = {}
+    with tempfile.TemporaryDirectory() as directory:
+        for source in args.inputs:
+            for level in LEVELS:
+                library = os.path.join(
+                    directory,
+                    os.path.basename(source) + level.replace("-", ".") + ".so")
+                compile_times[source, level] = compile_time(
+                    args.pony, source, level, library, args.repeat)
+                run_times[source, level] = run_time(library, args.repeat)
+
+    print_table("Compile time", args.inputs, compile_times)
+    print_table("Run time", args.inputs, run_times)
+
+
+if __name__ == "__main__":
+    main()
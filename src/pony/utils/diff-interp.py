@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+"""Check the compiled code of the Pony compiler against its interpreter.
+
+Runs every input once in the interpreter and once through the JIT, at every
+optimization level, and reports the inputs whose output differs. The
+interpreter computes with the kernels compile-time folding uses, so it serves
+as the reference:
+
+  diff-interp.py --pony build/bin/pony test/*.pony
+"""
+
+import argparse
+import difflib
+import subprocess
+import sys
+
+LEVELS = ["-O0", "-O1", "-O2", "-Os", "-O3"]
+
+
+def run(pony, source, args):
+    result = subprocess.run([pony, source] + args, capture_output=True,
+                            text=True)
+    return result.returncode, result.stdout
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--pony", required=True, help="the pony binary")
+    parser.add_argument("inputs", nargs="+", help="the programs to run")
+    args = parser.parse_args()
+
+    failures = 0
+    for source in args.inputs:
+        status, expected = run(args.pony, source, ["-emit=interp"])
+        if status != 0:
+            print(f"{source}: skipped, the interpreter can't run it")
+            continue
+        for level in LEVELS:
+            status, actual = run(args.pony, source,
+                                 ["-emit=jit", "-interp-threshold=0", level])
+            if status == 0 and actual == expected:
+                continue
+            failures += 1
+            print(f"{source}: {level} differs from the interpreter")
+            sys.stdout.writelines(difflib.unified_diff(
+                expected.splitlines(True), actual.splitlines(True),
+                "interp", f"jit {level}"))
+
+    print(f"{failures} mismatches")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
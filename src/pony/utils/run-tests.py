@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Run the tests of the Pony compiler and check what they produce.
+
+A test is a program under test/ whose leading comments give the commands to
+run, as in the rest of test/, each group of them followed by what every
+command of the group must produce:
+
+  # ../build/bin/pony ../test/test_14.pony -emit=jit
+  # ../build/bin/pony ../test/test_14.pony -emit=jit -opt
+  # expected output:
+  # 1.000000 2.000000
+  # ../build/bin/pony ../test/test_14.pony -emit=mlir
+  # expected errors:
+  # pony.print
+  # expected status: 0
+
+"expected output" is the exact stdout of the command, each line compared
+without its trailing spaces, and "#" alone standing for an empty line; the
+lines of "expected errors" must be found in its stderr, in that order;
+"expected status" is its exit code, 0 unless given. Other shell commands,
+preparing the inputs of the next ones, are written after "$ ".
+
+Commands run through the shell, in order, in a scratch directory of the test
+that "%t" stands for; "../build/bin/" is replaced with the directory of --pony,
+where the tools built with it are, and "../test/" with the directory of the
+test. Commands without expectations after them, like those of the older tests,
+are not run:
+
+  run-tests.py --pony build/bin/pony test/*.pony
+"""
+
+import argparse
+import difflib
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+PONY_COMMAND = re.compile(r"^(?:step \d+: )?(\.\./build/bin/.*)$")
+SHELL_COMMAND = re.compile(r"^\$ (.*)$")
+EXPECTATION = re.compile(r"^expected (output|errors|status):\s*(.*)$")
+
+
+class Group:
+    """Commands sharing the same expectations."""
+
+    def __init__(self):
+        self.commands = []
+        self.expected = False
+        self.output = None
+        self.errors = []
+        self.status = 0
+
+
+def parse(source):
+    """Return the groups of commands with expectations of `source`."""
+    groups = [Group()]
+    block = None
+    with open(source) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not line.startswith("#"):
+                break
+            text = line[2:] if line.startswith("# ") else line[1:]
+
+            expectation = EXPECTATION.match(text)
+            if expectation:
+                kind, value = expectation.groups()
+                group = groups[-1]
+                group.expected = True
+                block = None
+                if kind == "status":
+                    group.status = int(value)
+                elif kind == "output":
+                    group.output = block = []
+                else:
+                    block = group.errors
+                continue
+
+            command = PONY_COMMAND.match(text) or SHELL_COMMAND.match(text)
+            if command:
+                block = None
+                if groups[-1].expected:
+                    groups.append(Group())
+                groups[-1].commands.append(command.group(1))
+            elif block is not None:
+                block.append(text)
+    return [group for group in groups if group.expected]
+
+
+def expand(command, bin_dir, test_dir, scratch):
+    """Return `command` with the paths of this run substituted."""
+    command = command.replace("../build/bin/", shlex.quote(bin_dir + "/"))
+    command = command.replace("../test/", shlex.quote(test_dir + "/"))
+    return command.replace("%t", shlex.quote(scratch))
+
+
+def check(group, result):
+    """Return how `result` differs from the expectations of `group`."""
+    problems = []
+    if result.returncode != group.status:
+        problems.append(f"exited with {result.returncode}, expected "
+                        f"{group.status}")
+    if group.output is not None:
+        expected = [line.rstrip() for line in group.output]
+        actual = [line.rstrip() for line in result.stdout.splitlines()]
+        if actual != expected:
+            problems.append("stdout differs:\n" + "\n".join(
+                difflib.unified_diff(expected, actual, "expected", "actual",
+                                     lineterm="")))
+    position = 0
+    for error in group.errors:
+        found = result.stderr.find(error, position)
+        if found < 0:
+            problems.append(f"stderr misses '{error}':\n{result.stderr}")
+            break
+        position = found + len(error)
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--pony", required=True, help="the pony binary")
+    parser.add_argument("inputs", nargs="+", help="the tests to run")
+    args = parser.parse_args()
+    bin_dir = os.path.dirname(os.path.abspath(args.pony))
+
+    commands = 0
+    failures = 0
+    for source in args.inputs:
+        test_dir = os.path.dirname(os.path.abspath(source))
+        with tempfile.TemporaryDirectory() as scratch:
+            for group in parse(source):
+                for command in group.commands:
+                    commands += 1
+                    result = subprocess.run(
+                        expand(command, bin_dir, test_dir, scratch), shell=True,
+                        cwd=scratch, capture_output=True, text=True)
+                    problems = check(group, result)
+                    if not problems:
+                        continue
+                    failures += 1
+                    print(f"{source}: {command}")
+                    for problem in problems:
+                        print(f"  {problem}")
+
+    print(f"{commands} commands, {failures} failures")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
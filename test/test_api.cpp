@@ -0,0 +1,105 @@
+//===- test_api.cpp - Round trip through the embedding API ----------------===//
+//
+//===----------------------------------------------------------------------===//
+//
+// This file drives libpony the way an application embedding it would, on the
+// Pony program given on the command line: it compiles the program with
+// `multiply_transpose` as an entry point, calls it on buffers of its own and
+// runs `main`, then misuses the API and prints the errors it reports.
+// test_23.pony holds the program and the output expected from all of it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "pony/Pony.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// Print the shape and the values of `tensor`, a row per line.
+static void printTensor(const pony::Tensor &tensor) {
+  llvm::ArrayRef<int64_t> shape = tensor.shape();
+  llvm::outs() << "shape";
+  for (int64_t dim : shape)
+    llvm::outs() << ' ' << dim;
+  llvm::outs() << '\n';
+
+  int64_t numElements = 1;
+  for (int64_t dim : shape)
+    numElements *= dim;
+  int64_t rowSize = shape.empty() ? 1 : shape.back();
+  for (int64_t i = 0; i != numElements; ++i) {
+    llvm::outs() << llvm::format("%f ", tensor.data()[i]);
+    if ((i + 1) % rowSize == 0)
+      llvm::outs() << '\n';
+  }
+}
+
+/// Print the error `value` holds, or say that there is none.
+template <typename T> static void printError(llvm::Expected<T> value) {
+  if (value) {
+    llvm::outs() << "no error\n";
+    return;
+  }
+  llvm::outs() << "error: " << llvm::toString(value.takeError()) << '\n';
+}
+
+int main(int argc, char **argv) {
+  llvm::InitLLVM y(argc, argv);
+  if (argc != 2) {
+    llvm::errs() << "usage: " << argv[0] << " <file.pony>\n";
+    return 1;
+  }
+  auto fileOrErr = llvm::MemoryBuffer::getFile(argv[1]);
+  if (std::error_code ec = fileOrErr.getError()) {
+    llvm::errs() << "Could not open input file: " << ec.message() << "\n";
+    return 1;
+  }
+  llvm::StringRef source = (*fileOrErr)->getBuffer();
+
+  auto module = pony::CompiledModule::compile(
+      source, {{"multiply_transpose", {{2, 3}, {2, 3}}}});
+  if (!module) {
+    llvm::errs() << "Failed to compile: "
+                 << llvm::toString(module.takeError()) << "\n";
+    return 1;
+  }
+  auto function = (*module)->lookup("multiply_transpose");
+  if (!function) {
+    llvm::errs() << "Failed to look up multiply_transpose: "
+                 << llvm::toString(function.takeError()) << "\n";
+    return 1;
+  }
+
+  // The arguments are read where they are, so changing them in place changes
+  // the next result.
+  double a[6] = {1, 2, 3, 4, 5, 6};
+  double b[6] = {6, 5, 4, 3, 2, 1};
+  for (int i = 0; i != 2; ++i) {
+    auto result = function->invoke({{a, {2, 3}}, {b, {2, 3}}});
+    if (!result) {
+      llvm::errs() << "Failed to call multiply_transpose: "
+                   << llvm::toString(result.takeError()) << "\n";
+      return 1;
+    }
+    printTensor(*result);
+    a[0] = 10;
+  }
+
+  // What main prints goes straight to stdout.
+  llvm::outs() << "main:\n";
+  llvm::outs().flush();
+  if (llvm::Error err = (*module)->runMain()) {
+    llvm::errs() << "Failed to run main: " << llvm::toString(std::move(err))
+                 << "\n";
+    return 1;
+  }
+
+  printError(function->invoke({{a, {3, 2}}, {b, {2, 3}}}));
+  printError(function->invoke({{a, {2, 3}}}));
+  printError((*module)->lookup("transpose_all"));
+  printError(pony::CompiledModule::compile(source, {{"missing", {}}}));
+  printError(pony::CompiledModule::compile("def main() {"));
+  return 0;
+}